@@ -0,0 +1,417 @@
+// blake3.h -- header-only BLAKE3 (hash mode, 32-byte output) for the RDMA tools
+//
+// Portable compression function plus an AVX2 path that compresses eight
+// 1 KiB chunks side by side (one chunk per 32-bit lane). The AVX2 path is
+// picked at runtime, so the same binary runs on machines without it.
+#ifndef BLAKE3_H
+#define BLAKE3_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLAKE3_HAVE_AVX2 1
+#endif
+
+#define BLAKE3_OUT_LEN 32
+#define BLAKE3_BLOCK_LEN 64
+#define BLAKE3_CHUNK_LEN 1024
+#define BLAKE3_MAX_DEPTH 54
+
+enum {
+    B3_CHUNK_START = 1 << 0,
+    B3_CHUNK_END = 1 << 1,
+    B3_PARENT = 1 << 2,
+    B3_ROOT = 1 << 3,
+};
+
+static const uint32_t B3_IV[8] = {
+    0x6A09E667UL, 0xBB67AE85UL, 0x3C6EF372UL, 0xA54FF53AUL,
+    0x510E527FUL, 0x9B05688CUL, 0x1F83D9ABUL, 0x5BE0CD19UL,
+};
+
+static const uint8_t B3_MSG_SCHEDULE[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+static inline uint32_t b3_load32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void b3_store32(uint8_t *p, uint32_t w) {
+    p[0] = (uint8_t)w; p[1] = (uint8_t)(w >> 8); p[2] = (uint8_t)(w >> 16); p[3] = (uint8_t)(w >> 24);
+}
+
+static inline uint32_t b3_rotr(uint32_t w, int c) { return (w >> c) | (w << (32 - c)); }
+
+#define B3_G(s, a, b, c, d, x, y) do {                       \
+    s[a] = s[a] + s[b] + (x); s[d] = b3_rotr(s[d] ^ s[a], 16); \
+    s[c] = s[c] + s[d];       s[b] = b3_rotr(s[b] ^ s[c], 12); \
+    s[a] = s[a] + s[b] + (y); s[d] = b3_rotr(s[d] ^ s[a], 8);  \
+    s[c] = s[c] + s[d];       s[b] = b3_rotr(s[b] ^ s[c], 7);  \
+} while (0)
+
+// compress one 64-byte block; out receives the 8-word chaining value
+static inline void b3_compress(const uint32_t cv[8], const uint8_t block[BLAKE3_BLOCK_LEN],
+                               uint8_t block_len, uint64_t counter, uint8_t flags, uint32_t out[8]) {
+    uint32_t m[16], s[16];
+    for (int i = 0; i < 16; i++) m[i] = b3_load32(block + 4 * i);
+    for (int i = 0; i < 8; i++) s[i] = cv[i];
+    s[8] = B3_IV[0]; s[9] = B3_IV[1]; s[10] = B3_IV[2]; s[11] = B3_IV[3];
+    s[12] = (uint32_t)counter; s[13] = (uint32_t)(counter >> 32);
+    s[14] = block_len; s[15] = flags;
+    for (int r = 0; r < 7; r++) {
+        const uint8_t *k = B3_MSG_SCHEDULE[r];
+        B3_G(s, 0, 4, 8, 12, m[k[0]], m[k[1]]);
+        B3_G(s, 1, 5, 9, 13, m[k[2]], m[k[3]]);
+        B3_G(s, 2, 6, 10, 14, m[k[4]], m[k[5]]);
+        B3_G(s, 3, 7, 11, 15, m[k[6]], m[k[7]]);
+        B3_G(s, 0, 5, 10, 15, m[k[8]], m[k[9]]);
+        B3_G(s, 1, 6, 11, 12, m[k[10]], m[k[11]]);
+        B3_G(s, 2, 7, 8, 13, m[k[12]], m[k[13]]);
+        B3_G(s, 3, 4, 9, 14, m[k[14]], m[k[15]]);
+    }
+    for (int i = 0; i < 8; i++) out[i] = s[i] ^ s[i + 8];
+}
+
+// chaining value of one full 1 KiB chunk
+static inline void b3_hash_chunk(const uint8_t *in, uint64_t counter, uint32_t out[8]) {
+    uint32_t cv[8];
+    memcpy(cv, B3_IV, sizeof(cv));
+    for (int b = 0; b < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN; b++) {
+        uint8_t flags = (b == 0 ? B3_CHUNK_START : 0) |
+                        (b == BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1 ? B3_CHUNK_END : 0);
+        b3_compress(cv, in + b * BLAKE3_BLOCK_LEN, BLAKE3_BLOCK_LEN, counter, flags, cv);
+    }
+    memcpy(out, cv, sizeof(cv));
+}
+
+#ifdef BLAKE3_HAVE_AVX2
+#define B3V_ROT(x, c) _mm256_or_si256(_mm256_srli_epi32((x), (c)), _mm256_slli_epi32((x), 32 - (c)))
+#define B3V_G(v, a, b, c, d, x, y) do {                                                           \
+    v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), (x)); v[d] = B3V_ROT(_mm256_xor_si256(v[d], v[a]), 16); \
+    v[c] = _mm256_add_epi32(v[c], v[d]);                        v[b] = B3V_ROT(_mm256_xor_si256(v[b], v[c]), 12); \
+    v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), (y)); v[d] = B3V_ROT(_mm256_xor_si256(v[d], v[a]), 8);  \
+    v[c] = _mm256_add_epi32(v[c], v[d]);                        v[b] = B3V_ROT(_mm256_xor_si256(v[b], v[c]), 7);  \
+} while (0)
+
+// eight full chunks at once; lane i hashes in[i] with chunk counter counter + i
+__attribute__((target("avx2")))
+static void b3_hash_8_chunks_avx2(const uint8_t *const in[8], uint64_t counter, uint32_t out[8][8]) {
+    __m256i cv[8];
+    for (int i = 0; i < 8; i++) cv[i] = _mm256_set1_epi32((int)B3_IV[i]);
+    uint32_t lo[8], hi[8];
+    for (int l = 0; l < 8; l++) { lo[l] = (uint32_t)(counter + l); hi[l] = (uint32_t)((counter + l) >> 32); }
+    const __m256i ctr_lo = _mm256_loadu_si256((const __m256i *)lo);
+    const __m256i ctr_hi = _mm256_loadu_si256((const __m256i *)hi);
+
+    for (int b = 0; b < BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN; b++) {
+        uint8_t flags = (b == 0 ? B3_CHUNK_START : 0) |
+                        (b == BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN - 1 ? B3_CHUNK_END : 0);
+        __m256i m[16], v[16];
+        for (int w = 0; w < 16; w++) {
+            size_t off = (size_t)b * BLAKE3_BLOCK_LEN + 4 * w;
+            m[w] = _mm256_setr_epi32((int)b3_load32(in[0] + off), (int)b3_load32(in[1] + off),
+                                     (int)b3_load32(in[2] + off), (int)b3_load32(in[3] + off),
+                                     (int)b3_load32(in[4] + off), (int)b3_load32(in[5] + off),
+                                     (int)b3_load32(in[6] + off), (int)b3_load32(in[7] + off));
+        }
+        for (int i = 0; i < 8; i++) v[i] = cv[i];
+        for (int i = 0; i < 4; i++) v[8 + i] = _mm256_set1_epi32((int)B3_IV[i]);
+        v[12] = ctr_lo; v[13] = ctr_hi;
+        v[14] = _mm256_set1_epi32(BLAKE3_BLOCK_LEN);
+        v[15] = _mm256_set1_epi32(flags);
+        for (int r = 0; r < 7; r++) {
+            const uint8_t *k = B3_MSG_SCHEDULE[r];
+            B3V_G(v, 0, 4, 8, 12, m[k[0]], m[k[1]]);
+            B3V_G(v, 1, 5, 9, 13, m[k[2]], m[k[3]]);
+            B3V_G(v, 2, 6, 10, 14, m[k[4]], m[k[5]]);
+            B3V_G(v, 3, 7, 11, 15, m[k[6]], m[k[7]]);
+            B3V_G(v, 0, 5, 10, 15, m[k[8]], m[k[9]]);
+            B3V_G(v, 1, 6, 11, 12, m[k[10]], m[k[11]]);
+            B3V_G(v, 2, 7, 8, 13, m[k[12]], m[k[13]]);
+            B3V_G(v, 3, 4, 9, 14, m[k[14]], m[k[15]]);
+        }
+        for (int i = 0; i < 8; i++) cv[i] = _mm256_xor_si256(v[i], v[i + 8]);
+    }
+
+    uint32_t words[8][8];
+    for (int i = 0; i < 8; i++) _mm256_storeu_si256((__m256i *)words[i], cv[i]);
+    for (int l = 0; l < 8; l++)
+        for (int i = 0; i < 8; i++) out[l][i] = words[i][l];
+}
+
+static inline int b3_use_avx2(void) {
+    static int cached = -1;
+    if (cached < 0) cached = __builtin_cpu_supports("avx2") ? 1 : 0;
+    return cached;
+}
+#endif
+
+// chaining values of n contiguous full chunks starting at chunk counter `counter`
+static inline void b3_hash_many(const uint8_t *in, size_t n, uint64_t counter, uint32_t (*out)[8]) {
+    size_t i = 0;
+#ifdef BLAKE3_HAVE_AVX2
+    if (b3_use_avx2()) {
+        for (; i + 8 <= n; i += 8) {
+            const uint8_t *lanes[8];
+            for (int l = 0; l < 8; l++) lanes[l] = in + (i + l) * BLAKE3_CHUNK_LEN;
+            b3_hash_8_chunks_avx2(lanes, counter + i, (uint32_t (*)[8])out[i]);
+        }
+    }
+#endif
+    for (; i < n; i++) b3_hash_chunk(in + i * BLAKE3_CHUNK_LEN, counter + i, out[i]);
+}
+
+// ---------- incremental hasher ----------
+
+typedef struct {
+    uint32_t cv[8];
+    uint64_t chunk_counter;
+    uint8_t block[BLAKE3_BLOCK_LEN];
+    uint8_t block_len;
+    uint8_t blocks_compressed;
+    uint32_t cv_stack[BLAKE3_MAX_DEPTH][8];
+    uint8_t cv_stack_len;
+} blake3_hasher;
+
+static inline void blake3_hasher_init(blake3_hasher *h) {
+    memcpy(h->cv, B3_IV, sizeof(h->cv));
+    h->chunk_counter = 0;
+    h->block_len = 0;
+    h->blocks_compressed = 0;
+    h->cv_stack_len = 0;
+}
+
+static inline size_t b3_chunk_len(const blake3_hasher *h) {
+    return (size_t)h->blocks_compressed * BLAKE3_BLOCK_LEN + h->block_len;
+}
+
+static inline void b3_parent_cv(const uint32_t l[8], const uint32_t r[8], uint8_t flags, uint32_t out[8]) {
+    uint8_t block[BLAKE3_BLOCK_LEN];
+    for (int i = 0; i < 8; i++) { b3_store32(block + 4 * i, l[i]); b3_store32(block + 32 + 4 * i, r[i]); }
+    b3_compress(B3_IV, block, BLAKE3_BLOCK_LEN, 0, B3_PARENT | flags, out);
+}
+
+// merge completed subtrees: one merge per trailing zero bit of total_chunks
+static inline void b3_push_cv(blake3_hasher *h, uint32_t cv[8], uint64_t total_chunks) {
+    while ((total_chunks & 1) == 0) {
+        h->cv_stack_len--;
+        b3_parent_cv(h->cv_stack[h->cv_stack_len], cv, 0, cv);
+        total_chunks >>= 1;
+    }
+    memcpy(h->cv_stack[h->cv_stack_len++], cv, 8 * sizeof(uint32_t));
+}
+
+static inline void blake3_hasher_update(blake3_hasher *h, const void *data, size_t len) {
+    const uint8_t *in = (const uint8_t *)data;
+    while (len > 0) {
+        if (b3_chunk_len(h) == BLAKE3_CHUNK_LEN) {
+            // current chunk is full and more input follows, so it is not the root
+            uint32_t cv[8];
+            b3_compress(h->cv, h->block, h->block_len, h->chunk_counter,
+                        B3_CHUNK_END | (h->blocks_compressed == 0 ? B3_CHUNK_START : 0), cv);
+            b3_push_cv(h, cv, ++h->chunk_counter);
+            memcpy(h->cv, B3_IV, sizeof(h->cv));
+            h->block_len = 0;
+            h->blocks_compressed = 0;
+        }
+        if (b3_chunk_len(h) == 0 && len > BLAKE3_CHUNK_LEN) {
+            // whole chunks that are certainly not the last one go through hash_many
+            size_t n = (len - 1) / BLAKE3_CHUNK_LEN;
+            if (n > 64) n = 64;
+            uint32_t cvs[64][8];
+            b3_hash_many(in, n, h->chunk_counter, cvs);
+            for (size_t i = 0; i < n; i++) b3_push_cv(h, cvs[i], ++h->chunk_counter);
+            in += n * BLAKE3_CHUNK_LEN;
+            len -= n * BLAKE3_CHUNK_LEN;
+            continue;
+        }
+        if (h->block_len == BLAKE3_BLOCK_LEN) {
+            b3_compress(h->cv, h->block, BLAKE3_BLOCK_LEN, h->chunk_counter,
+                        h->blocks_compressed == 0 ? B3_CHUNK_START : 0, h->cv);
+            h->blocks_compressed++;
+            h->block_len = 0;
+        }
+        size_t want = BLAKE3_BLOCK_LEN - h->block_len;
+        size_t room = BLAKE3_CHUNK_LEN - b3_chunk_len(h);
+        if (want > room) want = room;
+        if (want > len) want = len;
+        memcpy(h->block + h->block_len, in, want);
+        h->block_len += (uint8_t)want;
+        in += want;
+        len -= want;
+    }
+}
+
+static inline void blake3_hasher_finalize(const blake3_hasher *h, uint8_t out[BLAKE3_OUT_LEN]) {
+    uint8_t block[BLAKE3_BLOCK_LEN] = {0};
+    memcpy(block, h->block, h->block_len);
+    uint8_t flags = B3_CHUNK_END | (h->blocks_compressed == 0 ? B3_CHUNK_START : 0);
+    uint32_t cv[8];
+    if (h->cv_stack_len == 0) {
+        b3_compress(h->cv, block, h->block_len, h->chunk_counter, flags | B3_ROOT, cv);
+    } else {
+        b3_compress(h->cv, block, h->block_len, h->chunk_counter, flags, cv);
+        for (int i = h->cv_stack_len - 1; i >= 0; i--)
+            b3_parent_cv(h->cv_stack[i], cv, i == 0 ? B3_ROOT : 0, cv);
+    }
+    for (int i = 0; i < 8; i++) b3_store32(out + 4 * i, cv[i]);
+}
+
+static inline void blake3(const void *data, size_t len, uint8_t out[BLAKE3_OUT_LEN]) {
+    blake3_hasher h;
+    blake3_hasher_init(&h);
+    blake3_hasher_update(&h, data, len);
+    blake3_hasher_finalize(&h, out);
+}
+
+// ---------- tree-parallel one-shot hashing ----------
+
+// chaining value of one chunk of 1..1024 bytes (or the empty root chunk)
+static inline void b3_chunk_cv(const uint8_t *in, size_t len, uint64_t counter, uint8_t root, uint32_t out[8]) {
+    uint32_t cv[8];
+    uint8_t block[BLAKE3_BLOCK_LEN];
+    memcpy(cv, B3_IV, sizeof(cv));
+    size_t nblocks = len ? (len + BLAKE3_BLOCK_LEN - 1) / BLAKE3_BLOCK_LEN : 1;
+    for (size_t b = 0; b < nblocks; b++) {
+        size_t blen = (b == nblocks - 1) ? len - b * BLAKE3_BLOCK_LEN : BLAKE3_BLOCK_LEN;
+        memset(block, 0, sizeof(block));
+        memcpy(block, in + b * BLAKE3_BLOCK_LEN, blen);
+        uint8_t flags = (b == 0 ? B3_CHUNK_START : 0) | (b == nblocks - 1 ? B3_CHUNK_END | root : 0);
+        b3_compress(cv, block, (uint8_t)blen, counter, flags, cv);
+    }
+    memcpy(out, cv, sizeof(cv));
+}
+
+// bytes in the left subtree: the largest power-of-two number of chunks that leaves the right non-empty
+static inline size_t b3_left_len(size_t len) {
+    size_t chunks = (len - 1) / BLAKE3_CHUNK_LEN;
+    size_t p = 1;
+    while (p * 2 <= chunks) p *= 2;
+    return p * BLAKE3_CHUNK_LEN;
+}
+
+// non-root chaining value of the subtree over in[0..len), first chunk numbered counter
+static inline void b3_subtree_cv(const uint8_t *in, size_t len, uint64_t counter, uint32_t out[8]) {
+    if (len <= BLAKE3_CHUNK_LEN) { b3_chunk_cv(in, len, counter, 0, out); return; }
+    size_t n = len / BLAKE3_CHUNK_LEN;
+    if (len % BLAKE3_CHUNK_LEN == 0 && n <= 64 && (n & (n - 1)) == 0) {
+        uint32_t cvs[64][8];
+        b3_hash_many(in, n, counter, cvs);
+        for (; n > 1; n /= 2)
+            for (size_t i = 0; i < n / 2; i++) b3_parent_cv(cvs[2 * i], cvs[2 * i + 1], 0, cvs[i]);
+        memcpy(out, cvs[0], 8 * sizeof(uint32_t));
+        return;
+    }
+    size_t left = b3_left_len(len);
+    uint32_t l[8], r[8];
+    b3_subtree_cv(in, left, counter, l);
+    b3_subtree_cv(in + left, len - left, counter + left / BLAKE3_CHUNK_LEN, r);
+    b3_parent_cv(l, r, 0, out);
+}
+
+// ---------- digests from pieces hashed out of order ----------
+
+// An input cut into aligned pieces of piece_len bytes (a power-of-two number
+// of chunks; only the last piece may be short) can be hashed piece by piece in
+// any order, e.g. by whichever thread sends each piece, and the digest
+// assembled afterwards from the pieces' chaining values.
+
+// non-root chaining value of piece `index`
+static inline void blake3_piece_cv(const void *data, size_t len, uint64_t index, size_t piece_len, uint32_t out[8]) {
+    b3_subtree_cv((const uint8_t *)data, len, index * (piece_len / BLAKE3_CHUNK_LEN), out);
+}
+
+static inline void b3_pieces_cv(const uint32_t (*cvs)[8], uint64_t start, uint64_t len, size_t piece_len,
+                                uint8_t flags, uint32_t out[8]) {
+    if (len <= piece_len) { memcpy(out, cvs[start / piece_len], 8 * sizeof(uint32_t)); return; }
+    // the left subtree is a power of two chunks, at least one piece, so both halves start on a piece
+    uint64_t left = b3_left_len((size_t)len);
+    uint32_t l[8], r[8];
+    b3_pieces_cv(cvs, start, left, piece_len, 0, l);
+    b3_pieces_cv(cvs, start + left, len - left, piece_len, 0, r);
+    b3_parent_cv(l, r, flags, out);
+}
+
+// digest of an input of total_len > piece_len bytes from the chaining values of all its pieces
+static inline void blake3_from_pieces(const uint32_t (*cvs)[8], uint64_t total_len, size_t piece_len,
+                                      uint8_t out[BLAKE3_OUT_LEN]) {
+    uint32_t cv[8];
+    b3_pieces_cv(cvs, 0, total_len, piece_len, B3_ROOT, cv);
+    for (int i = 0; i < 8; i++) b3_store32(out + 4 * i, cv[i]);
+}
+
+#ifdef BLAKE3_PARALLEL
+#include <pthread.h>
+
+struct b3_job {
+    const uint8_t *in;
+    size_t len;
+    uint64_t counter;
+    int threads;
+    uint32_t cv[8];
+};
+
+static void *b3_job_run(void *arg);
+
+// split the subtree across up to job->threads threads, left half on a new thread
+static void b3_subtree_cv_mt(struct b3_job *job) {
+    if (job->threads <= 1 || job->len <= 64 * BLAKE3_CHUNK_LEN) {
+        b3_subtree_cv(job->in, job->len, job->counter, job->cv);
+        return;
+    }
+    size_t left = b3_left_len(job->len);
+    struct b3_job l = {job->in, left, job->counter, job->threads / 2, {0}};
+    struct b3_job r = {job->in + left, job->len - left, job->counter + left / BLAKE3_CHUNK_LEN,
+                       job->threads - job->threads / 2, {0}};
+    pthread_t t;
+    int spawned = pthread_create(&t, NULL, b3_job_run, &l) == 0;
+    if (!spawned) b3_subtree_cv_mt(&l);
+    b3_subtree_cv_mt(&r);
+    if (spawned) pthread_join(t, NULL);
+    b3_parent_cv(l.cv, r.cv, 0, job->cv);
+}
+
+static void *b3_job_run(void *arg) { b3_subtree_cv_mt((struct b3_job *)arg); return NULL; }
+
+// one-shot digest of an in-memory (e.g. mmap'ed) buffer using up to `threads` threads
+static inline void blake3_parallel(const void *data, size_t len, int threads, uint8_t out[BLAKE3_OUT_LEN]) {
+    const uint8_t *in = (const uint8_t *)data;
+    uint32_t cv[8];
+    if (len <= BLAKE3_CHUNK_LEN) {
+        b3_chunk_cv(in, len, 0, B3_ROOT, cv);
+    } else {
+        size_t left = b3_left_len(len);
+        struct b3_job l = {in, left, 0, threads / 2 > 0 ? threads / 2 : 1, {0}};
+        struct b3_job r = {in + left, len - left, left / BLAKE3_CHUNK_LEN,
+                           threads - threads / 2 > 0 ? threads - threads / 2 : 1, {0}};
+        pthread_t t;
+        int spawned = threads > 1 && pthread_create(&t, NULL, b3_job_run, &l) == 0;
+        if (!spawned) b3_subtree_cv_mt(&l);
+        b3_subtree_cv_mt(&r);
+        if (spawned) pthread_join(t, NULL);
+        b3_parent_cv(l.cv, r.cv, B3_ROOT, cv);
+    }
+    for (int i = 0; i < 8; i++) b3_store32(out + 4 * i, cv[i]);
+}
+#endif
+
+static inline void blake3_hex(const uint8_t digest[BLAKE3_OUT_LEN], char hex[2 * BLAKE3_OUT_LEN + 1]) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < BLAKE3_OUT_LEN; i++) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 0xf];
+    }
+    hex[2 * BLAKE3_OUT_LEN] = '\0';
+}
+
+#endif
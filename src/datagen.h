@@ -0,0 +1,245 @@
+// datagen.h -- deterministic synthetic test data for the RDMA tools
+//
+// Data is produced in DATAGEN_BLOCK-sized blocks and every block is a pure
+// function of (seed, block index), so any range can be generated directly
+// into a buffer, in any order and from any number of threads, and two runs
+// with the same parameters produce identical bytes.
+#ifndef DATAGEN_H
+#define DATAGEN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DATAGEN_HAVE_AVX2 1
+#endif
+
+#define DATAGEN_BLOCK 4096
+#define DATAGEN_DUP_POOL 64     // distinct contents shared by duplicated blocks
+
+enum datagen_profile {
+    DG_RANDOM,      // incompressible PRNG output
+    DG_TEXT,        // words and line breaks from a small vocabulary
+    DG_ZEROS,       // all zero
+    DG_SPARSE,      // mostly zero blocks, one random block in 16
+};
+
+struct datagen {
+    enum datagen_profile profile;
+    uint64_t seed;
+    double compressibility;     // fraction of each block replaced by a constant run
+    double dup_ratio;           // fraction of blocks that repeat content from a small pool
+};
+
+static inline const char *datagen_profile_name(enum datagen_profile p) {
+    switch (p) {
+    case DG_RANDOM: return "random";
+    case DG_TEXT: return "text";
+    case DG_ZEROS: return "zeros";
+    case DG_SPARSE: return "sparse";
+    }
+    return "?";
+}
+
+static inline int datagen_parse_profile(const char *s, enum datagen_profile *out) {
+    for (int p = DG_RANDOM; p <= DG_SPARSE; p++) {
+        if (strcasecmp(s, datagen_profile_name((enum datagen_profile)p)) == 0) {
+            *out = (enum datagen_profile)p;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// sizes like 4096, 64K, 10M, 2G
+static inline uint64_t datagen_parse_size(const char *s) {
+    char *end;
+    uint64_t v = strtoull(s, &end, 10);
+    switch (*end) {
+    case 'k': case 'K': v <<= 10; break;
+    case 'm': case 'M': v <<= 20; break;
+    case 'g': case 'G': v <<= 30; break;
+    default: break;
+    }
+    return v;
+}
+
+static inline uint64_t dg_splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static inline uint64_t dg_rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+// xoshiro256** with four independent lanes; lane l is seeded from (key, l)
+struct dg_rng { uint64_t s[4][4]; };   // s[word][lane]
+
+static inline void dg_rng_seed(struct dg_rng *r, uint64_t key) {
+    uint64_t x = key;
+    for (int l = 0; l < 4; l++)
+        for (int w = 0; w < 4; w++) r->s[w][l] = x = dg_splitmix64(x);
+}
+
+static inline uint64_t dg_next_lane(struct dg_rng *r, int l) {
+    uint64_t *s0 = &r->s[0][l], *s1 = &r->s[1][l], *s2 = &r->s[2][l], *s3 = &r->s[3][l];
+    uint64_t result = dg_rotl(*s1 * 5, 7) * 9;
+    uint64_t t = *s1 << 17;
+    *s2 ^= *s0; *s3 ^= *s1; *s1 ^= *s2; *s0 ^= *s3;
+    *s2 ^= t;
+    *s3 = dg_rotl(*s3, 45);
+    return result;
+}
+
+static inline void dg_fill_random_scalar(struct dg_rng *r, uint8_t *dst, size_t len) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+        for (int l = 0; l < 4; l++) {
+            uint64_t v = dg_next_lane(r, l);
+            memcpy(dst + i + 8 * l, &v, 8);
+        }
+    for (int l = 0; i < len; l = (l + 1) & 3) {
+        uint64_t v = dg_next_lane(r, l);
+        size_t n = len - i < 8 ? len - i : 8;
+        memcpy(dst + i, &v, n);
+        i += n;
+    }
+}
+
+#ifdef DATAGEN_HAVE_AVX2
+#define DG_ROTL256(x, k) _mm256_or_si256(_mm256_slli_epi64((x), (k)), _mm256_srli_epi64((x), 64 - (k)))
+
+// same sequence as the scalar path, four lanes per step; x*5 and x*9 done as shift+add
+__attribute__((target("avx2")))
+static void dg_fill_random_avx2(struct dg_rng *r, uint8_t *dst, size_t len) {
+    __m256i s0 = _mm256_loadu_si256((const __m256i *)r->s[0]);
+    __m256i s1 = _mm256_loadu_si256((const __m256i *)r->s[1]);
+    __m256i s2 = _mm256_loadu_si256((const __m256i *)r->s[2]);
+    __m256i s3 = _mm256_loadu_si256((const __m256i *)r->s[3]);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i x5 = _mm256_add_epi64(_mm256_slli_epi64(s1, 2), s1);
+        __m256i rot = DG_ROTL256(x5, 7);
+        __m256i out = _mm256_add_epi64(_mm256_slli_epi64(rot, 3), rot);
+        _mm256_storeu_si256((__m256i *)(dst + i), out);
+        __m256i t = _mm256_slli_epi64(s1, 17);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = DG_ROTL256(s3, 45);
+    }
+    _mm256_storeu_si256((__m256i *)r->s[0], s0);
+    _mm256_storeu_si256((__m256i *)r->s[1], s1);
+    _mm256_storeu_si256((__m256i *)r->s[2], s2);
+    _mm256_storeu_si256((__m256i *)r->s[3], s3);
+    if (i < len) dg_fill_random_scalar(r, dst + i, len - i);
+}
+#endif
+
+static inline void dg_fill_random(struct dg_rng *r, uint8_t *dst, size_t len) {
+#ifdef DATAGEN_HAVE_AVX2
+    static int avx2 = -1;
+    if (avx2 < 0) avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    if (avx2) { dg_fill_random_avx2(r, dst, len); return; }
+#endif
+    dg_fill_random_scalar(r, dst, len);
+}
+
+static const char *const DG_WORDS[] = {
+    "the", "of", "and", "to", "in", "is", "that", "for", "it", "as", "with", "was", "on", "be",
+    "at", "by", "this", "from", "or", "have", "an", "data", "file", "transfer", "network", "memory",
+    "remote", "direct", "access", "queue", "pair", "completion", "buffer", "throughput", "latency",
+    "server", "client", "packet", "register", "region", "kernel", "bypass", "zero", "copy",
+};
+
+static inline void dg_fill_text(struct dg_rng *r, uint8_t *dst, size_t len) {
+    size_t i = 0, col = 0;
+    while (i < len) {
+        uint64_t v = dg_next_lane(r, 0);
+        const char *w = DG_WORDS[v % (sizeof(DG_WORDS) / sizeof(DG_WORDS[0]))];
+        size_t wl = strlen(w);
+        for (size_t k = 0; k < wl && i < len; k++) dst[i++] = (uint8_t)w[k];
+        if (i >= len) break;
+        col += wl + 1;
+        if (col > 72 || ((v >> 32) & 63) == 0) { dst[i++] = '\n'; col = 0; }
+        else dst[i++] = ((v >> 40) & 15) == 0 ? ',' : ' ';
+    }
+}
+
+// is block `idx` a duplicate? if so, which pool entry does it copy
+static inline int dg_dup_slot(const struct datagen *g, uint64_t idx, uint64_t *slot) {
+    if (g->dup_ratio <= 0.0) return 0;
+    uint64_t h = dg_splitmix64(g->seed ^ (idx * 0xD1B54A32D192ED03ULL) ^ 0xA5A5A5A5ULL);
+    if ((double)(h >> 11) * (1.0 / 9007199254740992.0) >= g->dup_ratio) return 0;
+    *slot = (h & 0xFFFF) % DATAGEN_DUP_POOL;
+    return 1;
+}
+
+// generate block `idx` (len <= DATAGEN_BLOCK bytes; shorter only for the final block)
+static inline void datagen_block(const struct datagen *g, uint64_t idx, uint8_t *dst, size_t len) {
+    uint64_t key = g->seed ^ dg_splitmix64(idx);
+    uint64_t slot;
+    if (dg_dup_slot(g, idx, &slot)) key = dg_splitmix64(g->seed ^ 0x5EEDD0D0ULL ^ slot) | 1ULL << 63;
+
+    if (g->profile == DG_ZEROS || (g->profile == DG_SPARSE && (dg_splitmix64(key) & 15) != 0)) {
+        memset(dst, 0, len);
+        return;
+    }
+    struct dg_rng r;
+    dg_rng_seed(&r, key);
+    size_t keep = len;
+    if (g->compressibility > 0.0) {
+        keep = (size_t)((double)len * (1.0 - g->compressibility));
+        if (keep > len) keep = len;
+    }
+    if (g->profile == DG_TEXT) dg_fill_text(&r, dst, keep);
+    else dg_fill_random(&r, dst, keep);
+    // constant tail: compresses to almost nothing
+    memset(dst + keep, g->profile == DG_TEXT ? ' ' : 0, len - keep);
+}
+
+// fill dst with the stream bytes at [offset, offset + len)
+static inline void datagen_fill(const struct datagen *g, uint64_t offset, uint8_t *dst, size_t len) {
+    uint8_t tmp[DATAGEN_BLOCK];
+    while (len > 0) {
+        uint64_t idx = offset / DATAGEN_BLOCK;
+        size_t in_blk = (size_t)(offset % DATAGEN_BLOCK);
+        size_t n = DATAGEN_BLOCK - in_blk;
+        if (n > len) n = len;
+        if (in_blk == 0 && n == DATAGEN_BLOCK) {
+            datagen_block(g, idx, dst, DATAGEN_BLOCK);
+        } else {
+            datagen_block(g, idx, tmp, DATAGEN_BLOCK);
+            memcpy(dst, tmp + in_blk, n);
+        }
+        dst += n;
+        offset += n;
+        len -= n;
+    }
+}
+
+// "SIZE[:PROFILE[:COMPRESSIBILITY[:DUP_RATIO]]]", e.g. "100M:text:0.5:0.2"
+static inline int datagen_parse_spec(const char *spec, struct datagen *g, uint64_t *size) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    memset(g, 0, sizeof(*g));
+    g->profile = DG_RANDOM;
+    g->seed = 0x5D1F00D5ULL;
+    char *save, *tok = strtok_r(buf, ":", &save);
+    if (!tok) return -1;
+    *size = datagen_parse_size(tok);
+    if ((tok = strtok_r(NULL, ":", &save)) && datagen_parse_profile(tok, &g->profile) != 0) return -1;
+    if (tok && (tok = strtok_r(NULL, ":", &save))) g->compressibility = atof(tok);
+    if (tok && (tok = strtok_r(NULL, ":", &save))) g->dup_ratio = atof(tok);
+    return 0;
+}
+
+#endif
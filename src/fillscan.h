@@ -0,0 +1,86 @@
+// fillscan.h -- vectorized "is this buffer one repeated byte?" check for the send path
+//
+// fill_scan() compares every byte against the first one: AVX2 on x86 (picked
+// at runtime), NEON on AArch64, 64-bit words otherwise. It stops at the first
+// 128-byte stripe that differs, so ordinary data is rejected after a few loads
+// and only real constant runs are read end to end.
+#ifndef FILLSCAN_H
+#define FILLSCAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILLSCAN_HAVE_AVX2 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define FILLSCAN_HAVE_NEON 1
+#endif
+
+static inline int fill_scan_scalar(const uint8_t *p, size_t n, uint8_t b) {
+    uint64_t pat = 0x0101010101010101ULL * b, acc = 0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        uint64_t w[4];
+        memcpy(w, p + i, sizeof(w));
+        acc |= (w[0] ^ pat) | (w[1] ^ pat) | (w[2] ^ pat) | (w[3] ^ pat);
+        if (acc) return 0;
+    }
+    for (; i < n; i++) if (p[i] != b) return 0;
+    return 1;
+}
+
+#ifdef FILLSCAN_HAVE_AVX2
+__attribute__((target("avx2")))
+static int fill_scan_avx2(const uint8_t *p, size_t n, uint8_t b) {
+    const __m256i pat = _mm256_set1_epi8((char)b);
+    size_t i = 0;
+    for (; i + 128 <= n; i += 128) {
+        __m256i x0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(p + i)), pat);
+        __m256i x1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(p + i + 32)), pat);
+        __m256i x2 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(p + i + 64)), pat);
+        __m256i x3 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(p + i + 96)), pat);
+        __m256i acc = _mm256_or_si256(_mm256_or_si256(x0, x1), _mm256_or_si256(x2, x3));
+        if (!_mm256_testz_si256(acc, acc)) return 0;
+    }
+    return fill_scan_scalar(p + i, n - i, b);
+}
+#endif
+
+#ifdef FILLSCAN_HAVE_NEON
+static inline int fill_scan_neon(const uint8_t *p, size_t n, uint8_t b) {
+    const uint8x16_t pat = vdupq_n_u8(b);
+    size_t i = 0;
+    for (; i + 128 <= n; i += 128) {
+        uint8x16_t acc = vdupq_n_u8(0);
+        for (int k = 0; k < 8; k++) acc = vorrq_u8(acc, veorq_u8(vld1q_u8(p + i + 16 * k), pat));
+        if (vmaxvq_u8(acc) != 0) return 0;
+    }
+    return fill_scan_scalar(p + i, n - i, b);
+}
+#endif
+
+// returns 1 and sets *byte when p[0..n) is a single repeated byte value
+static inline int fill_scan(const void *buf, size_t n, uint8_t *byte) {
+    const uint8_t *p = (const uint8_t *)buf;
+    if (n == 0) return 0;
+    uint8_t b = p[0];
+    // cheap reject on the last byte before touching the whole buffer
+    if (p[n - 1] != b) return 0;
+    int same;
+#if defined(FILLSCAN_HAVE_AVX2)
+    static int avx2 = -1;
+    if (avx2 < 0) avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    same = avx2 ? fill_scan_avx2(p, n, b) : fill_scan_scalar(p, n, b);
+#elif defined(FILLSCAN_HAVE_NEON)
+    same = fill_scan_neon(p, n, b);
+#else
+    same = fill_scan_scalar(p, n, b);
+#endif
+    if (same) *byte = b;
+    return same;
+}
+
+#endif
@@ -0,0 +1,412 @@
+// netemu.h -- deterministic RC transport emulator for benchmarking without hardware
+//
+// Queue pairs, completion queues and post/poll calls with the semantics of
+// their verbs counterparts, over a modelled link: bandwidth, one-way latency,
+// jitter, random loss with RC retransmission, a bounded switch queue, and RNR
+// NAKs when a SEND finds no posted receive. Messages on a QP arrive in order
+// and a send completes when its ACK is back, so a sender may reuse a buffer
+// only after its completion, exactly as on RC.
+//
+// Time is a virtual clock by default: an actor that finds nothing to do calls
+// emu_step, which jumps to the next event. Runs are then a pure function of
+// the configuration and seed. EMU_CLOCK_REAL uses CLOCK_MONOTONIC instead.
+#ifndef NETEMU_H
+#define NETEMU_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define EMU_PKT_OVERHEAD 58     // RoCEv2 per-packet headers and CRCs on the wire
+#define EMU_RNR_INFINITE 7      // rnr_retry value that retries forever, as in the IB spec
+
+enum emu_clock { EMU_CLOCK_VIRTUAL, EMU_CLOCK_REAL };
+
+enum emu_wc_status {
+    EMU_WC_SUCCESS,
+    EMU_WC_LOC_LEN_ERR,         // the SEND did not fit the receive buffer
+    EMU_WC_RNR_RETRY_EXC_ERR,
+    EMU_WC_RETRY_EXC_ERR,       // every transmission attempt was lost
+    EMU_WC_WR_FLUSH_ERR,        // the QP went to the error state first
+};
+
+enum emu_wc_opcode { EMU_WC_SEND, EMU_WC_RDMA_WRITE, EMU_WC_RECV };
+enum emu_wr_opcode { EMU_WR_SEND, EMU_WR_RDMA_WRITE };
+
+struct emu_link {
+    double gbps;            // line rate of each direction
+    double latency_us;      // one way
+    double jitter_us;       // uniform extra delay per message; never reorders
+    double loss;            // probability that one transmission attempt is lost
+    double timeout_us;      // RC ACK timeout before a retransmission
+    int retry_cnt;
+    double rnr_timer_us;
+    int rnr_retry;          // EMU_RNR_INFINITE: never give up
+    size_t queue_bytes;     // switch buffer ahead of the link; 0: unlimited, else tail drop
+    uint32_t mtu;
+    uint32_t max_send_wr, max_recv_wr;
+};
+
+static inline struct emu_link emu_link_default(void) {
+    return (struct emu_link){.gbps = 100, .latency_us = 2, .timeout_us = 500, .retry_cnt = 7,
+                             .rnr_timer_us = 10, .rnr_retry = EMU_RNR_INFINITE, .mtu = 4096,
+                             .max_send_wr = 256, .max_recv_wr = 256};
+}
+
+struct emu_wc {
+    uint64_t wr_id;
+    enum emu_wc_status status;
+    enum emu_wc_opcode opcode;
+    uint32_t byte_len;
+};
+
+struct emu_cq {
+    struct emu_wc *wc;
+    int cap, head, count;
+};
+
+// a work request from post until its completion
+struct emu_msg {
+    uint64_t wr_id;
+    enum emu_wr_opcode opcode;
+    const void *buf;
+    uint32_t len;
+    void *remote;           // RDMA WRITE target
+    double arrive;          // when it reaches the peer, retransmissions included
+    enum emu_wc_status status;
+    int rnr_tries;
+};
+
+struct emu_recv {
+    uint64_t wr_id;
+    void *buf;
+    uint32_t len;
+};
+
+struct emu_qp_stats {
+    uint64_t msgs, bytes;
+    uint64_t rnr_naks, retransmits, drops;
+};
+
+struct emu_net;
+
+struct emu_qp {
+    struct emu_net *net;
+    struct emu_qp *peer;
+    struct emu_cq *send_cq, *recv_cq;
+    struct emu_msg *sq;         // [sq_head, sq_head + sq_count) posted; the first sq_sent have arrived
+    uint32_t sq_head, sq_count, sq_sent;
+    struct emu_recv *rq;
+    uint32_t rq_head, rq_count;
+    double link_free;           // our direction of the link is busy serializing until then
+    double last_arrive;
+    int error;
+    struct emu_qp_stats stats;
+};
+
+enum emu_event_kind { EMU_EV_ARRIVE, EMU_EV_SEND_DONE, EMU_EV_WAKE };
+
+struct emu_event {
+    double at;
+    uint64_t seq;               // ties break in insertion order, which keeps runs deterministic
+    enum emu_event_kind kind;
+    struct emu_qp *qp;
+};
+
+struct emu_net {
+    struct emu_link link;
+    enum emu_clock clock;
+    double now, t0;
+    uint64_t rng;
+    struct emu_event *ev;       // binary min-heap on (at, seq)
+    int nev, cap;
+    uint64_t seq;
+};
+
+static inline double emu_mono(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// uniform in [0, 1)
+static inline double emu_rand(struct emu_net *n) {
+    uint64_t x = (n->rng += 0x9E3779B97F4A7C15ULL);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return (double)((x ^ (x >> 31)) >> 11) / 9007199254740992.0;
+}
+
+static inline int emu_net_init(struct emu_net *n, const struct emu_link *link, enum emu_clock clock, uint64_t seed) {
+    memset(n, 0, sizeof(*n));
+    n->link = *link;
+    n->clock = clock;
+    n->rng = seed;
+    n->t0 = emu_mono();
+    n->cap = 256;
+    n->ev = malloc((size_t)n->cap * sizeof(*n->ev));
+    return n->ev ? 0 : -1;
+}
+
+static inline void emu_net_destroy(struct emu_net *n) { free(n->ev); }
+
+static inline double emu_now(struct emu_net *n) {
+    if (n->clock == EMU_CLOCK_REAL) n->now = emu_mono() - n->t0;
+    return n->now;
+}
+
+static inline int emu_ev_before(const struct emu_event *a, const struct emu_event *b) {
+    return a->at < b->at || (a->at == b->at && a->seq < b->seq);
+}
+
+static inline void emu_push(struct emu_net *n, double at, enum emu_event_kind kind, struct emu_qp *qp) {
+    if (n->nev == n->cap) {
+        struct emu_event *ev = realloc(n->ev, (size_t)n->cap * 2 * sizeof(*ev));
+        if (!ev) abort();
+        n->ev = ev;
+        n->cap *= 2;
+    }
+    int i = n->nev++;
+    struct emu_event e = {at, n->seq++, kind, qp};
+    while (i > 0 && emu_ev_before(&e, &n->ev[(i - 1) / 2])) {
+        n->ev[i] = n->ev[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    n->ev[i] = e;
+}
+
+static inline struct emu_event emu_pop(struct emu_net *n) {
+    struct emu_event top = n->ev[0], last = n->ev[--n->nev];
+    int i = 0;
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= n->nev) break;
+        if (c + 1 < n->nev && emu_ev_before(&n->ev[c + 1], &n->ev[c])) c++;
+        if (!emu_ev_before(&n->ev[c], &last)) break;
+        n->ev[i] = n->ev[c];
+        i = c;
+    }
+    if (n->nev > 0) n->ev[i] = last;
+    return top;
+}
+
+static inline int emu_cq_init(struct emu_cq *cq, int cap) {
+    memset(cq, 0, sizeof(*cq));
+    cq->cap = cap;
+    cq->wc = calloc((size_t)cap, sizeof(*cq->wc));
+    return cq->wc ? 0 : -1;
+}
+
+static inline void emu_cq_destroy(struct emu_cq *cq) { free(cq->wc); }
+
+static inline void emu_cq_push(struct emu_cq *cq, uint64_t wr_id, enum emu_wc_status status,
+                               enum emu_wc_opcode opcode, uint32_t len) {
+    if (cq->count == cq->cap) abort();     // a CQ overrun is fatal on real hardware too
+    cq->wc[(cq->head + cq->count++) % cq->cap] = (struct emu_wc){wr_id, status, opcode, len};
+}
+
+static inline int emu_qp_init(struct emu_qp *qp, struct emu_net *n, struct emu_cq *send_cq, struct emu_cq *recv_cq) {
+    memset(qp, 0, sizeof(*qp));
+    qp->net = n;
+    qp->send_cq = send_cq;
+    qp->recv_cq = recv_cq;
+    qp->sq = calloc(n->link.max_send_wr, sizeof(*qp->sq));
+    qp->rq = calloc(n->link.max_recv_wr, sizeof(*qp->rq));
+    return qp->sq && qp->rq ? 0 : -1;
+}
+
+static inline void emu_qp_destroy(struct emu_qp *qp) {
+    free(qp->sq);
+    free(qp->rq);
+}
+
+// an RC connection between a and b
+static inline void emu_connect(struct emu_qp *a, struct emu_qp *b) {
+    a->peer = b;
+    b->peer = a;
+}
+
+static inline struct emu_msg *emu_sq_at(struct emu_qp *qp, uint32_t i) {
+    return &qp->sq[(qp->sq_head + i) % qp->net->link.max_send_wr];
+}
+
+// the QP is in the error state: everything still queued completes with a flush error
+static inline void emu_qp_fail(struct emu_qp *qp) {
+    if (qp->error) return;
+    qp->error = 1;
+    for (uint32_t i = qp->sq_sent; i < qp->sq_count; i++) emu_sq_at(qp, i)->status = EMU_WC_WR_FLUSH_ERR;
+    for (; qp->rq_count > 0; qp->rq_count--, qp->rq_head = (qp->rq_head + 1) % qp->net->link.max_recv_wr)
+        emu_cq_push(qp->recv_cq, qp->rq[qp->rq_head].wr_id, EMU_WC_WR_FLUSH_ERR, EMU_WC_RECV, 0);
+}
+
+static inline int emu_post_recv(struct emu_qp *qp, uint64_t wr_id, void *buf, uint32_t len) {
+    struct emu_net *n = qp->net;
+    if (qp->error) return EINVAL;
+    if (qp->rq_count == n->link.max_recv_wr) return ENOMEM;
+    qp->rq[(qp->rq_head + qp->rq_count++) % n->link.max_recv_wr] = (struct emu_recv){wr_id, buf, len};
+    return 0;
+}
+
+// Post a SEND (remote NULL) or an RDMA WRITE to remote. The time on the wire,
+// the losses and the retransmissions are all decided here; delivery happens
+// in emu_step when the virtual or real clock reaches the arrival.
+static inline int emu_post_send(struct emu_qp *qp, uint64_t wr_id, enum emu_wr_opcode opcode,
+                                const void *buf, uint32_t len, void *remote) {
+    struct emu_net *n = qp->net;
+    const struct emu_link *l = &n->link;
+    if (qp->error) return EINVAL;
+    if (qp->sq_count == l->max_send_wr) return ENOMEM;
+    double now = emu_now(n);
+
+    uint32_t pkts = len ? (len + l->mtu - 1) / l->mtu : 1;
+    double wire = ((double)len + (double)pkts * EMU_PKT_OVERHEAD) * 8 / (l->gbps * 1e9);
+    double start = qp->link_free > now ? qp->link_free : now;
+    double extra = 0;
+    enum emu_wc_status status = EMU_WC_SUCCESS;
+    // bytes still waiting for the wire ahead of this message
+    if (l->queue_bytes && (start - now) * l->gbps * 1e9 / 8 + len > (double)l->queue_bytes) {
+        qp->stats.drops++;
+        qp->stats.retransmits++;
+        extra += l->timeout_us / 1e6;
+    }
+    int attempt = 0;
+    while (l->loss > 0 && emu_rand(n) < l->loss) {
+        if (++attempt > l->retry_cnt) {
+            status = EMU_WC_RETRY_EXC_ERR;
+            break;
+        }
+        qp->stats.retransmits++;
+        extra += l->timeout_us / 1e6;
+    }
+    qp->link_free = start + wire;
+    double arrive = qp->link_free + l->latency_us / 1e6 + extra;
+    if (l->jitter_us > 0) arrive += emu_rand(n) * l->jitter_us / 1e6;
+    if (arrive < qp->last_arrive) arrive = qp->last_arrive;   // RC delivers in order
+    qp->last_arrive = arrive;
+
+    struct emu_msg *m = emu_sq_at(qp, qp->sq_count);
+    *m = (struct emu_msg){wr_id, opcode, buf, len, remote, arrive, status, 0};
+    qp->sq_count++;
+    qp->stats.msgs++;
+    qp->stats.bytes += len;
+    if (qp->sq_count == qp->sq_sent + 1) emu_push(n, arrive, EMU_EV_ARRIVE, qp);
+    return 0;
+}
+
+// the oldest message in flight on qp reaches the peer (or is NAKed)
+static inline void emu_arrive(struct emu_qp *qp) {
+    struct emu_net *n = qp->net;
+    const struct emu_link *l = &n->link;
+    struct emu_msg *m = emu_sq_at(qp, qp->sq_sent);
+    struct emu_qp *peer = qp->peer;
+    double rtt = 2 * l->latency_us / 1e6;
+
+    if (m->status == EMU_WC_SUCCESS && !qp->error) {
+        if (!peer || peer->error) {
+            m->status = EMU_WC_RETRY_EXC_ERR;
+        } else if (m->opcode == EMU_WR_RDMA_WRITE) {
+            if (m->len) memcpy(m->remote, m->buf, m->len);
+        } else if (peer->rq_count == 0) {
+            // receiver not ready: NAK, wait out the RNR timer and try again
+            qp->stats.rnr_naks++;
+            if (l->rnr_retry == EMU_RNR_INFINITE || m->rnr_tries++ < l->rnr_retry) {
+                m->arrive = n->now + rtt + l->rnr_timer_us / 1e6;
+                emu_push(n, m->arrive, EMU_EV_ARRIVE, qp);
+                return;
+            }
+            m->status = EMU_WC_RNR_RETRY_EXC_ERR;
+        } else {
+            struct emu_recv r = peer->rq[peer->rq_head];
+            peer->rq_head = (peer->rq_head + 1) % l->max_recv_wr;
+            peer->rq_count--;
+            if (m->len > r.len) {
+                m->status = EMU_WC_LOC_LEN_ERR;
+                emu_cq_push(peer->recv_cq, r.wr_id, EMU_WC_LOC_LEN_ERR, EMU_WC_RECV, 0);
+                emu_qp_fail(peer);
+            } else {
+                if (m->len) memcpy(r.buf, m->buf, m->len);
+                emu_cq_push(peer->recv_cq, r.wr_id, EMU_WC_SUCCESS, EMU_WC_RECV, m->len);
+            }
+        }
+    }
+    qp->sq_sent++;
+    // the ACK (or the error) travels back before the sender sees a completion
+    emu_push(n, n->now + l->latency_us / 1e6, EMU_EV_SEND_DONE, qp);
+    if (qp->sq_sent < qp->sq_count) {
+        struct emu_msg *next = emu_sq_at(qp, qp->sq_sent);
+        emu_push(n, next->arrive > n->now ? next->arrive : n->now, EMU_EV_ARRIVE, qp);
+    }
+}
+
+static inline void emu_send_done(struct emu_qp *qp) {
+    struct emu_msg *m = emu_sq_at(qp, 0);
+    emu_cq_push(qp->send_cq, m->wr_id, m->status,
+                m->opcode == EMU_WR_RDMA_WRITE ? EMU_WC_RDMA_WRITE : EMU_WC_SEND, m->len);
+    qp->sq_head = (qp->sq_head + 1) % qp->net->link.max_send_wr;
+    qp->sq_count--;
+    qp->sq_sent--;
+    if (m->status != EMU_WC_SUCCESS) emu_qp_fail(qp);
+}
+
+static inline void emu_run(const struct emu_event *e) {
+    switch (e->kind) {
+    case EMU_EV_ARRIVE: emu_arrive(e->qp); break;
+    case EMU_EV_SEND_DONE: emu_send_done(e->qp); break;
+    case EMU_EV_WAKE: break;
+    }
+}
+
+// run every event that is due
+static inline void emu_progress(struct emu_net *n) {
+    double now = emu_now(n);
+    while (n->nev > 0 && n->ev[0].at <= now) {
+        struct emu_event e = emu_pop(n);
+        emu_run(&e);
+    }
+}
+
+// have emu_step stop at t, e.g. when an actor's modelled CPU work ends
+static inline void emu_wake_at(struct emu_net *n, double t) { emu_push(n, t, EMU_EV_WAKE, NULL); }
+
+// Nothing to do until something happens. Virtual clock: jump to the next
+// event and run everything due then. Real clock: run what is due, sleeping
+// through long gaps. Returns -1 when no event is pending, i.e. the actors
+// are deadlocked.
+static inline int emu_step(struct emu_net *n) {
+    if (n->nev == 0) return -1;
+    if (n->clock == EMU_CLOCK_VIRTUAL) {
+        if (n->ev[0].at > n->now) n->now = n->ev[0].at;
+    } else {
+        double gap = n->ev[0].at - emu_now(n);
+        if (gap > 1e-3) {
+            // tv_nsec must stay below one second, so long gaps are split
+            double sleep = gap - 5e-4;
+            struct timespec ts = {(time_t)sleep, (long)((sleep - (double)(time_t)sleep) * 1e9)};
+            nanosleep(&ts, NULL);
+        }
+    }
+    emu_progress(n);
+    return 0;
+}
+
+static inline int emu_poll_cq(struct emu_net *n, struct emu_cq *cq, int max, struct emu_wc *wc) {
+    if (n->clock == EMU_CLOCK_REAL) emu_progress(n);
+    int got = 0;
+    for (; got < max && cq->count > 0; got++, cq->count--, cq->head = (cq->head + 1) % cq->cap) wc[got] = cq->wc[cq->head];
+    return got;
+}
+
+static inline const char *emu_wc_status_str(enum emu_wc_status s) {
+    switch (s) {
+    case EMU_WC_SUCCESS: return "success";
+    case EMU_WC_LOC_LEN_ERR: return "local length error";
+    case EMU_WC_RNR_RETRY_EXC_ERR: return "RNR retry counter exceeded";
+    case EMU_WC_RETRY_EXC_ERR: return "transport retry counter exceeded";
+    case EMU_WC_WR_FLUSH_ERR: return "work request flushed";
+    }
+    return "unknown";
+}
+
+#endif
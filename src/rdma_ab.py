@@ -0,0 +1,269 @@
+#!/usr/bin/env python3
+# rdma_ab.py -- TCP vs RDMA A/B comparison with confidence intervals
+#
+# Both transports send the same files. Repetitions are interleaved in a
+# seeded random order, so drift in the machine (page cache, frequency,
+# other load) falls on both sides alike. Each transfer is one client
+# process, tcp_client.py or rdma_file_client. Client cycles per byte come
+# from the CPU time each client reports for its send phase alone, so the
+# Python interpreter's start-up does not count against TCP. Peak RSS comes
+# from wait4 and is shown for reference only: a Python interpreter against
+# a native client says nothing about the transports, so it gets no verdict.
+# Per workload the report gives medians with bootstrap confidence intervals,
+# completion-time percentiles, the RDMA/TCP ratio with its own interval, and
+# a Mann-Whitney p-value. Output is one JSON and one self-contained HTML file.
+
+import argparse
+import html
+import json
+import os
+import platform
+import random
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+from rdma_results import bootstrap_ci, mann_whitney_p, parse_result_line, parse_size, percentile, ratio_ci, record
+
+BASE_DIR = os.path.dirname(os.path.abspath(__file__))
+TRANSPORTS = ("tcp", "rdma")
+
+
+def cpu_hz():
+    """Nominal clock of this CPU, to turn CPU seconds into cycles."""
+    try:
+        with open("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq") as f:
+            return int(f.read()) * 1e3
+    except (OSError, ValueError):
+        pass
+    try:
+        with open("/proc/cpuinfo") as f:
+            m = re.search(r"^cpu MHz\s*:\s*([\d.]+)", f.read(), re.M)
+            if m:
+                return float(m.group(1)) * 1e6
+    except OSError:
+        pass
+    return 0.0
+
+
+def run_client(transport, path, server):
+    """One transfer; a sample dict, or None and the error."""
+    if transport == "tcp":
+        cmd = ["python3", "tcp_client.py", path, server]
+    else:
+        cmd = [os.path.join(BASE_DIR, "rdma_file_client"), server, path, "--no-zero-rtt"]
+    with tempfile.TemporaryFile("w+") as out:
+        try:
+            proc = subprocess.Popen(cmd, cwd=BASE_DIR, stdout=out, stderr=subprocess.STDOUT, text=True)
+        except OSError as e:
+            return None, str(e)
+        start = time.perf_counter()
+        _, status, ru = os.wait4(proc.pid, 0)
+        wall = time.perf_counter() - start
+        out.seek(0)
+        output = out.read()
+    code = os.waitstatus_to_exitcode(status)
+    # both times run from connection setup until the server confirms it has the whole file;
+    # neither covers process start
+    if transport == "tcp":
+        m = re.search(r"completed in ([\d.]+) seconds", output)
+        cpu = re.search(r"send phase CPU: ([\d.]+) seconds", output)
+        if code != 0 or not m or not cpu:
+            return None, output.strip().splitlines()[-1] if output.strip() else f"exit {code}"
+        took, cpu_s = float(m.group(1)), float(cpu.group(1))
+    else:
+        result = parse_result_line(output)
+        if not result or code != 0 or not result.get("digest_match", True):
+            return None, output.strip().splitlines()[-1] if output.strip() else f"exit {code}"
+        took = result["elapsed_s"] + result.get("phases", {}).get("connected_s", 0.0)
+        cpu_s = result["rusage"]["data"]["cpu_s"]
+    return {"time_s": took, "wall_s": wall, "cpu_s": cpu_s, "max_rss_kb": ru.ru_maxrss}, None
+
+
+def summarize(samples, size, hz, rng):
+    """Per-transport statistics for one workload."""
+    times = sorted(s["time_s"] for s in samples)
+    mbps = [size / s["time_s"] / 1e6 for s in samples]
+    cpb = [s["cpu_s"] * hz / size for s in samples] if hz else []
+    rss = [s["max_rss_kb"] / 1024 for s in samples]
+    out = {"n": len(samples)}
+    if not samples:
+        return out
+    out["throughput_mbps"] = {"median": statistics.median(mbps), "ci": bootstrap_ci(mbps, statistics.median, rng)}
+    out["time_s"] = {"median": statistics.median(times), "ci": bootstrap_ci(times, statistics.median, rng),
+                     "p50": percentile(times, 50), "p90": percentile(times, 90), "p99": percentile(times, 99)}
+    if cpb:
+        out["cycles_per_byte"] = {"median": statistics.median(cpb), "ci": bootstrap_ci(cpb, statistics.median, rng)}
+    out["max_rss_mb"] = {"median": statistics.median(rss), "ci": bootstrap_ci(rss, statistics.median, rng)}
+    return out
+
+
+def compare(tcp, rdma, key, rng, alpha):
+    """RDMA relative to TCP on one metric: ratio of medians with its interval, p-value, verdict."""
+    if not tcp or not rdma:
+        return None
+    ratio = statistics.median(rdma) / max(statistics.median(tcp), 1e-12)
+    lo, hi = ratio_ci(tcp, rdma, rng)
+    p = mann_whitney_p(tcp, rdma)
+    significant = p < alpha and not lo <= 1.0 <= hi
+    return {"metric": key, "ratio": ratio, "ci": (lo, hi), "p": p, "significant": significant}
+
+
+def render_html(report):
+    def fmt(m, scale=1.0, digits=2):
+        if not m:
+            return "-"
+        lo, hi = m["ci"]
+        return f"{m['median'] * scale:.{digits}f} <small>[{lo * scale:.{digits}f}, {hi * scale:.{digits}f}]</small>"
+
+    rows = []
+    for w in report["workloads"]:
+        t, r = w["tcp"], w["rdma"]
+        rows.append(f"<h2>{html.escape(w['name'])} ({w['size']} bytes), {t['n']} TCP / {r['n']} RDMA runs</h2>")
+        rows.append("<table><tr><th>metric</th><th>TCP</th><th>RDMA</th><th>RDMA/TCP</th><th>p</th></tr>")
+        metrics = [("throughput MB/s", "throughput_mbps", 1.0, 2), ("completion ms (median)", "time_s", 1e3, 3),
+                   ("client send cycles/byte", "cycles_per_byte", 1.0, 3),
+                   ("client process max RSS MB (not compared)", "max_rss_mb", 1.0, 1)]
+        for label, key, scale, digits in metrics:
+            c = w["compare"].get(key)
+            if c:
+                cls = "sig" if c["significant"] else "ns"
+                cmp_cell = (f"<td class={cls}>{c['ratio']:.3f} <small>[{c['ci'][0]:.3f}, {c['ci'][1]:.3f}]</small></td>"
+                            f"<td class={cls}>{c['p']:.4f}</td>")
+            else:
+                cmp_cell = "<td>-</td><td>-</td>"
+            rows.append(f"<tr><td>{label}</td><td>{fmt(t.get(key), scale, digits)}</td>"
+                        f"<td>{fmt(r.get(key), scale, digits)}</td>{cmp_cell}</tr>")
+        for p in ("p50", "p90", "p99"):
+            cells = "".join(f"<td>{s['time_s'][p] * 1e3:.3f}</td>" if "time_s" in s else "<td>-</td>" for s in (t, r))
+            rows.append(f"<tr><td>completion ms {p}</td>{cells}<td></td><td></td></tr>")
+        rows.append("</table>")
+        for e in w["errors"][:5]:
+            rows.append(f"<p class=err>{html.escape(e)}</p>")
+    meta = html.escape(", ".join(f"{k}: {v}" for k, v in report["meta"].items()))
+    return f"""<!doctype html>
+<html><head><meta charset="utf-8"><title>TCP vs RDMA</title><style>
+body {{ font-family: sans-serif; margin: 2em; }}
+table {{ border-collapse: collapse; margin-bottom: 1em; }}
+td, th {{ border: 1px solid #ccc; padding: 4px 10px; text-align: right; }}
+td:first-child, th:first-child {{ text-align: left; }}
+.sig {{ background: #d8f0d8; font-weight: bold; }}
+.ns {{ color: #888; }}
+.err {{ color: #a00; }}
+</style></head><body>
+<h1>TCP vs RDMA</h1>
+<p>{meta}</p>
+<p>Medians with {report['meta']['confidence']:.0%} bootstrap intervals in brackets. Highlighted ratios are
+significant: Mann-Whitney p below {report['meta']['alpha']} and an interval that excludes 1.</p>
+{chr(10).join(rows)}
+</body></html>
+"""
+
+
+def main():
+    ap = argparse.ArgumentParser(description="TCP vs RDMA A/B comparison report")
+    ap.add_argument("server", nargs="?", default="127.0.0.1")
+    ap.add_argument("--sizes", default="4K,1M,64M", help="comma-separated file sizes to send")
+    ap.add_argument("--file", action="append", default=[], help="send this file as a workload too, repeatable")
+    ap.add_argument("--reps", type=int, default=10, help="measured transfers per transport and workload")
+    ap.add_argument("--warmup", type=int, default=1, help="unmeasured transfers per transport first")
+    ap.add_argument("--alpha", type=float, default=0.05, help="significance level")
+    ap.add_argument("--seed", type=int, default=1)
+    ap.add_argument("--no-store", action="store_true", help="do not append the samples to the result store")
+    ap.add_argument("--start-servers", action="store_true", help="start local tcp_server.py and rdma_file_server")
+    ap.add_argument("--json", default=os.path.join(BASE_DIR, "logs", "ab_report.json"))
+    ap.add_argument("--html", default=os.path.join(BASE_DIR, "logs", "ab_report.html"))
+    args = ap.parse_args()
+
+    rng = random.Random(args.seed)
+    hz = cpu_hz()
+    os.makedirs(os.path.join(BASE_DIR, "logs"), exist_ok=True)
+    servers = []
+    if args.start_servers:
+        log = open(os.path.join(BASE_DIR, "logs", "rdma_ab_servers.log"), "w")
+        servers = [subprocess.Popen(["python3", "tcp_server.py", "--loop"], cwd=BASE_DIR, stdout=log, stderr=log),
+                   subprocess.Popen([os.path.join(BASE_DIR, "rdma_file_server"), "--multi"], cwd=BASE_DIR,
+                                    stdout=log, stderr=log)]
+        time.sleep(0.5)
+
+    tmp = tempfile.mkdtemp(prefix="rdma_ab_")
+    workloads = []
+    for s in filter(None, args.sizes.split(",")):
+        path = os.path.join(tmp, f"ab_{s}.bin")
+        with open(path, "wb") as f:
+            left = parse_size(s)
+            while left > 0:
+                f.write(os.urandom(min(left, 1 << 20)))
+                left -= 1 << 20
+        workloads.append((s, path))
+    workloads += [(os.path.basename(p), p) for p in args.file]
+
+    report = {"meta": {"server": args.server, "reps": args.reps, "warmup": args.warmup, "seed": args.seed,
+                       "alpha": args.alpha, "confidence": 0.95, "host": platform.node(), "kernel": platform.release(),
+                       "cpu_hz": hz, "date": time.strftime("%Y-%m-%d %H:%M:%S")}, "workloads": []}
+    try:
+        for name, path in workloads:
+            size = os.path.getsize(path)
+            samples = {t: [] for t in TRANSPORTS}
+            errors = []
+            for _ in range(args.warmup):
+                for t in TRANSPORTS:
+                    run_client(t, path, args.server)
+            # each rep runs both transports, in an order drawn afresh
+            for _ in range(args.reps):
+                for t in rng.sample(TRANSPORTS, len(TRANSPORTS)):
+                    sample, error = run_client(t, path, args.server)
+                    if sample:
+                        samples[t].append(sample)
+                    else:
+                        errors.append(f"{t}: {error}")
+            w = {"name": name, "size": size, "errors": errors,
+                 "samples": samples, "compare": {}}
+            for t in TRANSPORTS:
+                w[t] = summarize(samples[t], size, hz, rng)
+            # no max RSS here: the interpreter's footprint would decide that verdict, not the transport's
+            metric = {"throughput_mbps": lambda s: size / s["time_s"] / 1e6, "time_s": lambda s: s["time_s"]}
+            if hz:
+                metric["cycles_per_byte"] = lambda s: s["cpu_s"] * hz / size
+            for key, f in metric.items():
+                c = compare([f(s) for s in samples["tcp"]], [f(s) for s in samples["rdma"]], key, rng, args.alpha)
+                if c:
+                    w["compare"][key] = c
+            report["workloads"].append(w)
+            if not args.no_store:
+                for t in TRANSPORTS:
+                    if samples[t]:
+                        record(f"ab/{name}/{t}", {key: [f(s) for s in samples[t]] for key, f in metric.items()},
+                               "rdma_ab", {"server": args.server, "size": size})
+
+            tp = w["compare"].get("throughput_mbps")
+            line = (f"[AB] {name}: TCP {w['tcp'].get('throughput_mbps', {}).get('median', 0):.2f} MB/s, "
+                    f"RDMA {w['rdma'].get('throughput_mbps', {}).get('median', 0):.2f} MB/s")
+            if tp:
+                line += (f", RDMA/TCP {tp['ratio']:.3f} [{tp['ci'][0]:.3f}, {tp['ci'][1]:.3f}] p={tp['p']:.4f}"
+                         f"{' (significant)' if tp['significant'] else ' (not significant)'}")
+            print(line)
+            for e in errors[:3]:
+                print(f"[AB]     failed: {e}")
+    finally:
+        for s in servers:
+            s.terminate()
+        for _, path in workloads[:len(workloads) - len(args.file)]:
+            os.unlink(path)
+        os.rmdir(tmp)
+
+    with open(args.json, "w") as f:
+        json.dump(report, f, indent=1)
+    with open(args.html, "w") as f:
+        f.write(render_html(report))
+    print(f"[AB] Report written to {args.html} and {args.json}")
+    print("RESULT " + json.dumps({"json": args.json, "html": args.html,
+                                  "workloads": [{"name": w["name"], "compare": w["compare"]} for w in report["workloads"]]}))
+    return 0 if all(not w["errors"] for w in report["workloads"]) else 2
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,542 @@
+// rdma_async.hpp -- C++20 coroutine API over the rdma_file_server protocol
+//
+// A loop owns the connections and busy-polls their CQs. Awaiting
+// conn.send(...) suspends only while the connection is out of credits or send
+// slots. conn.recv() suspends until the next non-credit message arrives. The
+// poller resumes the coroutine straight from the completion. Awaiters live in
+// the coroutine frame, and frames come from a per-thread pool, so an operation
+// costs no heap allocation. Many transfers share one thread without a state
+// machine per pipeline.
+//
+//   rdma_async::task<void> push(rdma_async::connection &c, const char *data, uint32_t n) {
+//       co_await c.send(MSG_DATA, 0, 0, data, n);
+//       co_await c.flush();
+//   }
+#ifndef RDMA_ASYNC_HPP
+#define RDMA_ASYNC_HPP
+
+#include <rdma/rdma_cma.h>
+#include <infiniband/verbs.h>
+#include <coroutine>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include "rdma_common.h"
+
+namespace rdma_async {
+
+// ---------- coroutine frames ----------
+
+// fixed-size blocks carved from one arena per thread; a frame larger than a
+// block, or one allocated while the pool is empty, goes to the heap and is counted.
+// A frame holds the coroutine's locals, so I/O buffers belong in the caller's
+// state (see rdma_async_send.cpp), not in the coroutine body.
+class frame_pool {
+public:
+    static constexpr std::size_t block = 1024, blocks = 4096;
+
+    static frame_pool &local() {
+        thread_local frame_pool pool;
+        return pool;
+    }
+
+    void *alloc(std::size_t n) {
+        if (n <= block && free_) {
+            node *b = free_;
+            free_ = b->next;
+            pooled_++;
+            return b;
+        }
+        heap_++;
+        return ::operator new(n);
+    }
+
+    void release(void *p) {
+        char *c = static_cast<char *>(p);
+        if (c >= arena_.get() && c < arena_.get() + block * blocks) {
+            node *b = static_cast<node *>(p);
+            b->next = free_;
+            free_ = b;
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    std::uint64_t pooled() const { return pooled_; }
+    std::uint64_t heap() const { return heap_; }
+
+private:
+    struct node { node *next; };
+
+    frame_pool() : arena_(new char[block * blocks]) {
+        for (std::size_t i = blocks; i-- > 0; ) {
+            node *b = reinterpret_cast<node *>(arena_.get() + i * block);
+            b->next = free_;
+            free_ = b;
+        }
+    }
+
+    std::unique_ptr<char[]> arena_;
+    node *free_ = nullptr;
+    std::uint64_t pooled_ = 0, heap_ = 0;
+};
+
+template <class T> class task;
+
+struct promise_base {
+    std::coroutine_handle<> continuation;
+
+    static void *operator new(std::size_t n) { return frame_pool::local().alloc(n); }
+    static void operator delete(void *p) { frame_pool::local().release(p); }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // hand control straight back to whoever awaited this task
+    struct final_awaiter {
+        bool await_ready() noexcept { return false; }
+        template <class P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            auto next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    final_awaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { std::abort(); }
+};
+
+template <class T>
+struct promise : promise_base {
+    T value{};
+    task<T> get_return_object();
+    void return_value(T v) { value = std::move(v); }
+};
+
+template <>
+struct promise<void> : promise_base {
+    task<void> get_return_object();
+    void return_void() {}
+};
+
+// lazily started coroutine; co_await runs it to completion and yields its value
+template <class T = void>
+class task {
+public:
+    using promise_type = promise<T>;
+
+    explicit task(std::coroutine_handle<promise_type> h) : h_(h) {}
+    task(task &&o) noexcept : h_(std::exchange(o.h_, {})) {}
+    task &operator=(task &&o) noexcept {
+        if (h_) h_.destroy();
+        h_ = std::exchange(o.h_, {});
+        return *this;
+    }
+    task(const task &) = delete;
+    ~task() { if (h_) h_.destroy(); }
+
+    bool done() const { return !h_ || h_.done(); }
+    void start() { h_.resume(); }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        h_.promise().continuation = caller;
+        return h_;
+    }
+    T await_resume() {
+        if constexpr (!std::is_void_v<T>) return std::move(h_.promise().value);
+    }
+
+private:
+    std::coroutine_handle<promise_type> h_;
+};
+
+template <class T>
+task<T> promise<T>::get_return_object() { return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this)); }
+inline task<void> promise<void>::get_return_object() {
+    return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+}
+
+// ---------- disk ----------
+
+// file reads and writes stay synchronous pread/pwrite, like the server's; the
+// awaitables keep call sites uniform and complete without suspending
+struct disk_op {
+    int fd;
+    void *buf;
+    std::size_t len;
+    off_t off;
+    bool write;
+    bool await_ready() const noexcept { return true; }
+    void await_suspend(std::coroutine_handle<>) const noexcept {}
+    ssize_t await_resume() const {
+        return write ? pwrite(fd, buf, len, off) : pread(fd, buf, len, off);
+    }
+};
+
+inline disk_op disk_read(int fd, void *buf, std::size_t len, off_t off) { return {fd, buf, len, off, false}; }
+inline disk_op disk_write(int fd, const void *buf, std::size_t len, off_t off) {
+    return {fd, const_cast<void *>(buf), len, off, true};
+}
+
+// ---------- connections ----------
+
+struct message {
+    std::uint8_t type, flags;
+    std::uint16_t stream;
+    std::uint32_t len;
+    std::uint64_t offset;
+    const char *payload;    // points into the receive slot, which is reposted by the next recv() on the connection
+};
+
+class loop;
+
+// one RC QP to the server with its own receive ring and send slots
+class connection {
+public:
+    static constexpr int send_slots = RECV_DEPTH;
+    static constexpr int max_replies = 4;
+    static constexpr int recv_ring = RECV_DEPTH + max_replies;
+
+    // send awaiter: posts once a credit and a send slot are free
+    struct send_op {
+        connection &c;
+        std::uint8_t type, flags;
+        std::uint64_t offset;
+        const void *payload;
+        std::uint32_t len;
+        std::coroutine_handle<> h{};
+        send_op *next = nullptr;
+
+        bool await_ready() {
+            if (c.failed_) return true;
+            if (c.waiters_ || !c.can_post()) return false;     // queue behind earlier senders
+            c.post(*this);
+            return true;
+        }
+        void await_suspend(std::coroutine_handle<> caller) {
+            h = caller;
+            c.enqueue(this);
+        }
+        int await_resume() const { return c.failed_ ? -1 : 0; }
+    };
+
+    struct recv_op {
+        connection &c;
+        std::coroutine_handle<> h{};
+        bool await_ready() const { return c.ready_count_ || c.failed_; }
+        void await_suspend(std::coroutine_handle<> caller) {
+            h = caller;
+            c.reply_waiter_ = this;
+        }
+        // type 0: the connection failed
+        message await_resume() {
+            // the previous message's slot is done with now
+            if (c.held_ >= 0 && !c.failed_) c.post_recv(c.held_);
+            c.held_ = -1;
+            if (c.failed_) return {};
+            int s = c.ready_[c.ready_head_];
+            c.ready_head_ = (c.ready_head_ + 1) % recv_ring;
+            c.ready_count_--;
+            c.held_ = s;
+            const msg_hdr *hdr = reinterpret_cast<const msg_hdr *>(c.recv_slot(s));
+            std::uint32_t len = ntohl(hdr->len);
+            if (len > BUF_SIZE) len = BUF_SIZE;
+            return {hdr->type, hdr->flags, ntohs(hdr->stream), len, ntohll(hdr->offset),
+                    reinterpret_cast<const char *>(hdr + 1)};
+        }
+    };
+
+    struct flush_op {
+        connection &c;
+        bool await_ready() const { return c.in_flight_ == 0 || c.failed_; }
+        void await_suspend(std::coroutine_handle<> caller) { c.flush_waiter_ = caller; }
+        int await_resume() const { return c.failed_ ? -1 : 0; }
+    };
+
+    // connect synchronously; nullptr (after perror) if the server cannot be reached
+    static std::unique_ptr<connection> open(loop &l, const char *host);
+    ~connection();
+
+    // payload (at most BUF_SIZE bytes) must stay valid until the co_await returns; it is copied when posted
+    send_op send(std::uint8_t type, std::uint8_t flags, std::uint64_t offset, const void *payload, std::uint32_t len) {
+        return {*this, type, flags, offset, payload, len};
+    }
+    recv_op recv() { return {*this}; }
+    flush_op flush() { return {*this}; }
+
+    // the file header every transfer starts with
+    send_op send_file_hdr(std::uint8_t flags, std::uint64_t size, const char *tenant) {
+        file_hdr_wire fh{};
+        std::memcpy(fh.tenant, tenant, strnlen(tenant, sizeof(fh.tenant)));
+        fh.qps = 1;
+        std::memcpy(hdr_scratch_, &fh, sizeof(fh));
+        return send(MSG_FILE_HDR, flags, size, hdr_scratch_, sizeof(fh));
+    }
+
+    bool failed() const { return failed_; }
+    // seconds senders spent queued for a credit or a send slot
+    double blocked() const { return blocked_; }
+
+private:
+    friend class loop;
+    connection() = default;
+
+    char *slot(int i) { return buf_ + static_cast<std::size_t>(i) * MSG_BUF_SIZE; }
+    char *recv_slot(int i) { return slot(send_slots + i); }
+
+    bool can_post() const { return credits_ > 0 && free_slots_ > 0; }
+
+    void enqueue(send_op *op) {
+        if (!waiters_) blocked_since_ = now();
+        if (tail_) tail_->next = op;
+        else waiters_ = op;
+        tail_ = op;
+    }
+
+    void post(send_op &op) {
+        int i = free_[--free_slots_];
+        credits_--;
+        in_flight_++;
+        msg_hdr *h = reinterpret_cast<msg_hdr *>(slot(i));
+        msg_hdr_set(h, op.type, op.flags, op.len, op.offset);
+        if (op.len) std::memcpy(h + 1, op.payload, op.len);
+        ibv_sge sge = {reinterpret_cast<std::uintptr_t>(h), static_cast<std::uint32_t>(sizeof(*h) + op.len), mr_->lkey};
+        ibv_send_wr wr{};
+        wr.wr_id = static_cast<std::uint64_t>(i);
+        wr.sg_list = &sge;
+        wr.num_sge = 1;
+        wr.opcode = IBV_WR_SEND;
+        wr.send_flags = IBV_SEND_SIGNALED;
+        ibv_send_wr *bad;
+        if (ibv_post_send(id_->qp, &wr, &bad)) { perror("ibv_post_send"); fail(); }
+    }
+
+    void post_recv(int i) {
+        ibv_sge sge = {reinterpret_cast<std::uintptr_t>(recv_slot(i)), static_cast<std::uint32_t>(MSG_BUF_SIZE), mr_->lkey};
+        ibv_recv_wr wr{};
+        wr.wr_id = static_cast<std::uint64_t>(i);
+        wr.sg_list = &sge;
+        wr.num_sge = 1;
+        ibv_recv_wr *bad;
+        if (ibv_post_recv(id_->qp, &wr, &bad)) { perror("ibv_post_recv"); fail(); }
+    }
+
+    // post queued sends while credits and slots last, resuming each sender
+    void drain_waiters() {
+        while (waiters_ && can_post() && !failed_) {
+            send_op *op = waiters_;
+            waiters_ = op->next;
+            if (!waiters_) {
+                tail_ = nullptr;
+                blocked_ += now() - blocked_since_;
+            }
+            post(*op);
+            op->h.resume();
+        }
+    }
+
+    // a failed completion ends the connection; every waiter is resumed with an error
+    void fail() {
+        failed_ = true;
+        while (send_op *op = waiters_) {
+            waiters_ = op->next;
+            op->h.resume();
+        }
+        tail_ = nullptr;
+        wake_reply();
+        wake_flush();
+    }
+
+    void wake_reply() {
+        if (recv_op *r = std::exchange(reply_waiter_, nullptr)) r->h.resume();
+    }
+    void wake_flush() {
+        if (auto h = std::exchange(flush_waiter_, {})) h.resume();
+    }
+
+    int poll();
+
+    static double now() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+    rdma_event_channel *ec_ = nullptr;
+    rdma_cm_id *id_ = nullptr;
+    ibv_pd *pd_ = nullptr;
+    ibv_cq *send_cq_ = nullptr, *recv_cq_ = nullptr;
+    ibv_mr *mr_ = nullptr;
+    char *buf_ = nullptr;
+    loop *loop_ = nullptr;
+
+    int credits_ = 1;       // the file header goes on an implicit first credit
+    int free_[send_slots];
+    int free_slots_ = 0, in_flight_ = 0;
+    send_op *waiters_ = nullptr, *tail_ = nullptr;
+    recv_op *reply_waiter_ = nullptr;
+    std::coroutine_handle<> flush_waiter_{};
+    // receive slots holding replies nobody has recv()'d yet, oldest first; they
+    // are not reposted until consumed, so a burst of replies is never overwritten
+    int ready_[recv_ring];
+    int ready_head_ = 0, ready_count_ = 0;
+    int held_ = -1;         // slot of the message the last recv() returned
+    char hdr_scratch_[sizeof(file_hdr_wire)];
+    bool failed_ = false;
+    double blocked_since_ = 0, blocked_ = 0;
+};
+
+// ---------- loop ----------
+
+// runs spawned tasks to completion, resuming them from CQ completions
+class loop {
+public:
+    void spawn(task<void> t) {
+        t.start();
+        if (!t.done()) tasks_.push_back(std::move(t));
+    }
+
+    void run() {
+        while (!tasks_.empty()) {
+            for (connection *c : conns_) c->poll();
+            for (std::size_t i = 0; i < tasks_.size(); ) {
+                if (tasks_[i].done()) {
+                    tasks_[i] = std::move(tasks_.back());
+                    tasks_.pop_back();
+                } else {
+                    i++;
+                }
+            }
+        }
+    }
+
+private:
+    friend class connection;
+    std::vector<connection *> conns_;
+    std::vector<task<void>> tasks_;
+};
+
+inline int connection::poll() {
+    ibv_wc wc[recv_ring];
+    int n = ibv_poll_cq(recv_cq_, recv_ring, wc);
+    if (n < 0) { fprintf(stderr, "ibv_poll_cq failed\n"); fail(); return 0; }
+    int busy = n;
+    for (int i = 0; i < n && !failed_; i++) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "reply recv failed: %s\n", ibv_wc_status_str(wc[i].status));
+            fail();
+            break;
+        }
+        int s = static_cast<int>(wc[i].wr_id);
+        const msg_hdr *h = reinterpret_cast<const msg_hdr *>(recv_slot(s));
+        if (h->type == MSG_CREDIT) {
+            std::uint32_t granted;
+            std::memcpy(&granted, h + 1, sizeof(granted));
+            credits_ += static_cast<int>(ntohl(granted));
+            post_recv(s);
+        } else {
+            ready_[(ready_head_ + ready_count_++) % recv_ring] = s;
+            wake_reply();
+        }
+    }
+
+    n = ibv_poll_cq(send_cq_, send_slots, wc);
+    if (n < 0) { fprintf(stderr, "ibv_poll_cq failed\n"); fail(); return busy; }
+    busy += n;
+    for (int i = 0; i < n && !failed_; i++) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "send failed: %s\n", ibv_wc_status_str(wc[i].status));
+            fail();
+            break;
+        }
+        free_[free_slots_++] = static_cast<int>(wc[i].wr_id);
+        in_flight_--;
+    }
+
+    drain_waiters();
+    if (in_flight_ == 0) wake_flush();
+    return busy;
+}
+
+inline std::unique_ptr<connection> connection::open(loop &l, const char *host) {
+    std::unique_ptr<connection> c(new connection);
+    c->loop_ = &l;
+    rdma_addrinfo hints{}, *dst;
+    hints.ai_port_space = RDMA_PS_TCP;
+    if (rdma_getaddrinfo(host, PORT, &hints, &dst)) { perror(host); return nullptr; }
+    c->ec_ = rdma_create_event_channel();
+    if (!c->ec_ || rdma_create_id(c->ec_, &c->id_, nullptr, RDMA_PS_TCP)) { perror("rdma_create_id"); return nullptr; }
+
+    auto wait = [&](rdma_cm_event_type want) {
+        rdma_cm_event *event;
+        if (rdma_get_cm_event(c->ec_, &event)) { perror("rdma_get_cm_event"); return false; }
+        rdma_cm_event_type got = event->event;
+        rdma_ack_cm_event(event);
+        if (got != want) fprintf(stderr, "%s (wanted %s)\n", rdma_event_str(got), rdma_event_str(want));
+        return got == want;
+    };
+    int rc = rdma_resolve_addr(c->id_, nullptr, dst->ai_dst_addr, 2000);
+    rdma_freeaddrinfo(dst);
+    if (rc || !wait(RDMA_CM_EVENT_ADDR_RESOLVED)) return nullptr;
+    if (rdma_resolve_route(c->id_, 2000) || !wait(RDMA_CM_EVENT_ROUTE_RESOLVED)) return nullptr;
+
+    c->pd_ = ibv_alloc_pd(c->id_->verbs);
+    c->send_cq_ = ibv_create_cq(c->id_->verbs, send_slots, nullptr, nullptr, 0);
+    c->recv_cq_ = ibv_create_cq(c->id_->verbs, recv_ring, nullptr, nullptr, 0);
+    if (!c->pd_ || !c->send_cq_ || !c->recv_cq_) { perror("ibv_alloc_pd/ibv_create_cq"); return nullptr; }
+    ibv_qp_init_attr qp_attr{};
+    qp_attr.send_cq = c->send_cq_;
+    qp_attr.recv_cq = c->recv_cq_;
+    qp_attr.qp_type = IBV_QPT_RC;
+    qp_attr.cap.max_send_wr = send_slots;
+    qp_attr.cap.max_recv_wr = recv_ring;
+    qp_attr.cap.max_send_sge = 1;
+    qp_attr.cap.max_recv_sge = 1;
+    if (rdma_create_qp(c->id_, c->pd_, &qp_attr)) { perror("rdma_create_qp"); return nullptr; }
+
+    std::size_t size = static_cast<std::size_t>(send_slots + recv_ring) * MSG_BUF_SIZE;
+    c->buf_ = static_cast<char *>(std::calloc(1, size));
+    c->mr_ = c->buf_ ? ibv_reg_mr(c->pd_, c->buf_, size, IBV_ACCESS_LOCAL_WRITE) : nullptr;
+    if (!c->mr_) { perror("ibv_reg_mr"); return nullptr; }
+    for (int i = 0; i < send_slots; i++) c->free_[c->free_slots_++] = i;
+    for (int i = 0; i < recv_ring; i++) c->post_recv(i);
+
+    rdma_conn_param param{};
+    param.responder_resources = 1;
+    param.initiator_depth = 1;
+    param.retry_count = 7;
+    param.rnr_retry_count = 7;
+    if (rdma_connect(c->id_, &param) || !wait(RDMA_CM_EVENT_ESTABLISHED)) return nullptr;
+    l.conns_.push_back(c.get());
+    return c;
+}
+
+inline connection::~connection() {
+    if (loop_) {
+        auto &v = loop_->conns_;
+        for (std::size_t i = 0; i < v.size(); i++)
+            if (v[i] == this) { v.erase(v.begin() + static_cast<std::ptrdiff_t>(i)); break; }
+    }
+    if (id_ && id_->qp) {
+        rdma_disconnect(id_);
+        rdma_destroy_qp(id_);
+    }
+    if (mr_) ibv_dereg_mr(mr_);
+    std::free(buf_);
+    if (send_cq_) ibv_destroy_cq(send_cq_);
+    if (recv_cq_) ibv_destroy_cq(recv_cq_);
+    if (pd_) ibv_dealloc_pd(pd_);
+    if (id_) rdma_destroy_id(id_);
+    if (ec_) rdma_destroy_event_channel(ec_);
+}
+
+} // namespace rdma_async
+
+#endif
@@ -0,0 +1,204 @@
+// rdma_common.h -- wire protocol shared by rdma_file_client and rdma_file_server
+//
+// Define RDMA_COMMON_NO_VERBS for the protocol alone, without rdma-core
+// (rdma_netemu models the protocol over an emulated link).
+#ifndef RDMA_COMMON_H
+#define RDMA_COMMON_H
+
+#ifndef RDMA_COMMON_NO_VERBS
+#include <infiniband/verbs.h>
+#endif
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PORT "7471"
+#define BUF_SIZE 4096
+
+// dedup: one hash batch is one BUF_SIZE payload of 32-byte chunk hashes
+#define DEDUP_HASH_LEN 32
+#define DEDUP_BATCH (BUF_SIZE / DEDUP_HASH_LEN)
+
+// flow control: the server keeps RECV_DEPTH receives posted per connection and
+// the client may only SEND while it holds a credit. The file header is sent on
+// an implicit first credit; everything after that is granted with MSG_CREDIT.
+#define RECV_DEPTH 16
+#define TENANT_NAME_LEN 16
+#define MAX_QPS 16
+
+// every SEND starts with a msg_hdr; payload (if any) follows it
+enum msg_type {
+    MSG_FILE_HDR = 1,   // client -> server: offset = file size, flags = XFER_F_*, payload = struct file_hdr_wire
+    MSG_DATA,           // client -> server: len bytes of file data at offset
+    MSG_HASHES,         // client -> server: len / 32 chunk hashes, first chunk at offset
+    MSG_NEED,           // server -> client: bitmap of chunks in the last batch the server lacks
+    MSG_DONE,           // client -> server: all data sent
+    MSG_RESULT,         // server -> client: struct result_wire
+    MSG_HOLE,           // client -> server: payload = 8-byte hole length at offset
+    MSG_FILL,           // client -> server: payload = struct fill_wire, a constant-byte run at offset
+    MSG_CREDIT,         // server -> client: payload = 4-byte count of additional send credits
+    MSG_ACK,            // server -> client (UD only): payload = struct ud_ack_wire
+    MSG_RING,           // server -> client: payload = struct ring_wire, the ring for an XFER_F_RING stream
+    MSG_BENCH,          // client -> server: payload = struct bench_wire with the region size; reply: the region
+};
+
+enum xfer_flags {
+    XFER_F_DEDUP = 1 << 0,
+    XFER_F_SPARSE = 1 << 1,
+    XFER_F_FILL = 1 << 2,
+    XFER_F_RING = 1 << 3,   // data goes by RDMA WRITE into a server-side ring instead of SENDs
+};
+
+struct msg_hdr {
+    uint8_t type;
+    uint8_t flags;
+    uint16_t stream;
+    uint32_t len;
+    uint64_t offset;
+} __attribute__((packed));
+
+#define MSG_BUF_SIZE (sizeof(struct msg_hdr) + BUF_SIZE)
+
+struct file_hdr_wire {
+    char tenant[TENANT_NAME_LEN];   // bandwidth policy group; NUL-padded, empty = "default"
+    uint64_t session;               // network byte order; non-zero when the file is spread over several QPs
+    uint8_t qps;                    // connections that will join the session
+} __attribute__((packed));
+
+struct fill_wire {
+    uint64_t len;       // network byte order
+    uint8_t byte;
+} __attribute__((packed));
+
+// zero-RTT: a file that fits in the connect request's private data (56 bytes
+// on RC) travels inside it. The server writes it and rejects the connection
+// with a struct tiny_reply_wire, so the transfer ends with the CM handshake.
+// A server that ignores the private data accepts instead and the client falls
+// back to a normal transfer on the connection.
+#define TINY_MAGIC 0x54494e59u     // "TINY"
+#define TINY_MAX 51
+
+struct tiny_req_wire {
+    uint32_t magic;     // network byte order
+    uint8_t len;
+    uint8_t data[TINY_MAX];
+} __attribute__((packed));
+
+enum tiny_status { TINY_OK, TINY_BAD, TINY_REFUSED };
+
+struct tiny_reply_wire {
+    uint32_t magic;     // network byte order
+    uint8_t status;     // enum tiny_status
+    uint8_t pad[3];
+    uint64_t bytes_written;
+    uint8_t digest[32];
+} __attribute__((packed));
+
+// one-sided ring (XFER_F_RING): the server exposes [struct ring_ctrl][RING_SLOTS
+// slots]. The client RDMA WRITEs records into slots and then the new tail; the
+// server consumes slots in order and publishes its head, which the client RDMA
+// READs only when the ring looks full. Counters are in network byte order.
+#define RING_SLOTS 256
+#define RING_SLOT_SIZE ((sizeof(struct ring_rec) + BUF_SIZE + 63) & ~(size_t)63)
+
+struct ring_ctrl {
+    uint64_t tail;      // written by the client: records [0, tail) are in place
+    uint8_t pad0[56];
+    uint64_t head;      // written by the server: records [0, head) are consumed
+    uint8_t pad1[56];
+};
+
+struct ring_rec {
+    uint64_t offset;
+    uint32_t len;
+    // low 32 bits of the record's position. It sits ahead of the payload, so it
+    // only catches a stale header (a slot not rewritten for this lap); the
+    // payload's ordering rests on the tail WRITE following the slot's on one QP
+    uint32_t seq;
+} __attribute__((packed));
+
+struct ring_wire {
+    uint64_t addr;      // network byte order: remote address of the struct ring_ctrl
+    uint32_t rkey;
+    uint32_t slots;
+    uint32_t slot_size;
+} __attribute__((packed));
+
+// bench: raw verbs microbenchmarks on an ordinary connection. After MSG_BENCH
+// the server exposes a region for RDMA WRITE and READ and drops SENDs whose
+// first byte is 0 (no message type) after counting them, without credits.
+#define BENCH_MAX_REGION (64u << 20)
+
+struct bench_wire {
+    uint64_t addr;      // network byte order
+    uint32_t rkey;
+    uint32_t len;
+} __attribute__((packed));
+
+// UD transport: one datagram per message, no credits. MSG_FILE_HDR carries a
+// struct ud_hello_wire, MSG_DATA at offset seq * dgram carries datagram seq, and
+// the server acknowledges with a cumulative sequence number plus a bitmap of
+// what it holds beyond it. Received datagrams are preceded by a 40-byte GRH.
+#define UD_GRH 40
+#define UD_SACK_BITS 256
+
+struct ud_hello_wire {
+    struct file_hdr_wire fh;
+    uint32_t dgram;     // network byte order; payload bytes per MSG_DATA datagram
+    uint64_t nonce;     // per transfer; tells a new client on a reused QP number from the old one
+} __attribute__((packed));
+
+struct ud_ack_wire {
+    uint64_t cum;                       // network byte order; every datagram below cum has arrived
+    uint8_t sack[UD_SACK_BITS / 8];     // bit i: datagram cum + i has arrived
+} __attribute__((packed));
+
+// final per-transfer report sent back by the server (network byte order)
+struct result_wire {
+    uint64_t bytes_received;    // payload bytes that crossed the wire
+    uint64_t bytes_written;     // bytes of the reconstructed file
+    uint64_t chunks_total;
+    uint64_t chunks_dup;        // chunks served from the server's chunk store
+    uint64_t bytes_dup;
+    uint64_t chunks_reflinked;  // subset of chunks_dup materialized by FICLONERANGE
+    uint64_t bytes_hole;        // bytes announced as holes instead of sent
+    uint64_t bytes_fill;        // bytes expanded from MSG_FILL runs
+    uint64_t queue_delay_us;    // time the client held no credits because of the server's bandwidth policy
+    uint8_t digest[32];         // BLAKE3 of the file as written on the server
+} __attribute__((packed));
+
+// helper for 64-bit hton/ntoh
+static inline uint64_t htonll(uint64_t x) {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    return (((uint64_t)htonl(x & 0xFFFFFFFFULL)) << 32) | htonl(x >> 32);
+#else
+    return x;
+#endif
+}
+
+static inline uint64_t ntohll(uint64_t x) { return htonll(x); }
+
+static inline void msg_hdr_set(struct msg_hdr *h, uint8_t type, uint8_t flags, uint32_t len, uint64_t offset) {
+    h->type = type;
+    h->flags = flags;
+    h->stream = 0;
+    h->len = htonl(len);
+    h->offset = htonll(offset);
+}
+
+#ifndef RDMA_COMMON_NO_VERBS
+// busy-poll one completion; returns 0 on success, -1 on a failed work request
+static inline int poll_one(struct ibv_cq *cq, struct ibv_wc *wc) {
+    int n;
+    while ((n = ibv_poll_cq(cq, 1, wc)) == 0);
+    if (n < 0) { fprintf(stderr, "ibv_poll_cq failed\n"); return -1; }
+    if (wc->status != IBV_WC_SUCCESS) {
+        fprintf(stderr, "work request failed: %s\n", ibv_wc_status_str(wc->status));
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+#endif
@@ -0,0 +1,221 @@
+// rdma_conn_storm.c -- connection-storm benchmark for rdma_file_server
+//
+// Forks P client processes that connect N RC connections in total at the same
+// moment, the way a job start does, and reports accepts per second and
+// time-to-accept percentiles. Each process drives all of its connections
+// asynchronously on one event channel.
+#define _GNU_SOURCE
+#include <rdma/rdma_cma.h>
+#include <infiniband/verbs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "rdma_common.h"
+
+#define STORM_TIMEOUT_S 30.0
+
+struct storm_conn {
+    struct rdma_cm_id *id;
+    double start;           // the storm began; accepts per second count from here
+    double connect;         // rdma_connect sent; time to accept counts from here, not address and route resolution
+    double done;            // done < 0: the connection failed
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_all(int fd, const void *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) { perror("write"); exit(1); }
+        p = (const char *)p + w;
+        n -= (size_t)w;
+    }
+}
+
+static int read_all(int fd, void *p, size_t n) {
+    while (n > 0) {
+        ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        p = (char *)p + r;
+        n -= (size_t)r;
+    }
+    return 0;
+}
+
+// one process: n connections started together once the parent says go; the
+// start and accept times of each are written to out_fd
+static void run_child(const struct rdma_addrinfo *dst, int n, double hold, int go_fd, int out_fd) {
+    struct rdma_event_channel *ec = rdma_create_event_channel();
+    struct storm_conn *cs = calloc((size_t)n, sizeof(*cs));
+    if (!ec || !cs) { perror("setup"); exit(1); }
+    struct ibv_pd *pd = NULL;
+    struct ibv_cq *cq = NULL;
+    char go;
+    if (read_all(go_fd, &go, 1) != 0) exit(1);
+
+    for (int i = 0; i < n; i++) {
+        if (rdma_create_id(ec, &cs[i].id, &cs[i], RDMA_PS_TCP)) { perror("rdma_create_id"); exit(1); }
+        cs[i].start = now_sec();
+        if (rdma_resolve_addr(cs[i].id, NULL, dst->ai_dst_addr, 2000)) cs[i].done = -1;
+    }
+    int left = 0;
+    for (int i = 0; i < n; i++) left += cs[i].done == 0;
+
+    double deadline = now_sec() + STORM_TIMEOUT_S;
+    while (left > 0 && now_sec() < deadline) {
+        struct pollfd pfd = {.fd = ec->fd, .events = POLLIN};
+        if (poll(&pfd, 1, 100) <= 0) continue;
+        struct rdma_cm_event *event;
+        if (rdma_get_cm_event(ec, &event)) { perror("rdma_get_cm_event"); exit(1); }
+        struct rdma_cm_id *id = event->id;
+        struct storm_conn *sc = id->context;
+        switch (event->event) {
+        case RDMA_CM_EVENT_ADDR_RESOLVED:
+            if (rdma_resolve_route(id, 2000)) { sc->done = -1; left--; }
+            break;
+        case RDMA_CM_EVENT_ROUTE_RESOLVED: {
+            // all connections go to one server, so one PD and one CQ cover them
+            if (!pd) {
+                pd = ibv_alloc_pd(id->verbs);
+                cq = ibv_create_cq(id->verbs, 2 * n, NULL, NULL, 0);
+                if (!pd || !cq) { perror("ibv_alloc_pd/ibv_create_cq"); exit(1); }
+            }
+            struct ibv_qp_init_attr qp_attr = {
+                .send_cq = cq, .recv_cq = cq, .qp_type = IBV_QPT_RC,
+                .cap = {.max_send_wr = 1, .max_recv_wr = 1, .max_send_sge = 1, .max_recv_sge = 1}
+            };
+            sc->connect = now_sec();
+            if (rdma_create_qp(id, pd, &qp_attr) || rdma_connect(id, NULL)) { sc->done = -1; left--; }
+            break;
+        }
+        case RDMA_CM_EVENT_ESTABLISHED:
+            sc->done = now_sec();
+            left--;
+            break;
+        case RDMA_CM_EVENT_ADDR_ERROR:
+        case RDMA_CM_EVENT_ROUTE_ERROR:
+        case RDMA_CM_EVENT_CONNECT_ERROR:
+        case RDMA_CM_EVENT_UNREACHABLE:
+        case RDMA_CM_EVENT_REJECTED:
+            if (sc->done == 0) { sc->done = -1; left--; }
+            break;
+        default:
+            break;
+        }
+        rdma_ack_cm_event(event);
+    }
+    if (hold > 0) usleep((useconds_t)(hold * 1e6));
+
+    write_all(out_fd, &n, sizeof(n));
+    for (int i = 0; i < n; i++) {
+        double rec[3] = {cs[i].start, cs[i].connect, cs[i].done > 0 ? cs[i].done : -1};
+        write_all(out_fd, rec, sizeof(rec));
+    }
+    for (int i = 0; i < n; i++) {
+        if (cs[i].done > 0) rdma_disconnect(cs[i].id);
+        if (cs[i].id->qp) rdma_destroy_qp(cs[i].id);
+        rdma_destroy_id(cs[i].id);
+    }
+    if (cq) ibv_destroy_cq(cq);
+    if (pd) ibv_dealloc_pd(pd);
+    rdma_destroy_event_channel(ec);
+    free(cs);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <server_ip> [--clients N] [--procs P] [--hold-ms MS]\n", argv[0]);
+        return 1;
+    }
+    int clients = 256, procs = 8;
+    double hold = 0.2;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) clients = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--procs") == 0 && i + 1 < argc) procs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--hold-ms") == 0 && i + 1 < argc) hold = atof(argv[++i]) / 1e3;
+        else fprintf(stderr, "[Storm] Ignoring unknown option %s\n", argv[i]);
+    }
+    if (clients < 1 || procs < 1) { fprintf(stderr, "--clients and --procs must be positive\n"); return 1; }
+    if (procs > clients) procs = clients;
+
+    struct rdma_addrinfo hints = {.ai_port_space = RDMA_PS_TCP}, *dst;
+    if (rdma_getaddrinfo(argv[1], PORT, &hints, &dst)) { perror(argv[1]); return 1; }
+
+    // every child blocks on the go pipe, so the storm starts once all of them exist
+    int go[2];
+    if (pipe(go) != 0) { perror("pipe"); return 1; }
+    int *out = calloc((size_t)procs, sizeof(int));
+    pid_t *pids = calloc((size_t)procs, sizeof(pid_t));
+    if (!out || !pids) { perror("calloc"); return 1; }
+    for (int p = 0; p < procs; p++) {
+        int fds[2];
+        if (pipe(fds) != 0) { perror("pipe"); return 1; }
+        int n = clients / procs + (p < clients % procs);
+        pids[p] = fork();
+        if (pids[p] < 0) { perror("fork"); return 1; }
+        if (pids[p] == 0) {
+            close(go[1]);
+            close(fds[0]);
+            run_child(dst, n, hold, go[0], fds[1]);
+            _exit(0);
+        }
+        close(fds[1]);
+        out[p] = fds[0];
+    }
+    close(go[0]);
+    printf("[Storm] %d connections from %d processes to %s...\n", clients, procs, argv[1]);
+    fflush(stdout);
+    char g[1] = {1};
+    for (int p = 0; p < procs; p++) write_all(go[1], g, 1);
+
+    double *lat = calloc((size_t)clients, sizeof(double));
+    if (!lat) { perror("calloc"); return 1; }
+    int ok = 0, failed = 0;
+    double first = 0, last = 0;
+    for (int p = 0; p < procs; p++) {
+        int n;
+        if (read_all(out[p], &n, sizeof(n)) != 0) { failed += clients / procs; continue; }
+        for (int i = 0; i < n; i++) {
+            double rec[3];
+            if (read_all(out[p], rec, sizeof(rec)) != 0) { failed += n - i; break; }
+            if (first == 0 || rec[0] < first) first = rec[0];
+            if (rec[2] < 0) { failed++; continue; }
+            if (rec[2] > last) last = rec[2];
+            lat[ok++] = rec[2] - rec[1];
+        }
+        close(out[p]);
+    }
+    for (int p = 0; p < procs; p++) waitpid(pids[p], NULL, 0);
+    rdma_freeaddrinfo(dst);
+
+    qsort(lat, (size_t)ok, sizeof(double), cmp_double);
+    double span = last - first, rate = ok && span > 0 ? ok / span : 0;
+    double p50 = ok ? lat[(size_t)(0.50 * (ok - 1))] : 0, p90 = ok ? lat[(size_t)(0.90 * (ok - 1))] : 0;
+    double p99 = ok ? lat[(size_t)(0.99 * (ok - 1))] : 0, max = ok ? lat[ok - 1] : 0;
+    printf("[Storm] %d accepted, %d failed in %.3f s: %.0f accepts/s, time to accept p50 %.3f ms, "
+           "p90 %.3f ms, p99 %.3f ms, max %.3f ms\n", ok, failed, span, rate, p50 * 1e3, p90 * 1e3, p99 * 1e3, max * 1e3);
+    printf("RESULT {\"clients\": %d, \"procs\": %d, \"accepted\": %d, \"failed\": %d, \"span_s\": %.6f, "
+           "\"accepts_per_s\": %.1f, \"accept_p50_s\": %.6f, \"accept_p90_s\": %.6f, \"accept_p99_s\": %.6f, "
+           "\"accept_max_s\": %.6f}\n", clients, procs, ok, failed, span, rate, p50, p90, p99, max);
+    free(lat);
+    free(out);
+    free(pids);
+    return failed ? 2 : 0;
+}
@@ -19,6 +19,8 @@ from tkinter import font as tkFont
 from tkinter.simpledialog import askstring
 
 import psutil
+from rdma_engine import load_engine, EngineError, DEDUP
+from rdma_results import parse_result_line, record
 import matplotlib.pyplot as plt
 from matplotlib.backends.backend_tkagg import FigureCanvasTkAgg
 
@@ -49,11 +51,45 @@ def run_command(cmd, check=False, capture_output=True, text=True):
         cp = subprocess.CompletedProcess(cmd, 127, stdout="", stderr=str(e))
         return cp
 
-def create_temp_file(size_bytes):
-    """Create a temporary file of specified size (in bytes)."""
+def self_reported_usage(result):
+    """CPU % and peak RSS (MB) over the data phase, from the rusage a native tool reported, or None.
+
+    The RSS is None for an engine transfer, which has no process of its own to measure.
+    """
+    data = ((result or {}).get('rusage') or {}).get('data')
+    if not data:
+        return None
+    elapsed = result.get('elapsed_s', 0.0)
+    rss_kb = data.get('max_rss_kb')
+    return (data['cpu_s'] / elapsed * 100 if elapsed > 0 else 0.0, rss_kb / 1024 if rss_kb is not None else None)
+
+def rdma_connect_us(result):
+    """CM handshake time in µs from a RESULT's phases, or None. It is connection setup and
+    does not depend on the message size, so it is reported apart from the RTT plot."""
+    phases = (result or {}).get('phases')
+    if not phases:
+        return None
+    return max(phases['connected_s'] - phases['route_s'], 0.0) * 1_000_000
+
+DATA_PROFILES = ["random", "text", "zeros", "sparse"]
+
+def create_temp_file(size_bytes, profile="random", compress=0.0, dup=0.0):
+    """Create a temporary file of specified size (in bytes).
+
+    Uses the native rdma_gen_data generator when it has been built (fast, and
+    supports compressible/duplicated/sparse profiles); falls back to os.urandom.
+    """
     with tempfile.NamedTemporaryFile(delete=False) as f:
+        path = f.name
+    gen = os.path.join(os.path.dirname(os.path.abspath(__file__)), "rdma_gen_data")
+    if os.path.exists(gen) and os.access(gen, os.X_OK):
+        cp = run_command([gen, path, str(size_bytes), "--profile", profile,
+                          "--compress", str(compress), "--dup", str(dup)])
+        if cp.returncode == 0:
+            return path
+    with open(path, "wb") as f:
         f.write(os.urandom(size_bytes))
-        return f.name
+    return path
 
 # ---------- Main App ----------
 
@@ -63,6 +99,8 @@ class ModernRDMAApp:
         self.base_dir = os.path.dirname(os.path.abspath(__file__))
         self.logs_dir = os.path.join(self.base_dir, "logs")
         os.makedirs(self.logs_dir, exist_ok=True)
+        # in-process transfer engine (librdma_engine.so); None falls back to the executables
+        self.engine = load_engine()
 
         # root window
         self.root = tk.Tk()
@@ -108,6 +146,7 @@ class ModernRDMAApp:
         self.last_rdma_memory = 0.0  # MB
         self.bandwidth_data = {'TCP': [], 'RDMA': []}  # (size_MB, bandwidth_MB/s)
         self.rtt_data = {'TCP': [], 'RDMA': []}  # (size_MB, rtt_us)
+        self.rdma_ceiling = {}  # server_ip -> best raw verbs bandwidth in Gbit/s, or None
 
         # UI build
         self.setup_ui()
@@ -280,6 +319,20 @@ class ModernRDMAApp:
                                   highlightbackground=self.colors['hover_light'], cursor='hand2', state='disabled')
         self.rdma_btn.pack(side='left', padx=(0,12))
 
+        self.dedup_var = tk.BooleanVar(value=False)
+        tk.Checkbutton(btn_row, text="Dedup (RDMA)", variable=self.dedup_var, font=self.fonts['label'],
+                       bg=self.colors['bg_secondary'], fg=self.colors['text_secondary'],
+                       selectcolor=self.colors['bg_tertiary'], activebackground=self.colors['bg_secondary'],
+                       highlightthickness=0).pack(side='left', padx=(0,12))
+
+        tk.Label(btn_row, text="Test data:", font=self.fonts['label'],
+                 bg=self.colors['bg_secondary'], fg=self.colors['text_secondary']).pack(side='left')
+        self.data_profile_var = tk.StringVar(value=DATA_PROFILES[0])
+        profile_menu = tk.OptionMenu(btn_row, self.data_profile_var, *DATA_PROFILES)
+        profile_menu.configure(font=self.fonts['label'], bg=self.colors['bg_tertiary'], fg=self.colors['text_primary'],
+                               highlightthickness=0, relief='flat')
+        profile_menu.pack(side='left', padx=(4,12))
+
         tk.Label(inner, text="(Start server locally or point to remote server IP)", font=self.fonts['small'],
                  bg=self.colors['bg_secondary'], fg=self.colors['text_secondary']).pack(anchor='w', pady=(8,0))
 
@@ -490,7 +543,7 @@ class ModernRDMAApp:
 
     def start_rdma_server(self):
         exe = os.path.join(self.base_dir, "rdma_file_server")
-        if not os.path.exists(exe) or not os.access(exe, os.X_OK):
+        if not self.engine and (not os.path.exists(exe) or not os.access(exe, os.X_OK)):
             self.update_status("rdma_file_server not found or not executable in src/. Compile it first.")
             return
 
@@ -500,17 +553,21 @@ class ModernRDMAApp:
 
         def _start():
             self.update_status("Starting RDMA server (background)...")
-            self.rdma_server_process = subprocess.Popen(
-                [exe],
-                cwd=self.base_dir,
-                stdout=subprocess.PIPE,
-                stderr=subprocess.PIPE
-            )
+            self.rdma_server_process = self._spawn_rdma_server(exe)
             time.sleep(0.2)
             self.update_status("✅ RDMA server started (local).")
 
         threading.Thread(target=_start, daemon=True).start()
 
+    def _spawn_rdma_server(self, exe):
+        """Start the local rdma_file_server executable: posix_spawned by the engine when it is loaded, else Popen.
+
+        --multi keeps it up for the size sweep that follows the main transfer.
+        """
+        if self.engine:
+            return self.engine.start_server("--multi", log=os.path.join(self.logs_dir, "rdma_server.log"))
+        return subprocess.Popen([exe, "--multi"], cwd=self.base_dir, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+
     def stop_rdma_server(self):
         if self.rdma_server_process:
             try:
@@ -632,26 +689,26 @@ class ModernRDMAApp:
                 self._ui_update("")
                 raise FileNotFoundError("tcp_client.py missing")
 
-            # Start monitoring
-            self.monitoring = True
+            # the kernel's accounting for the reaped child is exact, however short the transfer
             proc = subprocess.Popen(["python3", "tcp_client.py", self.selected_file, server_ip],
                                     cwd=self.base_dir, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
-            monitor = threading.Thread(target=self.monitor_resources, args=(proc, "TCP"), daemon=True)
-            monitor.start()
-
             start = time.perf_counter()
-            proc.wait()
+            _, status, ru = os.wait4(proc.pid, 0)
             end = time.perf_counter()
-            self.monitoring = False
-            monitor.join()
+            proc.returncode = os.waitstatus_to_exitcode(status)
 
             elapsed = end - start
             self.tcp_times.append(elapsed)
             throughput = file_size / elapsed if elapsed > 0 else 0.0
             self.last_tcp_throughput = throughput
-            avg_cpu, avg_memory = self.monitor_resources(proc, "TCP")
+            avg_cpu = (ru.ru_utime + ru.ru_stime) / elapsed * 100 if elapsed > 0 else 0.0
+            avg_memory = ru.ru_maxrss / 1024
             self.last_tcp_cpu = avg_cpu
             self.last_tcp_memory = avg_memory
+            if proc.returncode == 0:
+                record(f"gui/tcp/{os.path.getsize(self.selected_file)}",
+                       {"time_s": elapsed, "throughput_mbps": throughput, "cpu_pct": avg_cpu, "memory_mb": avg_memory},
+                       "rdma_demo_app", {"server": server_ip})
 
             # Measure RTT for selected file
             file_size_mb, rtt_us = self.measure_rtt(server_ip, self.selected_file, "TCP")
@@ -660,7 +717,7 @@ class ModernRDMAApp:
 
             # Test multiple file sizes for bandwidth and RTT
             for size_mb in [1, 10, 100]:  # Test with 1MB, 10MB, 100MB files
-                temp_file = create_temp_file(int(size_mb * 1024 * 1024))
+                temp_file = create_temp_file(int(size_mb * 1024 * 1024), self.data_profile_var.get())
                 try:
                     proc = subprocess.Popen(["python3", "tcp_client.py", temp_file, server_ip],
                                             cwd=self.base_dir, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
@@ -715,78 +772,67 @@ class ModernRDMAApp:
             started_local_server = False
             if server_ip in ("127.0.0.1", "localhost"):
                 exe = os.path.join(self.base_dir, "rdma_file_server")
-                if os.path.exists(exe) and os.access(exe, os.X_OK):
+                if self.engine or (os.path.exists(exe) and os.access(exe, os.X_OK)):
                     self._ui_update("Launching local RDMA server for demo...")
-                    self.rdma_server_process = subprocess.Popen([exe], cwd=self.base_dir,
-                                                               stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+                    self.rdma_server_process = self._spawn_rdma_server(exe)
                     started_local_server = True
                     time.sleep(0.5)
                 else:
                     self._ui_update("")
                     raise FileNotFoundError("rdma_file_server missing")
 
-            client_exe = os.path.join(self.base_dir, "rdma_file_client")
-            if not os.path.exists(client_exe) or not os.access(client_exe, os.X_OK):
-                self._ui_update("")
-                raise FileNotFoundError("")
-
-            self.monitoring = True
-            proc = subprocess.Popen([client_exe, server_ip, self.selected_file], cwd=self.base_dir,
-                                    stdout=subprocess.PIPE, stderr=subprocess.PIPE)
-            monitor = threading.Thread(target=self.monitor_resources, args=(proc, "RDMA"), daemon=True)
-            monitor.start()
+            elapsed, result, error, avg_cpu, avg_memory = self._run_rdma_client(server_ip, self.selected_file,
+                                                                                self.dedup_var.get())
+            if result and result.get('dedup'):
+                self._ui_update(f"Dedup: {result['chunks_dup']}/{result['chunks_total']} chunks already on server, "
+                                f"{human_readable_size(result['bytes_saved'])} saved "
+                                f"(ratio {result['dedup_ratio'] * 100:.1f}%, {result['chunks_reflinked']} reflinked).")
 
-            start = time.perf_counter()
-            proc.wait()
-            end = time.perf_counter()
-            self.monitoring = False
-            monitor.join()
-
-            elapsed = end - start
             self.rdma_times.append(elapsed)
             throughput = file_size / elapsed if elapsed > 0 else 0.0
             self.last_rdma_throughput = throughput
-            avg_cpu, avg_memory = self.monitor_resources(proc, "RDMA")
             self.last_rdma_cpu = avg_cpu
-            self.last_rdma_memory = avg_memory
+            self.last_rdma_memory = avg_memory or 0.0  # the memory plot leaves out a zero bar
+            if not error:
+                record(f"gui/rdma/{os.path.getsize(self.selected_file)}{'/dedup' if self.dedup_var.get() else ''}",
+                       {"time_s": elapsed, "throughput_mbps": throughput, "cpu_pct": avg_cpu, "memory_mb": avg_memory},
+                       "rdma_demo_app", {"server": server_ip})
 
             file_size_mb, rtt_us = self.measure_rtt(server_ip, self.selected_file, "RDMA")
             self.rtt_data['RDMA'].append((file_size_mb, rtt_us))
             self.bandwidth_data['RDMA'].append((file_size_mb, throughput))
 
             for size_mb in [1, 10, 100]:
-                temp_file = create_temp_file(int(size_mb * 1024 * 1024))
+                temp_file = create_temp_file(int(size_mb * 1024 * 1024), self.data_profile_var.get())
                 try:
-                    proc = subprocess.Popen([client_exe, server_ip, temp_file],
-                                            cwd=self.base_dir, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
-                    start = time.perf_counter()
-                    proc.wait()
-                    end = time.perf_counter()
-                    elapsed = end - start
-                    throughput = size_mb / elapsed if elapsed > 0 else 0.0
-                    self.bandwidth_data['RDMA'].append((size_mb, throughput))
-                    _, rtt_us = self.measure_rtt(server_ip, temp_file, "RDMA")
-                    self.rtt_data['RDMA'].append((size_mb, rtt_us))
+                    sweep_elapsed, _, _, _, _ = self._run_rdma_client(server_ip, temp_file)
+                    sweep_throughput = size_mb / sweep_elapsed if sweep_elapsed > 0 else 0.0
+                    self.bandwidth_data['RDMA'].append((size_mb, sweep_throughput))
+                    _, sweep_rtt = self.measure_rtt(server_ip, temp_file, "RDMA")
+                    self.rtt_data['RDMA'].append((size_mb, sweep_rtt))
                 finally:
                     os.unlink(temp_file)
 
+            memory_text = f"{avg_memory:.2f} MB" if avg_memory is not None else "n/a (in-process engine)"
             self._ui_update(f"RDMA client finished (time={elapsed:.4f}s, throughput={throughput:.5f} MB/s, "
-                            f"CPU={avg_cpu:.2f}%, Memory={avg_memory:.2f} MB, RTT={rtt_us:.5f} µs).")
-            if proc.returncode != 0:
-                self._ui_update(f"RDMA client error: {proc.stderr.strip()}")
-            else:
-                recv_path = os.path.join(self.base_dir, "received_file.txt")
-                if not os.path.exists(recv_path):
-                    alt = os.path.join(self.base_dir, "logs", "rdma_received_file.txt")
-                    if os.path.exists(alt):
-                        recv_path = alt
-                if os.path.exists(recv_path):
-                    orig = file_checksum(self.selected_file)
-                    recv = file_checksum(recv_path)
-                    if orig == recv:
-                        self._ui_update("✅ RDMA file integrity OK.")
-                    else:
-                        self._ui_update("")
+                            f"CPU={avg_cpu:.2f}%, Memory={memory_text}, RTT={rtt_us:.5f} µs).")
+            connect_us = rdma_connect_us(result)
+            if connect_us is not None:
+                self._ui_update(f"RDMA connect latency (route resolved to established): {connect_us:.1f} µs.")
+            ceiling = self._rdma_ceiling(server_ip)
+            if ceiling:
+                gbps = throughput * 1024 * 1024 * 8 / 1e9
+                self._ui_update(f"RDMA transfer reached {gbps / ceiling * 100:.1f}% of the raw verbs ceiling "
+                                f"({gbps:.2f} of {ceiling:.2f} Gbit/s).")
+            if error:
+                self._ui_update(f"RDMA client error: {error}")
+            elif result and 'digest_match' in result:
+                # both ends hash the data in flight, so there is nothing to re-read here
+                if result['digest_match']:
+                    self._ui_update(f"✅ RDMA file integrity OK (BLAKE3 {result['digest'][:16]}…).")
+                else:
+                    self._ui_update(f"❌ RDMA digest mismatch: client {result['digest'][:16]}…, "
+                                    f"server {result['server_digest'][:16]}….")
 
             if started_local_server and self.rdma_server_process:
                 try:
@@ -805,6 +851,58 @@ class ModernRDMAApp:
             self.root.after(0, lambda: self.tcp_btn.configure(state='normal'))
             self.root.after(0, lambda: self.rdma_btn.configure(state='normal'))
 
+    def _run_rdma_client(self, server_ip, path, dedup=False):
+        """Run one RDMA transfer; returns (elapsed_s, RESULT dict or None, error or None, CPU %, memory MB).
+
+        With the engine loaded the transfer runs in this process, otherwise
+        rdma_file_client is spawned. CPU and memory come from the data-phase
+        rusage either of them reports; the engine reports no memory (None).
+        """
+        if self.engine:
+            start = time.perf_counter()
+            try:
+                result, error = self.engine.send_file(server_ip, path, DEDUP if dedup else 0), None
+            except EngineError as e:
+                result, error = None, str(e)
+            elapsed = time.perf_counter() - start
+            cpu, memory = self_reported_usage(result) or (0.0, None)
+            return elapsed, result, error, cpu, memory
+
+        client_exe = os.path.join(self.base_dir, "rdma_file_client")
+        if not os.path.exists(client_exe) or not os.access(client_exe, os.X_OK):
+            raise FileNotFoundError("rdma_file_client missing")
+        self.monitoring = True
+        client_args = [client_exe, server_ip, path] + (["--dedup"] if dedup else [])
+        proc = subprocess.Popen(client_args, cwd=self.base_dir,
+                                stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+        # psutil sampling is only the fallback for a client too old to report its own rusage
+        sampled = []
+        monitor = threading.Thread(target=lambda: sampled.append(self.monitor_resources(proc, "RDMA")), daemon=True)
+        monitor.start()
+        start = time.perf_counter()
+        client_out, client_err = proc.communicate()
+        elapsed = time.perf_counter() - start
+        self.monitoring = False
+        monitor.join()
+        result = parse_result_line(client_out)
+        avg_cpu, avg_memory = self_reported_usage(result) or (sampled[0] if sampled else (0.0, 0.0))
+        error = client_err.strip() if proc.returncode not in (0, 2) else None
+        return elapsed, result, error, avg_cpu, avg_memory
+
+    def _rdma_ceiling(self, server_ip):
+        """Best raw verbs bandwidth to server_ip in Gbit/s from `rdma_file_client bench`, measured once per server."""
+        if server_ip not in self.rdma_ceiling:
+            exe = os.path.join(self.base_dir, "rdma_file_client")
+            result = None
+            if os.path.exists(exe) and os.access(exe, os.X_OK):
+                out = run_command([exe, "bench", server_ip, "--sizes", "4K,1M", "--depths", "32", "--no-lat"])
+                result = parse_result_line(out.stdout)
+                if result:
+                    record("gui/bench/4K-1M", {f"ceiling_gbps/{op}": v for op, v in result['ceiling_gbps'].items()},
+                           "rdma_file_client bench", {"server": server_ip, "depth": 32})
+            self.rdma_ceiling[server_ip] = max(result['ceiling_gbps'].values()) if result else None
+        return self.rdma_ceiling[server_ip]
+
     def _ui_update(self, msg):
         self.root.after(0, lambda: self.update_status(msg))
 
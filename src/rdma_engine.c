@@ -0,0 +1,176 @@
+// rdma_engine.c -- rdma_file_client's transfer path as a library (see rdma_engine.h)
+//
+// The client source is compiled into this file with its main renamed, so a
+// transfer runs exactly the code the command-line tool runs. Its fatal-error
+// paths call exit(); here they unwind to rdma_engine_send instead, which tears
+// down what was built and reports the failure.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdarg.h>
+#include <setjmp.h>
+
+static __thread jmp_buf *engine_jmp;
+
+static __attribute__((noreturn)) void engine_exit(int code) {
+    if (engine_jmp) longjmp(*engine_jmp, code ? code : 1);
+    (exit)(code);
+}
+
+#define exit(code) engine_exit(code)
+#define main rdma_file_client_main
+#include "rdma_file_client.c"
+#undef main
+#undef exit
+
+#include "rdma_engine.h"
+
+static __thread char engine_err[256];
+
+const char *rdma_engine_error(void) { return engine_err; }
+
+static __attribute__((noreturn, format(printf, 1, 2))) void engine_fail(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(engine_err, sizeof(engine_err), fmt, ap);
+    va_end(ap);
+    engine_exit(1);
+}
+
+struct engine_progress {
+    rdma_engine_progress_fn fn;
+    void *arg;
+    uint64_t step, next;
+};
+
+static void engine_on_data(struct client_ctx *c, uint64_t end) {
+    struct engine_progress *p = c->on_data_arg;
+    if (end < p->next && end < c->size) return;
+    p->next = end + p->step;
+    p->fn(end, c->size, p->arg);
+}
+
+// undo client_connect and the source open; copes with a connect that failed halfway
+static void engine_teardown(struct client_ctx *c) {
+    if (c->id && c->id->qp) {
+        rdma_disconnect(c->id);
+        rdma_destroy_qp(c->id);
+    }
+    if (c->mr) ibv_dereg_mr(c->mr);
+    if (c->send_cq) ibv_destroy_cq(c->send_cq);
+    if (c->recv_cq) ibv_destroy_cq(c->recv_cq);
+    if (c->pd) ibv_dealloc_pd(c->pd);
+    free(c->buf);
+    if (c->id) rdma_destroy_id(c->id);
+    if (c->f) fclose(c->f);
+}
+
+int rdma_engine_send(const char *server, const char *src, int flags, const char *tenant,
+                     rdma_engine_progress_fn progress, uint64_t progress_step, void *arg,
+                     struct rdma_engine_stats *out) {
+    // everything the error path needs lives outside the stack frame that longjmp returns to
+    static __thread struct client_ctx c;
+    static __thread struct rail r;
+    static __thread struct rdma_event_channel *ec;
+    static __thread struct datagen gen;
+    struct engine_progress prog = {progress, arg, progress_step ? progress_step : 1 << 20, 0};
+    const int zero_detect = !!(flags & RDMA_ENGINE_ZERO_DETECT), fill = !!(flags & RDMA_ENGINE_FILL);
+    const uint8_t mode = (uint8_t)((flags & (XFER_F_DEDUP | XFER_F_SPARSE | XFER_F_FILL | XFER_F_RING)) |
+                                   (zero_detect || fill ? XFER_F_SPARSE : 0));
+    jmp_buf jb;
+
+    memset(&c, 0, sizeof(c));
+    memset(out, 0, sizeof(*out));
+    r = (struct rail){.remote = server};
+    ec = NULL;
+    engine_err[0] = '\0';
+    if (setjmp(jb)) {
+        engine_jmp = NULL;
+        if (!engine_err[0]) snprintf(engine_err, sizeof(engine_err), "transfer to %s failed (details on stderr)", server);
+        engine_teardown(&c);
+        if (ec) rdma_destroy_event_channel(ec);
+        if (r.dst) rdma_freeaddrinfo(r.dst);
+        return -1;
+    }
+    engine_jmp = &jb;
+
+    if (strncmp(src, "gen:", 4) == 0) {
+        if (datagen_parse_spec(src + 4, &gen, &c.size) != 0) engine_fail("bad generator spec %s", src);
+        c.gen = &gen;
+    } else {
+        struct stat st;
+        c.f = fopen(src, "rb");
+        if (!c.f || fstat(fileno(c.f), &st) != 0) engine_fail("%s: %s", src, strerror(errno));
+        c.size = (uint64_t)st.st_size;
+    }
+    struct rdma_addrinfo hints = {.ai_port_space = RDMA_PS_TCP};
+    if (rdma_getaddrinfo(server, PORT, &hints, &r.dst)) engine_fail("cannot resolve %s", server);
+    ec = rdma_create_event_channel();
+    if (!ec) engine_fail("rdma_create_event_channel: %s", strerror(errno));
+    int crc = client_connect(&c, ec, &r, NULL, 0);
+    if (crc) {
+        // client_connect already released everything it built
+        c.id = NULL;
+        c.pd = NULL;
+        c.send_cq = c.recv_cq = NULL;
+        c.mr = NULL;
+        c.buf = NULL;
+        if (crc > 0) engine_fail("%s rejected the connection", server);
+        engine_fail("cannot connect to %s", server);
+    }
+    if (progress) {
+        c.on_data = engine_on_data;
+        c.on_data_arg = &prog;
+    }
+
+    double t0 = now_sec();
+    struct usage u0;
+    usage_now(RUSAGE_THREAD, &u0);
+    blake3_hasher_init(&c.hasher);
+    send_file_hdr(&c, mode, c.size, tenant ? tenant : "default", 0, 1);
+    if (mode & XFER_F_DEDUP) send_dedup(&c);
+    else if (mode & XFER_F_SPARSE) send_sparse(&c, zero_detect, fill);
+    else if (mode & XFER_F_RING) send_ring(&c);
+    else send_plain(&c);
+    send_msg(&c, MSG_DONE, 0, c.size, NULL, 0);
+    uint32_t rlen;
+    struct result_wire rw;
+    memcpy(&rw, wait_reply(&c, MSG_RESULT, &rlen), sizeof(rw));
+    out->elapsed_s = now_sec() - t0;
+    struct usage u = usage_since(&u0, RUSAGE_THREAD);
+    engine_jmp = NULL;
+
+    uint8_t digest[BLAKE3_OUT_LEN];
+    blake3_hasher_finalize(&c.hasher, digest);
+    blake3_hex(digest, out->digest);
+    blake3_hex(rw.digest, out->server_digest);
+    out->digest_match = memcmp(digest, rw.digest, BLAKE3_OUT_LEN) == 0;
+    out->file_size = c.size;
+    out->bytes_sent = ntohll(rw.bytes_received);
+    out->bytes_written = ntohll(rw.bytes_written);
+    out->chunks_total = ntohll(rw.chunks_total);
+    out->chunks_dup = ntohll(rw.chunks_dup);
+    out->bytes_saved = ntohll(rw.bytes_dup);
+    out->chunks_reflinked = ntohll(rw.chunks_reflinked);
+    out->hole_bytes = c.hole_bytes;
+    out->zero_chunks = c.zero_chunks;
+    out->fill_bytes = c.fill_bytes;
+    out->fill_runs = c.fill_msgs;
+    out->queue_delay_s = ntohll(rw.queue_delay_us) / 1e6;
+    out->credit_wait_s = c.credit_wait;
+    out->addr_s = c.phase.addr;
+    out->route_s = c.phase.route;
+    out->resources_s = c.phase.resources;
+    out->connected_s = c.phase.connected;
+    out->first_byte_s = c.phase.first_byte;
+    out->user_s = u.user_s;
+    out->sys_s = u.sys_s;
+    out->vol_ctx_switches = u.vcsw;
+    out->invol_ctx_switches = u.ivcsw;
+    out->minor_faults = u.minflt;
+    out->major_faults = u.majflt;
+
+    engine_teardown(&c);
+    rdma_destroy_event_channel(ec);
+    rdma_freeaddrinfo(r.dst);
+    return out->digest_match ? 0 : 2;
+}
@@ -0,0 +1,70 @@
+// rdma_engine.h -- C ABI of librdma_engine.so, the transfer engine as a library
+//
+// rdma_engine_send runs one transfer in the calling thread with the same code
+// as rdma_file_client and returns its statistics. A failure returns -1 instead
+// of exiting the process. rdma_engine_server_start spawns the rdma_file_server
+// executable. Bindings: rdma_engine.py (ctypes).
+#ifndef RDMA_ENGINE_H
+#define RDMA_ENGINE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// transfer modes, the same bits as the wire's XFER_F_* flags. ZERO_DETECT
+// and FILL are rdma_file_client's --zero-detect and --fill and imply SPARSE;
+// ZERO_DETECT stays on the client, so it has no wire bit.
+enum rdma_engine_flags {
+    RDMA_ENGINE_DEDUP = 1 << 0,
+    RDMA_ENGINE_SPARSE = 1 << 1,
+    RDMA_ENGINE_FILL = 1 << 2,
+    RDMA_ENGINE_RING = 1 << 3,
+    RDMA_ENGINE_ZERO_DETECT = 1 << 8,
+};
+
+struct rdma_engine_stats {
+    uint64_t file_size;
+    uint64_t bytes_sent;        // payload bytes the server received
+    uint64_t bytes_written;
+    uint64_t chunks_total, chunks_dup, bytes_saved, chunks_reflinked;
+    uint64_t hole_bytes, zero_chunks, fill_bytes, fill_runs;
+    double elapsed_s;           // file header to result, like the client's RESULT line
+    double queue_delay_s;       // held back by the server's bandwidth policy
+    double credit_wait_s;
+    // time to first byte, seconds since the connect started
+    double addr_s, route_s, resources_s, connected_s, first_byte_s;
+    // the calling thread's getrusage over the transfer. No peak RSS: the
+    // kernel only has the caller's whole process's, not the transfer's.
+    double user_s, sys_s;
+    long vol_ctx_switches, invol_ctx_switches, minor_faults, major_faults;
+    int digest_match;
+    char digest[65], server_digest[65];     // BLAKE3, hex
+};
+
+// called from the sending thread as data goes out, at most once per progress_step bytes
+typedef void (*rdma_engine_progress_fn)(uint64_t sent, uint64_t total, void *arg);
+
+// src is a path or a "gen:" spec as for rdma_file_client. Returns 0, 2 on a
+// digest mismatch, or -1 with the reason in rdma_engine_error().
+int rdma_engine_send(const char *server, const char *src, int flags, const char *tenant,
+                     rdma_engine_progress_fn progress, uint64_t progress_step, void *arg,
+                     struct rdma_engine_stats *out);
+
+// reason for the last -1 from this thread
+const char *rdma_engine_error(void);
+
+// spawn rdma_file_server ($RDMA_FILE_SERVER, else the one next to this library)
+// with argv (without the program name); its output goes to log_path (NULL:
+// inherited). Returns the pid, or -1 if the executable is missing or fails to start.
+int rdma_engine_server_start(int argc, const char *const *argv, const char *log_path);
+
+// SIGTERM the server and reap it; returns its exit status or -1
+int rdma_engine_server_stop(int pid, double timeout_s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
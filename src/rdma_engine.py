@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+# rdma_engine.py -- ctypes binding for librdma_engine.so (see rdma_engine.h)
+#
+# Transfers run in the calling thread through the native engine: no exec, no
+# stdout scraping, and exact per-phase numbers. The server is the
+# rdma_file_server executable, spawned by the library.
+
+import ctypes
+import os
+import time
+
+DEDUP = 1 << 0
+SPARSE = 1 << 1
+FILL = 1 << 2           # implies SPARSE, like rdma_file_client --fill
+RING = 1 << 3
+ZERO_DETECT = 1 << 8    # implies SPARSE, like rdma_file_client --zero-detect
+
+PROGRESS_FN = ctypes.CFUNCTYPE(None, ctypes.c_uint64, ctypes.c_uint64, ctypes.c_void_p)
+
+
+class EngineStats(ctypes.Structure):
+    _fields_ = [
+        ("file_size", ctypes.c_uint64),
+        ("bytes_sent", ctypes.c_uint64),
+        ("bytes_written", ctypes.c_uint64),
+        ("chunks_total", ctypes.c_uint64),
+        ("chunks_dup", ctypes.c_uint64),
+        ("bytes_saved", ctypes.c_uint64),
+        ("chunks_reflinked", ctypes.c_uint64),
+        ("hole_bytes", ctypes.c_uint64),
+        ("zero_chunks", ctypes.c_uint64),
+        ("fill_bytes", ctypes.c_uint64),
+        ("fill_runs", ctypes.c_uint64),
+        ("elapsed_s", ctypes.c_double),
+        ("queue_delay_s", ctypes.c_double),
+        ("credit_wait_s", ctypes.c_double),
+        ("addr_s", ctypes.c_double),
+        ("route_s", ctypes.c_double),
+        ("resources_s", ctypes.c_double),
+        ("connected_s", ctypes.c_double),
+        ("first_byte_s", ctypes.c_double),
+        ("user_s", ctypes.c_double),
+        ("sys_s", ctypes.c_double),
+        ("vol_ctx_switches", ctypes.c_long),
+        ("invol_ctx_switches", ctypes.c_long),
+        ("minor_faults", ctypes.c_long),
+        ("major_faults", ctypes.c_long),
+        ("digest_match", ctypes.c_int),
+        ("digest", ctypes.c_char * 65),
+        ("server_digest", ctypes.c_char * 65),
+    ]
+
+
+class EngineError(RuntimeError):
+    pass
+
+
+class EngineServer:
+    """A server started by Engine.start_server; quacks like the subprocess.Popen it replaces."""
+
+    def __init__(self, engine, pid):
+        self.engine = engine
+        self.pid = pid
+        self.returncode = None
+
+    def poll(self):
+        if self.returncode is None:
+            pid, status = os.waitpid(self.pid, os.WNOHANG)
+            if pid == self.pid:
+                self.returncode = os.waitstatus_to_exitcode(status)
+        return self.returncode
+
+    def wait(self, timeout=None):
+        deadline = None if timeout is None else time.monotonic() + timeout
+        while self.poll() is None:
+            if deadline is not None and time.monotonic() > deadline:
+                raise TimeoutError(f"server {self.pid} still running")
+            time.sleep(0.01)
+        return self.returncode
+
+    def terminate(self, timeout=1.0):
+        if self.returncode is None:
+            self.returncode = self.engine.lib.rdma_engine_server_stop(self.pid, timeout)
+
+
+class Engine:
+    def __init__(self, path=None):
+        if path is None:
+            path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "librdma_engine.so")
+        self.lib = ctypes.CDLL(path)
+        self.lib.rdma_engine_send.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int, ctypes.c_char_p,
+                                              PROGRESS_FN, ctypes.c_uint64, ctypes.c_void_p,
+                                              ctypes.POINTER(EngineStats)]
+        self.lib.rdma_engine_send.restype = ctypes.c_int
+        self.lib.rdma_engine_error.restype = ctypes.c_char_p
+        self.lib.rdma_engine_server_start.argtypes = [ctypes.c_int, ctypes.POINTER(ctypes.c_char_p), ctypes.c_char_p]
+        self.lib.rdma_engine_server_start.restype = ctypes.c_int
+        self.lib.rdma_engine_server_stop.argtypes = [ctypes.c_int, ctypes.c_double]
+        self.lib.rdma_engine_server_stop.restype = ctypes.c_int
+
+    def send_file(self, server, src, flags=0, tenant="default", progress=None, progress_step=1 << 20):
+        """Send src (a path or a "gen:" spec) and return the client's RESULT fields as a dict.
+
+        progress(sent, total) is called from this thread at most once per progress_step bytes.
+        """
+        stats = EngineStats()
+        cb = PROGRESS_FN(lambda sent, total, _arg: progress(sent, total)) if progress else PROGRESS_FN()
+        rc = self.lib.rdma_engine_send(server.encode(), os.fsencode(src), flags, tenant.encode(),
+                                       cb, progress_step, None, ctypes.byref(stats))
+        if rc < 0:
+            raise EngineError(self.lib.rdma_engine_error().decode(errors="replace"))
+        return {
+            "file_size": stats.file_size,
+            "elapsed_s": stats.elapsed_s,
+            "dedup": bool(flags & DEDUP),
+            "sparse": bool(flags & (SPARSE | FILL | ZERO_DETECT)),
+            "ring": bool(flags & RING),
+            "hole_bytes": stats.hole_bytes,
+            "zero_chunks": stats.zero_chunks,
+            "fill_bytes": stats.fill_bytes,
+            "fill_runs": stats.fill_runs,
+            "bytes_sent": stats.bytes_sent,
+            "bytes_written": stats.bytes_written,
+            "chunks_total": stats.chunks_total,
+            "chunks_dup": stats.chunks_dup,
+            "bytes_saved": stats.bytes_saved,
+            "chunks_reflinked": stats.chunks_reflinked,
+            "dedup_ratio": stats.bytes_saved / stats.file_size if stats.file_size else 0.0,
+            "tenant": tenant,
+            "queue_delay_s": stats.queue_delay_s,
+            "credit_wait_s": stats.credit_wait_s,
+            "phases": {
+                "addr_s": stats.addr_s,
+                "route_s": stats.route_s,
+                "resources_s": stats.resources_s,
+                "connected_s": stats.connected_s,
+                "first_byte_s": stats.first_byte_s,
+            },
+            # this thread only, so other threads of the caller do not blur the numbers;
+            # no max_rss_kb, as the kernel's peak RSS would be the whole caller's
+            "rusage": {"data": {
+                "user_s": stats.user_s,
+                "sys_s": stats.sys_s,
+                "cpu_s": stats.user_s + stats.sys_s,
+                "vol_ctx_switches": stats.vol_ctx_switches,
+                "invol_ctx_switches": stats.invol_ctx_switches,
+                "minor_faults": stats.minor_faults,
+                "major_faults": stats.major_faults,
+            }},
+            "digest_alg": "blake3",
+            "digest": stats.digest.decode(),
+            "server_digest": stats.server_digest.decode(),
+            "digest_match": bool(stats.digest_match),
+        }
+
+    def start_server(self, *args, log=None):
+        """Start rdma_file_server with the given options; returns an EngineServer."""
+        argv = (ctypes.c_char_p * (len(args) + 1))(*[a.encode() for a in args], None)
+        pid = self.lib.rdma_engine_server_start(len(args), argv, os.fsencode(log) if log else None)
+        if pid < 0:
+            raise EngineError("could not start rdma_file_server (build it next to librdma_engine.so "
+                              "or set RDMA_FILE_SERVER)")
+        return EngineServer(self, pid)
+
+
+def load_engine(path=None):
+    """Return an Engine, or None when librdma_engine.so has not been built."""
+    try:
+        return Engine(path)
+    except OSError:
+        return None
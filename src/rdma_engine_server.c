@@ -0,0 +1,68 @@
+// rdma_engine_server.c -- rdma_file_server for librdma_engine.so (see rdma_engine.h)
+//
+// The server runs as its own executable, started with posix_spawn. A fork of
+// the caller without exec would copy its threads' locks and its verbs
+// resources into the child, which neither libibverbs nor a threaded caller
+// like the GUI survives reliably.
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "rdma_engine.h"
+
+extern char **environ;
+
+// $RDMA_FILE_SERVER, else rdma_file_server next to this library
+static int server_path(char *path, size_t n) {
+    const char *env = getenv("RDMA_FILE_SERVER");
+    if (env && *env) return snprintf(path, n, "%s", env) < (int)n ? 0 : -1;
+    Dl_info info;
+    if (!dladdr((void *)server_path, &info) || !info.dli_fname) return -1;
+    const char *slash = strrchr(info.dli_fname, '/');
+    int dir = slash ? (int)(slash - info.dli_fname) : 1;
+    return snprintf(path, n, "%.*s/rdma_file_server", dir, slash ? info.dli_fname : ".") < (int)n ? 0 : -1;
+}
+
+int rdma_engine_server_start(int argc, const char *const *argv, const char *log_path) {
+    char path[PATH_MAX];
+    if (server_path(path, sizeof(path)) != 0 || access(path, X_OK) != 0) return -1;
+    char **args = calloc((size_t)argc + 2, sizeof(char *));
+    if (!args) return -1;
+    args[0] = path;
+    for (int i = 0; i < argc; i++) args[i + 1] = (char *)argv[i];
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    if (log_path) {
+        posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO, log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        posix_spawn_file_actions_adddup2(&fa, STDOUT_FILENO, STDERR_FILENO);
+    }
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid;
+    int rc = posix_spawn(&pid, path, &fa, NULL, args, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    free(args);
+    return rc != 0 ? -1 : (int)pid;
+}
+
+int rdma_engine_server_stop(int pid, double timeout_s) {
+    int status;
+    if (kill(pid, SIGTERM) != 0) return -1;
+    for (double waited = 0; waited < timeout_s; waited += 0.01) {
+        pid_t r = waitpid(pid, &status, WNOHANG);
+        if (r == pid) return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        if (r < 0) return -1;
+        usleep(10000);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+    return -1;
+}
@@ -1,115 +1,1760 @@
 // rdma_file_client.c (fixed)
+#define _GNU_SOURCE
 #include <rdma/rdma_cma.h>
 #include <infiniband/verbs.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
-#include <arpa/inet.h> // htonll helper
+#include "rdma_common.h"
+#define BLAKE3_PARALLEL
+#include "blake3.h"
+#include "datagen.h"
+#include "fillscan.h"
+#include "rusage.h"
 
-#define PORT "7471"
-#define BUF_SIZE 4096
+// registered buffer layout: [send slot][recv ring][dedup batch / sparse data]
+#define SEND_OFF 0
+#define RECV_OFF MSG_BUF_SIZE
+// every unread credit message carries at least one credit, so at most
+// RECV_DEPTH of them plus MAX_REPLIES answers can be in flight towards us
+#define MAX_REPLIES 4
+#define RECV_RING (RECV_DEPTH + MAX_REPLIES)
+#define MAX_JOBS 1024
+// ring mode: records written per tail update; each batch is staged in the batch area
+#define RING_BATCH 32
+#define BATCH_OFF ((size_t)(1 + RECV_RING) * MSG_BUF_SIZE)
+#define REG_SIZE (BATCH_OFF + (size_t)DEDUP_BATCH * BUF_SIZE)
 
-// helper for 64-bit hton
-static inline uint64_t htonll(uint64_t x) {
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-    return (((uint64_t)htonl(x & 0xFFFFFFFFULL)) << 32) | htonl(x >> 32);
-#else
-    return x;
-#endif
+// one file of a multi-job run; its messages carry the job index as msg_hdr.stream
+enum job_state { JOB_PENDING, JOB_SENDING, JOB_WAIT_RESULT, JOB_COMPLETE };
+
+struct job {
+    const char *src;
+    FILE *f;
+    struct datagen gen;
+    int is_gen;
+    uint64_t size, sent;
+    int prio;               // 0 is the most urgent class
+    double deadline;        // seconds after the run starts, 0 = none
+    double last_served;     // for aging: when the scheduler last picked this job
+    double first_byte, completion;
+    enum job_state state;
+    blake3_hasher hasher;
+    struct result_wire rw;
+};
+
+enum sched_policy { JOBS_FIFO, JOBS_SRPT };
+
+// a local/remote address pair; QPs on different rails resolve to different devices
+struct rail {
+    const char *local, *remote;
+    struct rdma_addrinfo *src, *dst;
+};
+
+struct client_ctx {
+    struct rdma_cm_id *id;
+    struct ibv_pd *pd;
+    struct ibv_cq *send_cq, *recv_cq;
+    struct ibv_mr *mr;
+    char *buf;
+    blake3_hasher hasher;   // whole-file digest over the bytes as they are sent
+    // flow control: sends left before the server must grant more, and the last non-credit reply
+    int credits;
+    double credit_wait;
+    char reply[MSG_BUF_SIZE];
+    int have_reply;
+    // multi-job mode: stream stamped on outgoing messages, and results routed back per job
+    uint16_t stream;
+    struct job *jobs;
+    int njobs;
+    int replies_pending;
+    double t0;
+    // data source: a file, or synthetic data generated straight into the registered buffer
+    FILE *f;
+    const struct datagen *gen;
+    uint64_t size, src_off;
+    // sparse mode: end of the last byte range described to the server, and accounting
+    uint64_t sent_end;
+    uint64_t hole_bytes, zero_chunks;
+    // fill elision: pending run of identical non-zero chunks
+    uint64_t run_start, run_len;
+    uint8_t run_byte;
+    uint64_t fill_bytes, fill_msgs;
+    // ring mode: RDMA READs of the server's head, and time spent with the ring full
+    uint64_t ring_reads;
+    double ring_full_wait;
+    // time to first byte: milestones since client_connect started, plus the local setup time
+    double t_connect;
+    struct { double addr, route, resources, connected, first_byte; } phase;
+    // in-process callers (rdma_engine.c) follow MSG_DATA sends through this hook
+    void (*on_data)(struct client_ctx *c, uint64_t end);
+    void *on_data_arg;
+};
+
+// cleared by --serial-setup: resolve, then build local resources, strictly in turn
+static int overlap_setup = 1;
+// process usage when main started: the "run" half of every RESULT's rusage
+static struct usage run_usage0;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
-int main(int argc, char **argv) {
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <server_ip> <file_to_send>\n", argv[0]);
+static void post_ring_recv(struct client_ctx *c, int slot) {
+    struct ibv_sge sge = {.addr = (uintptr_t)(c->buf + RECV_OFF + (size_t)slot * MSG_BUF_SIZE),
+                          .length = MSG_BUF_SIZE, .lkey = c->mr->lkey};
+    struct ibv_recv_wr wr = {.wr_id = (uint64_t)slot, .sg_list = &sge, .num_sge = 1};
+    struct ibv_recv_wr *bad;
+    if (ibv_post_recv(c->id->qp, &wr, &bad)) { perror("ibv_post_recv"); exit(1); }
+}
+
+// consume whatever the server has sent: credits are counted, anything else is kept as the reply
+static void poll_ring(struct client_ctx *c) {
+    struct ibv_wc wc[RECV_RING];
+    int n = ibv_poll_cq(c->recv_cq, RECV_RING, wc);
+    if (n < 0) { fprintf(stderr, "ibv_poll_cq failed\n"); exit(1); }
+    for (int i = 0; i < n; i++) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "reply recv failed: %s\n", ibv_wc_status_str(wc[i].status));
+            exit(1);
+        }
+        int slot = (int)wc[i].wr_id;
+        const struct msg_hdr *h = (const struct msg_hdr *)(c->buf + RECV_OFF + (size_t)slot * MSG_BUF_SIZE);
+        if (wc[i].byte_len < sizeof(*h)) { fprintf(stderr, "reply too small\n"); exit(1); }
+        if (h->type == MSG_CREDIT) {
+            uint32_t n_credits;
+            memcpy(&n_credits, h + 1, sizeof(n_credits));
+            c->credits += (int)ntohl(n_credits);
+        } else if (h->type == MSG_RESULT && c->jobs) {
+            // the stream ID comes off the wire: only a job still waiting for its result may take it
+            uint16_t id = ntohs(h->stream);
+            if (id >= c->njobs || c->jobs[id].state != JOB_WAIT_RESULT ||
+                wc[i].byte_len < sizeof(*h) + sizeof(c->jobs[id].rw)) {
+                fprintf(stderr, "unexpected result for stream %u\n", id);
+                exit(1);
+            }
+            struct job *j = &c->jobs[id];
+            memcpy(&j->rw, h + 1, sizeof(j->rw));
+            j->completion = now_sec() - c->t0;
+            j->state = JOB_COMPLETE;
+            c->replies_pending--;
+        } else {
+            memcpy(c->reply, h, wc[i].byte_len);
+            c->have_reply = 1;
+        }
+        post_ring_recv(c, slot);
+    }
+}
+
+// send header + optional payload (payload must live inside the registered buffer)
+static void send_msg(struct client_ctx *c, uint8_t type, uint8_t flags, uint64_t offset,
+                     const char *payload, uint32_t len) {
+    if (c->credits == 0) {
+        double t = now_sec();
+        while (c->credits == 0) poll_ring(c);
+        c->credit_wait += now_sec() - t;
+    }
+    c->credits--;
+    struct msg_hdr *h = (struct msg_hdr *)(c->buf + SEND_OFF);
+    msg_hdr_set(h, type, flags, len, offset);
+    h->stream = htons(c->stream);
+    struct ibv_sge sge[2] = {
+        {.addr = (uintptr_t)h, .length = sizeof(*h), .lkey = c->mr->lkey},
+        {.addr = (uintptr_t)payload, .length = len, .lkey = c->mr->lkey},
+    };
+    struct ibv_send_wr wr = {.wr_id = type, .sg_list = sge, .num_sge = len ? 2 : 1,
+        .opcode = IBV_WR_SEND, .send_flags = IBV_SEND_SIGNALED};
+    struct ibv_send_wr *bad;
+    struct ibv_wc wc;
+    if (ibv_post_send(c->id->qp, &wr, &bad)) { perror("ibv_post_send"); exit(1); }
+    if (poll_one(c->send_cq, &wc)) { fprintf(stderr, "send (type %u) failed\n", type); exit(1); }
+    if (type == MSG_DATA && c->phase.first_byte == 0) c->phase.first_byte = now_sec() - c->t_connect;
+    if (type == MSG_DATA && c->on_data) c->on_data(c, offset + len);
+}
+
+// per-phase time to first byte, as a JSON object; start_s is the CLOCK_MONOTONIC
+// time the connect began, so a driver can line runs up
+static void phases_json(const struct client_ctx *c, char *out, size_t n) {
+    snprintf(out, n, "{\"overlap\": %s, \"start_s\": %.6f, \"addr_s\": %.6f, \"route_s\": %.6f, \"resources_s\": %.6f, "
+             "\"connected_s\": %.6f, \"first_byte_s\": %.6f}", overlap_setup ? "true" : "false", c->t_connect,
+             c->phase.addr, c->phase.route, c->phase.resources, c->phase.connected, c->phase.first_byte);
+}
+
+static void print_phases(const struct client_ctx *c) {
+    printf("[Client] Setup: address %.3f ms, route %.3f ms, local resources %.3f ms (%s), connected %.3f ms, "
+           "first byte %.3f ms\n", c->phase.addr * 1e3, c->phase.route * 1e3, c->phase.resources * 1e3,
+           overlap_setup ? "overlapped" : "serial", c->phase.connected * 1e3, c->phase.first_byte * 1e3);
+}
+
+// RESULT "rusage": the whole run, the data phase that began at data0, and the
+// per-thread objects in threads (a JSON array body) if there are any
+static void usage_report(const struct usage *data0, const char *threads, char *out, size_t n) {
+    struct usage run = usage_since(&run_usage0, RUSAGE_SELF), data = usage_since(data0, RUSAGE_SELF);
+    char rj[320], dj[320];
+    usage_json(&run, rj, sizeof(rj));
+    usage_json(&data, dj, sizeof(dj));
+    printf("[Client] Data phase: user %.3f s, sys %.3f s, %ld voluntary / %ld involuntary context switches, "
+           "%ld minor / %ld major faults, peak RSS %ld KiB\n", data.user_s, data.sys_s, data.vcsw, data.ivcsw,
+           data.minflt, data.majflt, data.max_rss_kb);
+    snprintf(out, n, "{\"run\": %s, \"data\": %s%s%s%s}", rj, dj, threads ? ", \"threads\": [" : "",
+             threads ? threads : "", threads ? "]" : "");
+}
+
+// wait for the next non-credit message from the server; returns its payload
+static const char *wait_reply(struct client_ctx *c, uint8_t type, uint32_t *len) {
+    while (!c->have_reply) poll_ring(c);
+    c->have_reply = 0;
+    const struct msg_hdr *h = (const struct msg_hdr *)c->reply;
+    if (h->type != type) {
+        fprintf(stderr, "unexpected reply (type %u, wanted %u)\n", h->type, type);
+        exit(1);
+    }
+    *len = ntohl(h->len);
+    return (const char *)(h + 1);
+}
+
+static size_t src_read(struct client_ctx *c, char *dst, size_t len) {
+    if (!c->gen) return fread(dst, 1, len, c->f);
+    if (len > c->size - c->src_off) len = (size_t)(c->size - c->src_off);
+    datagen_fill(c->gen, c->src_off, (uint8_t *)dst, len);
+    c->src_off += len;
+    return len;
+}
+
+static size_t src_pread(struct client_ctx *c, char *dst, size_t len, uint64_t off) {
+    if (len > c->size - off) len = (size_t)(c->size - off);
+    if (c->gen) { datagen_fill(c->gen, off, (uint8_t *)dst, len); return len; }
+    ssize_t r = pread(fileno(c->f), dst, len, (off_t)off);
+    if (r < 0) { perror("pread"); exit(1); }
+    return (size_t)r;
+}
+
+// next data extent at or after off: [*start, *end). Returns -1 when only holes remain.
+static int next_extent(struct client_ctx *c, uint64_t off, uint64_t *start, uint64_t *end) {
+    if (off >= c->size) return -1;
+    if (c->gen) { *start = off; *end = c->size; return 0; }
+    int fd = fileno(c->f);
+    off_t d = lseek(fd, (off_t)off, SEEK_DATA);
+    if (d < 0) {
+        if (errno == ENXIO) return -1;
+        *start = off; *end = c->size;   // filesystem without SEEK_DATA: all data
+        return 0;
+    }
+    off_t h = lseek(fd, d, SEEK_HOLE);
+    *start = (uint64_t)d;
+    *end = h < 0 || (uint64_t)h > c->size ? c->size : (uint64_t)h;
+    return 0;
+}
+
+// the digest covers holes as the zeros they read back as
+static void hash_zeros(struct client_ctx *c, uint64_t len) {
+    static const uint8_t zeros[BUF_SIZE];
+    while (len > 0) {
+        size_t n = len < BUF_SIZE ? (size_t)len : BUF_SIZE;
+        blake3_hasher_update(&c->hasher, zeros, n);
+        len -= n;
+    }
+}
+
+static void send_hole(struct client_ctx *c, uint64_t offset, uint64_t len) {
+    char *payload = c->buf + SEND_OFF + sizeof(struct msg_hdr);
+    uint64_t net_len = htonll(len);
+    memcpy(payload, &net_len, sizeof(net_len));
+    send_msg(c, MSG_HOLE, 0, offset, payload, sizeof(net_len));
+    hash_zeros(c, len);
+    c->hole_bytes += len;
+}
+
+static void flush_fill(struct client_ctx *c) {
+    if (c->run_len == 0) return;
+    if (c->run_start > c->sent_end) send_hole(c, c->sent_end, c->run_start - c->sent_end);
+    char *payload = c->buf + SEND_OFF + sizeof(struct msg_hdr);
+    struct fill_wire fw = {.len = htonll(c->run_len), .byte = c->run_byte};
+    memcpy(payload, &fw, sizeof(fw));
+    send_msg(c, MSG_FILL, 0, c->run_start, payload, sizeof(fw));
+
+    uint8_t pat[BUF_SIZE];
+    memset(pat, c->run_byte, sizeof(pat));
+    for (uint64_t left = c->run_len; left > 0; ) {
+        size_t n = left < BUF_SIZE ? (size_t)left : BUF_SIZE;
+        blake3_hasher_update(&c->hasher, pat, n);
+        left -= n;
+    }
+    c->fill_bytes += c->run_len;
+    c->fill_msgs++;
+    c->sent_end = c->run_start + c->run_len;
+    c->run_len = 0;
+}
+
+// sparse: walk data extents, send them, and describe everything else as holes.
+// With zero_detect, all-zero chunks inside data extents become holes too; with
+// fill, runs of chunks holding one repeated non-zero byte become MSG_FILL.
+static void send_sparse(struct client_ctx *c, int zero_detect, int fill) {
+    char *payload = c->buf + BATCH_OFF;     // the send slot payload is used by hole/fill messages
+    uint64_t off = 0, start, end;
+    while (next_extent(c, off, &start, &end) == 0) {
+        for (uint64_t pos = start; pos < end; ) {
+            size_t want = end - pos < BUF_SIZE ? (size_t)(end - pos) : BUF_SIZE;
+            size_t r = src_pread(c, payload, want, pos);
+            if (r == 0) break;
+            uint8_t byte;
+            if ((zero_detect || fill) && fill_scan(payload, r, &byte) && (byte == 0 || fill)) {
+                if (byte == 0) {
+                    flush_fill(c);
+                    c->zero_chunks++;
+                } else if (c->run_len && c->run_byte == byte && c->run_start + c->run_len == pos) {
+                    c->run_len += r;
+                } else {
+                    flush_fill(c);
+                    c->run_start = pos;
+                    c->run_len = r;
+                    c->run_byte = byte;
+                }
+                pos += r;
+                continue;
+            }
+            flush_fill(c);
+            if (pos > c->sent_end) send_hole(c, c->sent_end, pos - c->sent_end);
+            blake3_hasher_update(&c->hasher, payload, r);
+            send_msg(c, MSG_DATA, 0, pos, payload, (uint32_t)r);
+            pos += r;
+            c->sent_end = pos;
+        }
+        off = end;
+    }
+    flush_fill(c);
+    if (c->sent_end < c->size) send_hole(c, c->sent_end, c->size - c->sent_end);
+}
+
+static void send_plain(struct client_ctx *c) {
+    char *payload = c->buf + SEND_OFF + sizeof(struct msg_hdr);
+    uint64_t offset = 0;
+    size_t r;
+    while ((r = src_read(c, payload, BUF_SIZE)) > 0) {
+        blake3_hasher_update(&c->hasher, payload, r);
+        send_msg(c, MSG_DATA, 0, offset, payload, (uint32_t)r);
+        offset += r;
+    }
+}
+
+static void ring_post(struct client_ctx *c, enum ibv_wr_opcode op, void *local, uint32_t len,
+                      uint64_t remote, uint32_t rkey, int signaled) {
+    struct ibv_sge sge = {.addr = (uintptr_t)local, .length = len, .lkey = c->mr->lkey};
+    struct ibv_send_wr wr = {.wr_id = op, .sg_list = &sge, .num_sge = 1, .opcode = op,
+        .send_flags = signaled ? IBV_SEND_SIGNALED : 0};
+    wr.wr.rdma.remote_addr = remote;
+    wr.wr.rdma.rkey = rkey;
+    struct ibv_send_wr *bad;
+    struct ibv_wc wc;
+    if (ibv_post_send(c->id->qp, &wr, &bad)) { perror("ibv_post_send"); exit(1); }
+    if (signaled && poll_one(c->send_cq, &wc)) { fprintf(stderr, "ring %s failed\n", op == IBV_WR_RDMA_READ ? "read" : "write"); exit(1); }
+}
+
+// ring: WRITE up to RING_BATCH records into free slots, then WRITE the new tail.
+// Only the tail write is signaled; RC completes in order, so its completion
+// frees the whole staging batch. The head is read back only when the ring is full.
+static void send_ring(struct client_ctx *c) {
+    uint32_t len;
+    struct ring_wire rw;
+    memcpy(&rw, wait_reply(c, MSG_RING, &len), sizeof(rw));
+    uint64_t addr = ntohll(rw.addr);
+    uint32_t rkey = ntohl(rw.rkey), slots = ntohl(rw.slots), slot_size = ntohl(rw.slot_size);
+    uint64_t tail_addr = addr + offsetof(struct ring_ctrl, tail), head_addr = addr + offsetof(struct ring_ctrl, head);
+    uint64_t *word = (uint64_t *)(c->buf + SEND_OFF);
+    char *stage = c->buf + BATCH_OFF;
+    if ((size_t)RING_BATCH * slot_size > (size_t)DEDUP_BATCH * BUF_SIZE || slot_size < sizeof(struct ring_rec) + BUF_SIZE) {
+        fprintf(stderr, "server ring slots of %u bytes do not fit\n", slot_size);
+        exit(1);
+    }
+
+    uint64_t tail = 0, head = 0, offset = 0;
+    while (offset < c->size) {
+        int n = 0;
+        while (n < RING_BATCH && offset < c->size && tail - head < slots) {
+            char *rec = stage + (size_t)n * slot_size;
+            size_t r = src_read(c, rec + sizeof(struct ring_rec), BUF_SIZE);
+            if (r == 0) { c->size = offset; break; }
+            blake3_hasher_update(&c->hasher, rec + sizeof(struct ring_rec), r);
+            struct ring_rec h = {.offset = htonll(offset), .len = htonl((uint32_t)r), .seq = htonl((uint32_t)tail)};
+            memcpy(rec, &h, sizeof(h));
+            ring_post(c, IBV_WR_RDMA_WRITE, rec, (uint32_t)(sizeof(h) + r),
+                      addr + sizeof(struct ring_ctrl) + (tail % slots) * slot_size, rkey, 0);
+            tail++;
+            n++;
+            offset += r;
+        }
+        if (n) {
+            if (c->phase.first_byte == 0) c->phase.first_byte = now_sec() - c->t_connect;
+            *word = htonll(tail);
+            ring_post(c, IBV_WR_RDMA_WRITE, word, sizeof(*word), tail_addr, rkey, 1);
+            continue;
+        }
+        // full as far as we know: look at the server's head
+        double t = now_sec();
+        while (tail - head >= slots) {
+            ring_post(c, IBV_WR_RDMA_READ, word, sizeof(*word), head_addr, rkey, 1);
+            head = ntohll(*(volatile uint64_t *)word);
+            c->ring_reads++;
+        }
+        c->ring_full_wait += now_sec() - t;
+    }
+}
+
+// dedup: per batch, send chunk hashes, then only the chunks the server asks for
+static void send_dedup(struct client_ctx *c) {
+    char *batch = c->buf + BATCH_OFF;
+    char *hashes = c->buf + SEND_OFF + sizeof(struct msg_hdr);
+    size_t lens[DEDUP_BATCH];
+    uint64_t base = 0;
+    for (;;) {
+        size_t r = src_read(c, batch, (size_t)DEDUP_BATCH * BUF_SIZE);
+        if (r == 0) break;
+        size_t n = (r + BUF_SIZE - 1) / BUF_SIZE;
+        blake3_hasher_update(&c->hasher, batch, r);
+        for (size_t i = 0; i < n; i++) {
+            lens[i] = (i == n - 1) ? r - i * BUF_SIZE : BUF_SIZE;
+            blake3(batch + i * BUF_SIZE, lens[i], (uint8_t *)hashes + i * DEDUP_HASH_LEN);
+        }
+        send_msg(c, MSG_HASHES, 0, base, hashes, (uint32_t)(n * DEDUP_HASH_LEN));
+        uint32_t blen;
+        const uint8_t *need = (const uint8_t *)wait_reply(c, MSG_NEED, &blen);
+        uint8_t bitmap[DEDUP_BATCH / 8];
+        memcpy(bitmap, need, sizeof(bitmap));
+        for (size_t i = 0; i < n; i++) {
+            if (bitmap[i / 8] & (1u << (i % 8)))
+                send_msg(c, MSG_DATA, 0, base + i * BUF_SIZE, batch + i * BUF_SIZE, (uint32_t)lens[i]);
+        }
+        base += r;
+        if (r < (size_t)DEDUP_BATCH * BUF_SIZE) break;
+    }
+}
+
+static void wait_cm_event(struct rdma_event_channel *ec, enum rdma_cm_event_type want) {
+    struct rdma_cm_event *event;
+    if (rdma_get_cm_event(ec, &event)) { perror("rdma_get_cm_event"); exit(1); }
+    enum rdma_cm_event_type got = event->event;
+    rdma_ack_cm_event(event);
+    if (got != want) { fprintf(stderr, "%s (wanted %s)\n", rdma_event_str(got), rdma_event_str(want)); exit(1); }
+}
+
+// undo everything client_connect built
+static void client_release(struct client_ctx *c) {
+    rdma_destroy_qp(c->id);
+    ibv_dereg_mr(c->mr);
+    ibv_destroy_cq(c->send_cq);
+    ibv_destroy_cq(c->recv_cq);
+    ibv_dealloc_pd(c->pd);
+    free(c->buf);
+    rdma_destroy_id(c->id);
+}
+
+// one RC QP to the server; the receive ring is posted before connecting so
+// credits can never arrive to an empty queue. pdata rides in the connect
+// request. Returns 1 if the server rejected the connection; the reject's
+// private data is then left in c->reply and the QP is already torn down.
+// Returns -1, also torn down, if the connection could not be established.
+//
+// Local setup runs while the CM works: the buffer is faulted in during address
+// resolution, and PD/CQ/QP/MR are built on the resolved device while the route
+// query is outstanding. --serial-setup restores the one-step-at-a-time order.
+static int client_connect(struct client_ctx *c, struct rdma_event_channel *ec, const struct rail *r,
+                          const void *pdata, uint8_t pdata_len) {
+    c->t_connect = now_sec();
+    rdma_create_id(ec, &c->id, NULL, RDMA_PS_TCP);
+    // binding the source address picks the rail's device
+    rdma_resolve_addr(c->id, r->src ? r->src->ai_src_addr : NULL, r->dst->ai_dst_addr, 2000);
+    if (!overlap_setup) wait_cm_event(ec, RDMA_CM_EVENT_ADDR_RESOLVED);
+    c->buf = malloc(REG_SIZE);
+    if (!c->buf) { perror("malloc"); exit(1); }
+    memset(c->buf, 0, REG_SIZE);
+    if (overlap_setup) wait_cm_event(ec, RDMA_CM_EVENT_ADDR_RESOLVED);
+    c->phase.addr = now_sec() - c->t_connect;
+
+    rdma_resolve_route(c->id, 2000);
+    if (!overlap_setup) {
+        wait_cm_event(ec, RDMA_CM_EVENT_ROUTE_RESOLVED);
+        c->phase.route = now_sec() - c->t_connect;
+    }
+
+    double t = now_sec();
+    c->pd = ibv_alloc_pd(c->id->verbs);
+    c->send_cq = ibv_create_cq(c->id->verbs, 10, NULL, NULL, 0);
+    c->recv_cq = ibv_create_cq(c->id->verbs, RECV_RING, NULL, NULL, 0);
+
+    struct ibv_qp_init_attr qp_attr = {
+        .send_cq = c->send_cq, .recv_cq = c->recv_cq, .qp_type = IBV_QPT_RC,
+        .cap = {.max_send_wr = RING_BATCH + 2, .max_recv_wr = RECV_RING,
+                .max_send_sge = 2, .max_recv_sge = 1}
+    };
+    if (rdma_create_qp(c->id, c->pd, &qp_attr)) { perror("rdma_create_qp"); exit(1); }
+
+    c->mr = ibv_reg_mr(c->pd, c->buf, REG_SIZE, IBV_ACCESS_LOCAL_WRITE);
+    if (!c->mr) { perror("ibv_reg_mr"); exit(1); }
+    for (int i = 0; i < RECV_RING; i++) post_ring_recv(c, i);
+    c->credits = 1;
+    c->phase.resources = now_sec() - t;
+    if (overlap_setup) {
+        wait_cm_event(ec, RDMA_CM_EVENT_ROUTE_RESOLVED);
+        c->phase.route = now_sec() - c->t_connect;
+    }
+
+    struct rdma_cm_event *event;
+    struct rdma_conn_param param = {.private_data = pdata, .private_data_len = pdata_len,
+        .responder_resources = 1, .initiator_depth = 1, .retry_count = 7, .rnr_retry_count = 7};
+    if (rdma_connect(c->id, pdata ? &param : NULL)) {
+        perror("rdma_connect");
+        client_release(c);
+        return -1;
+    }
+    if (rdma_get_cm_event(ec, &event)) {
+        perror("rdma_get_cm_event");
+        client_release(c);
+        return -1;
+    }
+    c->phase.connected = now_sec() - c->t_connect;
+    enum rdma_cm_event_type got = event->event;
+    if (got == RDMA_CM_EVENT_ESTABLISHED) {
+        rdma_ack_cm_event(event);
+        return 0;
+    }
+    if (got == RDMA_CM_EVENT_REJECTED) {
+        memset(c->reply, 0, sizeof(c->reply));
+        if (event->param.conn.private_data)
+            memcpy(c->reply, event->param.conn.private_data, event->param.conn.private_data_len);
+    } else {
+        fprintf(stderr, "%s (wanted %s)\n", rdma_event_str(got), rdma_event_str(RDMA_CM_EVENT_ESTABLISHED));
+    }
+    rdma_ack_cm_event(event);
+    client_release(c);
+    return got == RDMA_CM_EVENT_REJECTED ? 1 : -1;
+}
+
+static void client_disconnect(struct client_ctx *c) {
+    rdma_disconnect(c->id);
+    client_release(c);
+}
+
+// file header: size + transfer mode, and the tenant whose bandwidth share this counts against
+static void send_file_hdr(struct client_ctx *c, uint8_t flags, uint64_t size, const char *tenant,
+                          uint64_t session, int qps) {
+    char *payload = c->buf + SEND_OFF + sizeof(struct msg_hdr);
+    struct file_hdr_wire fh = {.session = htonll(session), .qps = (uint8_t)qps};
+    memcpy(fh.tenant, tenant, strnlen(tenant, sizeof(fh.tenant)));
+    memcpy(payload, &fh, sizeof(fh));
+    send_msg(c, MSG_FILE_HDR, flags, size, payload, sizeof(fh));
+}
+
+// ---------- multi-job mode ----------
+
+static int job_open(struct job *j, const char *src, int prio, double deadline) {
+    memset(j, 0, sizeof(*j));
+    j->src = src;
+    j->prio = prio;
+    j->deadline = deadline;
+    if (strncmp(src, "gen:", 4) == 0) {
+        if (datagen_parse_spec(src + 4, &j->gen, &j->size) != 0) return -1;
+        j->is_gen = 1;
+    } else {
+        struct stat st;
+        if (!(j->f = fopen(src, "rb")) || fstat(fileno(j->f), &st) != 0) return -1;
+        j->size = (uint64_t)st.st_size;
+    }
+    blake3_hasher_init(&j->hasher);
+    return 0;
+}
+
+// "SOURCE [PRIORITY [DEADLINE_MS]]" per line; blank lines and '#' comments are skipped
+static int load_jobs(const char *path, struct job *jobs, int *njobs) {
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return -1; }
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        char src[400];
+        int prio = 0;
+        double deadline_ms = 0;
+        if (line[0] == '#' || sscanf(line, "%399s %d %lf", src, &prio, &deadline_ms) < 1) continue;
+        if (*njobs == MAX_JOBS) { fprintf(stderr, "too many jobs (max %d)\n", MAX_JOBS); break; }
+        if (job_open(&jobs[*njobs], strdup(src), prio, deadline_ms / 1e3) != 0) {
+            fprintf(stderr, "cannot open job source %s\n", src);
+            fclose(f);
+            return -1;
+        }
+        (*njobs)++;
+    }
+    fclose(f);
+    return 0;
+}
+
+// pick the job that gets the next quantum of chunks. SRPT orders by remaining
+// bytes, scaled up 2x per priority level and down by how long the job has gone
+// unserved (aging, so big jobs cannot starve); jobs that will miss their
+// deadline at the current rate unless served now go first, earliest deadline first.
+static struct job *pick_job(struct job *jobs, int njobs, enum sched_policy policy, double aging,
+                            double now, double rate) {
+    struct job *best = NULL;
+    double best_key = 0;
+    int best_urgent = 0;
+    for (int i = 0; i < njobs; i++) {
+        struct job *j = &jobs[i];
+        if (j->state != JOB_PENDING && j->state != JOB_SENDING) continue;
+        if (policy == JOBS_FIFO) return j;
+        double remaining = (double)(j->size - j->sent);
+        int urgent = j->deadline > 0 && now + remaining / rate >= j->deadline;
+        double key = urgent ? j->deadline
+                            : remaining * (double)(1u << (j->prio < 16 ? j->prio : 16)) /
+                              (1.0 + aging * (now - j->last_served));
+        if (!best || urgent > best_urgent || (urgent == best_urgent && key < best_key)) {
+            best = j;
+            best_key = key;
+            best_urgent = urgent;
+        }
+    }
+    return best;
+}
+
+static void job_send_chunk(struct client_ctx *c, struct job *j, double now) {
+    char *payload = c->buf + SEND_OFF + sizeof(struct msg_hdr);
+    c->stream = (uint16_t)(j - c->jobs);
+    if (j->sent == j->size) {
+        // everything is out: close the stream, keeping the answers in flight within the ring
+        while (c->replies_pending >= MAX_REPLIES) poll_ring(c);
+        c->replies_pending++;
+        j->state = JOB_WAIT_RESULT;
+        send_msg(c, MSG_DONE, 0, j->size, NULL, 0);
+        if (j->f) fclose(j->f);
+        return;
+    }
+    size_t n = j->size - j->sent < BUF_SIZE ? (size_t)(j->size - j->sent) : BUF_SIZE;
+    if (j->is_gen) {
+        datagen_fill(&j->gen, j->sent, (uint8_t *)payload, n);
+    } else if (pread(fileno(j->f), payload, n, (off_t)j->sent) != (ssize_t)n) {
+        fprintf(stderr, "short read from %s\n", j->src);
+        exit(1);
+    }
+    if (j->state == JOB_PENDING) { j->state = JOB_SENDING; j->first_byte = now; }
+    blake3_hasher_update(&j->hasher, payload, n);
+    send_msg(c, MSG_DATA, 0, j->sent, payload, (uint32_t)n);
+    j->sent += n;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// interleave all jobs over the one connection, quantum chunks per scheduling decision
+static int run_jobs(struct client_ctx *c, struct job *jobs, int njobs, const char *tenant,
+                    enum sched_policy policy, double aging, int quantum) {
+    c->jobs = jobs;
+    c->njobs = njobs;
+    c->t0 = now_sec();
+    struct usage data0;
+    usage_now(RUSAGE_SELF, &data0);
+    uint64_t total = 0;
+    // announce every job up front so the server sees the whole queue
+    for (int i = 0; i < njobs; i++) {
+        c->stream = (uint16_t)i;
+        send_file_hdr(c, 0, jobs[i].size, tenant, 0, 1);
+        total += jobs[i].size;
+    }
+
+    uint64_t sent = 0;
+    for (;;) {
+        double now = now_sec() - c->t0;
+        double rate = now > 0.01 && sent > 0 ? sent / now : 1e9;
+        struct job *j = pick_job(jobs, njobs, policy, aging, now, rate);
+        if (!j) break;
+        j->last_served = now;
+        for (int q = 0; q < quantum && (j->state == JOB_PENDING || j->state == JOB_SENDING); q++) {
+            uint64_t before = j->sent;
+            job_send_chunk(c, j, now);
+            sent += j->sent - before;
+        }
+    }
+    while (c->replies_pending > 0) poll_ring(c);
+    double elapsed = now_sec() - c->t0;
+
+    // per-job lines, then the aggregate RESULT the GUI reads
+    double *ct = malloc(sizeof(double) * (size_t)njobs);
+    if (!ct) { perror("malloc"); exit(1); }
+    int all_match = 1, misses = 0;
+    uint64_t bytes_written = 0;
+    double sum_ct = 0, sum_slowdown = 0, queue_delay = 0;
+    double rate = elapsed > 0 ? total / elapsed : 0;
+    for (int i = 0; i < njobs; i++) {
+        struct job *j = &jobs[i];
+        uint8_t digest[BLAKE3_OUT_LEN];
+        blake3_hasher_finalize(&j->hasher, digest);
+        int match = memcmp(digest, j->rw.digest, BLAKE3_OUT_LEN) == 0;
+        int met = j->deadline <= 0 || j->completion <= j->deadline;
+        all_match &= match;
+        misses += !met;
+        bytes_written += ntohll(j->rw.bytes_written);
+        queue_delay += ntohll(j->rw.queue_delay_us) / 1e6;
+        ct[i] = j->completion;
+        sum_ct += j->completion;
+        // slowdown: completion time relative to sending this job alone at the run's average rate
+        double ideal = rate > 0 ? j->size / rate : 0;
+        sum_slowdown += ideal > 1e-6 ? j->completion / ideal : 1.0;
+        printf("JOB {\"job\": %d, \"source\": \"%s\", \"size\": %" PRIu64 ", \"priority\": %d, "
+               "\"deadline_s\": %.6f, \"first_byte_s\": %.6f, \"completion_s\": %.6f, "
+               "\"deadline_met\": %s, \"digest_match\": %s}\n",
+               i, j->src, j->size, j->prio, j->deadline, j->first_byte, j->completion,
+               met ? "true" : "false", match ? "true" : "false");
+    }
+    qsort(ct, (size_t)njobs, sizeof(double), cmp_double);
+    printf("[Client] %d jobs sent (%" PRIu64 " bytes) in %.3f s, mean completion %.3f s, p99 %.3f s, "
+           "%d deadlines missed.\n", njobs, total, elapsed, sum_ct / njobs,
+           ct[(size_t)(0.99 * (njobs - 1))], misses);
+    char phases[256], rusage[1024];
+    print_phases(c);
+    phases_json(c, phases, sizeof(phases));
+    usage_report(&data0, NULL, rusage, sizeof(rusage));
+    printf("RESULT {\"file_size\": %" PRIu64 ", \"elapsed_s\": %.6f, \"jobs\": %d, \"sched\": \"%s\", "
+           "\"bytes_sent\": %" PRIu64 ", \"bytes_written\": %" PRIu64 ", "
+           "\"mean_completion_s\": %.6f, \"p50_completion_s\": %.6f, \"p99_completion_s\": %.6f, "
+           "\"max_completion_s\": %.6f, \"mean_slowdown\": %.3f, \"deadline_misses\": %d, "
+           "\"tenant\": \"%s\", \"queue_delay_s\": %.6f, \"credit_wait_s\": %.6f, \"phases\": %s, "
+           "\"rusage\": %s, \"digest_alg\": \"blake3\", \"digest_match\": %s}\n",
+           total, elapsed, njobs, policy == JOBS_SRPT ? "srpt" : "fifo", sent, bytes_written,
+           sum_ct / njobs, ct[(size_t)(0.5 * (njobs - 1))], ct[(size_t)(0.99 * (njobs - 1))],
+           ct[njobs - 1], sum_slowdown / njobs, misses, tenant, queue_delay, c->credit_wait, phases,
+           rusage, all_match ? "true" : "false");
+    fflush(stdout);
+    free(ct);
+    return all_match ? 0 : 2;
+}
+
+// ---------- multi-QP mode ----------
+
+// a sender's share of the chunk indices, [head, tail) packed into one word: the
+// owner pops from the head and thieves split off the back half, each with a
+// single CAS, so the data path takes no locks
+struct span {
+    _Atomic uint64_t ht;
+    char pad[64 - sizeof(uint64_t)];    // one cache line per span
+};
+
+struct qp_worker {
+    pthread_t thread;
+    struct client_ctx *c;
+    struct span *spans;
+    struct qp_worker *all;
+    uint32_t (*cvs)[8];         // BLAKE3 chaining value of every chunk, filled by whichever sender sends it
+    int index, nqps, rail;
+    double start;
+    _Atomic uint64_t chunks;    // read by thieves to estimate this sender's rate
+    uint64_t bytes, steals;
+    double dry_at;      // when this sender found no work left anywhere
+    struct usage usage; // this sender thread's own usage
+};
+
+
+static inline uint64_t span_pack(uint32_t head, uint32_t tail) { return (uint64_t)head << 32 | tail; }
+
+static int span_pop(struct span *s, uint32_t *idx) {
+    uint64_t v = atomic_load(&s->ht);
+    for (;;) {
+        uint32_t head = (uint32_t)(v >> 32), tail = (uint32_t)v;
+        if (head >= tail) return 0;
+        if (atomic_compare_exchange_weak(&s->ht, &v, span_pack(head + 1, tail))) { *idx = head; return 1; }
+    }
+}
+
+// chunks per second so far; 0 before the first chunk
+static double worker_rate(const struct qp_worker *w, double now) {
+    uint64_t n = atomic_load_explicit(&w->chunks, memory_order_relaxed);
+    return n && now > w->start ? n / (now - w->start) : 0;
+}
+
+// take work from the span that will take longest to drain at its owner's
+// measured rate, splitting it in proportion to our rate and the owner's (half
+// when either is unknown); 0 when everything is taken
+static int span_steal(struct qp_worker *w) {
+    for (;;) {
+        double now = now_sec(), worst = 0;
+        int victim = -1;
+        for (int i = 0; i < w->nqps; i++) {
+            if (i == w->index) continue;
+            uint64_t v = atomic_load(&w->spans[i].ht);
+            uint32_t head = (uint32_t)(v >> 32), tail = (uint32_t)v;
+            if (head >= tail) continue;
+            double rate = worker_rate(&w->all[i], now);
+            double drain = rate > 0 ? (tail - head) / rate : (double)(tail - head) * 1e9;
+            if (victim < 0 || drain > worst) { worst = drain; victim = i; }
+        }
+        if (victim < 0) return 0;
+        struct span *s = &w->spans[victim];
+        uint64_t v = atomic_load(&s->ht);
+        uint32_t head = (uint32_t)(v >> 32), tail = (uint32_t)v;
+        if (head >= tail) continue;
+        double mine = worker_rate(w, now), theirs = worker_rate(&w->all[victim], now);
+        double share = mine > 0 && theirs > 0 ? mine / (mine + theirs) : 0.5;
+        uint32_t take = (uint32_t)((tail - head) * share + 0.5);
+        if (take == 0) take = 1;
+        if (!atomic_compare_exchange_strong(&s->ht, &v, span_pack(head, tail - take))) continue;
+        atomic_store(&w->spans[w->index].ht, span_pack(tail - take, tail));
+        w->steals++;
         return 1;
     }
+}
 
-    struct rdma_event_channel *ec = rdma_create_event_channel();
-    struct rdma_cm_id *conn_id = NULL;
-    struct rdma_addrinfo hints = {}, *res;
-    struct ibv_pd *pd;
-    struct ibv_cq *cq;
-    struct ibv_mr *mr;
-    char *buf = malloc(BUF_SIZE);
-    if (!buf) { perror("malloc"); exit(1); }
+static void *qp_sender(void *arg) {
+    struct qp_worker *w = arg;
+    struct client_ctx *c = w->c;
+    char *payload = c->buf + SEND_OFF + sizeof(struct msg_hdr);
+    struct usage u0;
+    usage_now(RUSAGE_THREAD, &u0);
+    for (;;) {
+        uint32_t idx;
+        if (!span_pop(&w->spans[w->index], &idx)) {
+            if (span_steal(w)) continue;
+            break;
+        }
+        uint64_t off = (uint64_t)idx * BUF_SIZE;
+        size_t n = src_pread(c, payload, BUF_SIZE, off);
+        if (w->cvs) blake3_piece_cv(payload, n, idx, BUF_SIZE, w->cvs[idx]);
+        send_msg(c, MSG_DATA, 0, off, payload, (uint32_t)n);
+        w->bytes += n;
+        atomic_fetch_add_explicit(&w->chunks, 1, memory_order_relaxed);
+    }
+    w->dry_at = now_sec();
+    w->usage = usage_since(&u0, RUSAGE_THREAD);
+    return NULL;
+}
+
+// BLAKE3 of the whole source read again, for comparison with the server's digest
+static void source_digest(struct client_ctx *c, uint8_t out[BLAKE3_OUT_LEN]) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (c->f && c->size > 0) {
+        void *map = mmap(NULL, c->size, PROT_READ, MAP_SHARED, fileno(c->f), 0);
+        if (map != MAP_FAILED) {
+            blake3_parallel(map, c->size, ncpu > 0 ? (int)ncpu : 1, out);
+            munmap(map, c->size);
+            return;
+        }
+    }
+    blake3_hasher h;
+    blake3_hasher_init(&h);
+    char *tmp = c->buf + BATCH_OFF;
+    for (uint64_t off = 0; off < c->size; ) {
+        size_t n = src_pread(c, tmp, (size_t)DEDUP_BATCH * BUF_SIZE, off);
+        if (n == 0) break;
+        blake3_hasher_update(&h, tmp, n);
+        off += n;
+    }
+    blake3_hasher_finalize(&h, out);
+}
+
+// one file over nqps connections: each QP gets an equal span of chunks to start
+// with and a sender thread; senders that run dry steal from the fullest span, so
+// faster paths end up carrying more of the file
+static int send_multi_qp(struct client_ctx *cs, int nqps, const struct rail *rails, int nrails,
+                         const char *src, const char *tenant) {
+    struct datagen gen;
+    uint64_t file_size;
+    FILE *f = NULL;
+    if (strncmp(src, "gen:", 4) == 0) {
+        if (datagen_parse_spec(src + 4, &gen, &file_size) != 0) { fprintf(stderr, "bad generator spec %s\n", src); exit(1); }
+    } else {
+        struct stat st;
+        if (!(f = fopen(src, "rb")) || fstat(fileno(f), &st) != 0) { perror("fopen"); exit(1); }
+        file_size = (uint64_t)st.st_size;
+    }
+    uint64_t nchunks = (file_size + BUF_SIZE - 1) / BUF_SIZE;
+    if (nchunks > UINT32_MAX) { fprintf(stderr, "file too large for multi-QP mode\n"); exit(1); }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t session = ((uint64_t)getpid() << 32 ^ (uint64_t)ts.tv_nsec ^ (uint64_t)ts.tv_sec << 20) | 1;
+
+    struct span *spans = aligned_alloc(64, sizeof(struct span) * (size_t)nqps);
+    struct qp_worker *ws = calloc((size_t)nqps, sizeof(*ws));
+    if (!spans || !ws) { perror("alloc"); exit(1); }
+    // the senders hash each chunk as they send it, 32 bytes of state per 4 KiB, so
+    // the digest needs no second pass over the source; a one-chunk file has no tree
+    uint32_t (*cvs)[8] = nchunks > 1 ? calloc(nchunks, sizeof(*cvs)) : NULL;
+
+    double t0 = now_sec();
+    struct usage data0;
+    usage_now(RUSAGE_SELF, &data0);
+    for (int i = 0; i < nqps; i++) {
+        cs[i].f = f;
+        cs[i].gen = f ? NULL : &gen;
+        cs[i].size = file_size;
+        send_file_hdr(&cs[i], 0, file_size, tenant, session, nqps);
+        uint64_t lo = nchunks * (uint64_t)i / (uint64_t)nqps, hi = nchunks * (uint64_t)(i + 1) / (uint64_t)nqps;
+        atomic_init(&spans[i].ht, span_pack((uint32_t)lo, (uint32_t)hi));
+        ws[i] = (struct qp_worker){.c = &cs[i], .spans = spans, .all = ws, .cvs = cvs, .index = i, .nqps = nqps,
+                                   .rail = i % nrails, .start = t0};
+    }
+    for (int i = 0; i < nqps; i++)
+        if (pthread_create(&ws[i].thread, NULL, qp_sender, &ws[i]) != 0) { perror("pthread_create"); exit(1); }
+    double last = 0;
+    for (int i = 0; i < nqps; i++) {
+        pthread_join(ws[i].thread, NULL);
+        if (ws[i].dry_at > last) last = ws[i].dry_at;
+    }
+    double data_s = last - t0;
+
+    // every member must close its stream before the server answers any of them
+    for (int i = 0; i < nqps; i++) send_msg(&cs[i], MSG_DONE, 0, file_size, NULL, 0);
+    struct result_wire rw;
+    double queue_delay = 0;
+    for (int i = 0; i < nqps; i++) {
+        uint32_t rlen;
+        memcpy(&rw, wait_reply(&cs[i], MSG_RESULT, &rlen), sizeof(rw));
+        double q = ntohll(rw.queue_delay_us) / 1e6;
+        if (q > queue_delay) queue_delay = q;
+    }
+    double elapsed = now_sec() - t0;
+
+    uint8_t digest[BLAKE3_OUT_LEN];
+    char hex[2 * BLAKE3_OUT_LEN + 1], server_hex[2 * BLAKE3_OUT_LEN + 1];
+    if (cvs) blake3_from_pieces((const uint32_t (*)[8])cvs, file_size, BUF_SIZE, digest);
+    else source_digest(&cs[0], digest);
+    free(cvs);
+    blake3_hex(digest, hex);
+    blake3_hex(rw.digest, server_hex);
+    int digest_match = memcmp(digest, rw.digest, BLAKE3_OUT_LEN) == 0;
+    if (f) fclose(f);
+
+    printf("[Client] File sent successfully (%" PRIu64 " bytes over %d QPs).\n", file_size, nqps);
+    printf("[Client] BLAKE3 %s (server %s)\n", hex, digest_match ? "matches" : "MISMATCH");
+    char bytes_json[MAX_QPS * 24], steals_json[MAX_QPS * 24], idle_json[MAX_QPS * 24];
+    size_t pb = 0, ps = 0, pi = 0;
+    for (int i = 0; i < nqps; i++) {
+        double idle = last - ws[i].dry_at;
+        printf("[Client] QP %d: %" PRIu64 " bytes (%.1f%%), %" PRIu64 " steals, idle for the last %.3f s\n",
+               i, ws[i].bytes, file_size ? 100.0 * ws[i].bytes / file_size : 0.0, ws[i].steals, idle);
+        const char *sep = i ? ", " : "";
+        pb += snprintf(bytes_json + pb, sizeof(bytes_json) - pb, "%s%" PRIu64, sep, ws[i].bytes);
+        ps += snprintf(steals_json + ps, sizeof(steals_json) - ps, "%s%" PRIu64, sep, ws[i].steals);
+        pi += snprintf(idle_json + pi, sizeof(idle_json) - pi, "%s%.6f", sep, idle);
+    }
+    // per rail: bytes carried and the rate while its QPs were busy
+    char rails_json[MAX_QPS * 160];
+    size_t pr = 0;
+    for (int r = 0; r < nrails; r++) {
+        uint64_t bytes = 0;
+        double busy = 0;
+        for (int i = r; i < nqps; i += nrails) {
+            bytes += ws[i].bytes;
+            if (ws[i].dry_at - t0 > busy) busy = ws[i].dry_at - t0;
+        }
+        const char *dev = ibv_get_device_name(cs[r].id->verbs->device);
+        double mbps = busy > 0 ? bytes / busy / 1e6 : 0.0;
+        if (nrails > 1)
+            printf("[Client] Rail %d (%s -> %s, %s): %" PRIu64 " bytes, %.2f MB/s\n", r,
+                   rails[r].local ? rails[r].local : "*", rails[r].remote, dev, bytes, mbps);
+        pr += snprintf(rails_json + pr, sizeof(rails_json) - pr,
+                       "%s{\"local\": \"%s\", \"remote\": \"%s\", \"device\": \"%s\", \"bytes\": %" PRIu64 ", \"MBps\": %.2f}",
+                       r ? ", " : "", rails[r].local ? rails[r].local : "", rails[r].remote, dev, bytes, mbps);
+    }
+    char phases[256], threads[MAX_QPS * 336], rusage[sizeof(threads) + 1024];
+    size_t pt = 0;
+    for (int i = 0; i < nqps; i++) {
+        if (i) pt += snprintf(threads + pt, sizeof(threads) - pt, ", ");
+        usage_json(&ws[i].usage, threads + pt, sizeof(threads) - pt);
+        pt += strlen(threads + pt);
+    }
+    print_phases(&cs[0]);
+    phases_json(&cs[0], phases, sizeof(phases));
+    usage_report(&data0, threads, rusage, sizeof(rusage));
+    printf("RESULT {\"file_size\": %" PRIu64 ", \"elapsed_s\": %.6f, \"data_s\": %.6f, \"qps\": %d, "
+           "\"qp_bytes\": [%s], \"qp_steals\": [%s], \"qp_idle_tail_s\": [%s], \"rails\": [%s], "
+           "\"bytes_sent\": %" PRIu64 ", \"bytes_written\": %" PRIu64 ", "
+           "\"tenant\": \"%s\", \"queue_delay_s\": %.6f, \"phases\": %s, \"rusage\": %s, "
+           "\"digest_alg\": \"blake3\", \"digest\": \"%s\", \"server_digest\": \"%s\", \"digest_match\": %s}\n",
+           file_size, elapsed, data_s, nqps, bytes_json, steals_json, idle_json, rails_json,
+           ntohll(rw.bytes_received), ntohll(rw.bytes_written), tenant, queue_delay, phases, rusage,
+           hex, server_hex, digest_match ? "true" : "false");
+    fflush(stdout);
+    free(spans);
+    free(ws);
+    return digest_match ? 0 : 2;
+}
+
+// ---------- UD transport (experimental) ----------
 
-    hints.ai_port_space = RDMA_PS_TCP;
-    rdma_getaddrinfo(argv[1], PORT, &hints, &res);
+// --ud: datagrams of one path MTU over a UD QP. Up to window datagrams are in
+// flight; each keeps its send slot until the server's cumulative ACK passes it,
+// so holes the server reports can be resent straight from the slot.
+#define UD_SEND_DEPTH 128
+#define UD_RECV 64
+#define UD_MAX_STALLS 100  // RTOs in a row without progress before the transfer is given up
 
-    rdma_create_id(ec, &conn_id, NULL, RDMA_PS_TCP);
-    rdma_resolve_addr(conn_id, NULL, res->ai_dst_addr, 2000);
+struct ud_ctx {
+    struct client_ctx *c;
+    struct ibv_ah *ah;
+    uint32_t rqpn, rqkey;
+    uint32_t dgram, window;
+    size_t slot;            // msg_hdr + dgram
+    size_t recv_slot;       // UD_GRH + path MTU
+    double rto;
+    // per window slot: datagram it holds, when it last went out, acked, send WRs still posted
+    uint64_t *seq;
+    double *sent_at;
+    uint8_t *acked;
+    int *inflight;
+    int posted;
+    uint64_t datagrams, retransmits, nack_retransmits, timeouts;
+};
+
+// layout: [window data slots][control slot][UD_RECV receive slots]
+static char *ud_slot(struct ud_ctx *u, uint32_t i) { return u->c->buf + (size_t)i * u->slot; }
+
+static void ud_reap(struct ud_ctx *u) {
+    struct ibv_wc wc[16];
+    int n = ibv_poll_cq(u->c->send_cq, 16, wc);
+    if (n < 0) { fprintf(stderr, "ibv_poll_cq failed\n"); exit(1); }
+    for (int i = 0; i < n; i++) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            fprintf(stderr, "UD send failed: %s\n", ibv_wc_status_str(wc[i].status));
+            exit(1);
+        }
+        u->inflight[wc[i].wr_id]--;
+        u->posted--;
+    }
+}
 
+static void ud_post(struct ud_ctx *u, uint32_t i, uint32_t len) {
+    while (u->posted >= UD_SEND_DEPTH) ud_reap(u);
+    struct ibv_sge sge = {.addr = (uintptr_t)ud_slot(u, i), .length = len, .lkey = u->c->mr->lkey};
+    struct ibv_send_wr wr = {.wr_id = i, .sg_list = &sge, .num_sge = 1,
+        .opcode = IBV_WR_SEND, .send_flags = IBV_SEND_SIGNALED};
+    wr.wr.ud.ah = u->ah;
+    wr.wr.ud.remote_qpn = u->rqpn;
+    wr.wr.ud.remote_qkey = u->rqkey;
+    struct ibv_send_wr *bad;
+    if (ibv_post_send(u->c->id->qp, &wr, &bad)) { perror("ibv_post_send"); exit(1); }
+    u->inflight[i]++;
+    u->posted++;
+}
+
+static void ud_post_recv(struct ud_ctx *u, int i) {
+    char *base = ud_slot(u, u->window + 1) + (size_t)i * u->recv_slot;
+    struct ibv_sge sge = {.addr = (uintptr_t)base, .length = (uint32_t)u->recv_slot, .lkey = u->c->mr->lkey};
+    struct ibv_recv_wr wr = {.wr_id = (uint64_t)i, .sg_list = &sge, .num_sge = 1};
+    struct ibv_recv_wr *bad;
+    if (ibv_post_recv(u->c->id->qp, &wr, &bad)) { perror("ibv_post_recv"); exit(1); }
+}
+
+// next datagram from the server, copied out of the ring; 0 when nothing has arrived
+static uint32_t ud_recv(struct ud_ctx *u, char *out, uint32_t cap) {
+    struct ibv_wc wc;
+    int n = ibv_poll_cq(u->c->recv_cq, 1, &wc);
+    if (n < 0) { fprintf(stderr, "ibv_poll_cq failed\n"); exit(1); }
+    if (n == 0) return 0;
+    uint32_t len = 0;
+    if (wc.status == IBV_WC_SUCCESS && wc.byte_len >= UD_GRH + sizeof(struct msg_hdr)) {
+        len = wc.byte_len - UD_GRH < cap ? wc.byte_len - UD_GRH : cap;
+        memcpy(out, ud_slot(u, u->window + 1) + wc.wr_id * u->recv_slot + UD_GRH, len);
+    }
+    ud_post_recv(u, (int)wc.wr_id);
+    return len;
+}
+
+static void ud_connect(struct client_ctx *c, struct ud_ctx *u, struct rdma_event_channel *ec, const struct rail *r) {
+    rdma_create_id(ec, &c->id, NULL, RDMA_PS_UDP);
+    rdma_resolve_addr(c->id, r->src ? r->src->ai_src_addr : NULL, r->dst->ai_dst_addr, 2000);
     struct rdma_cm_event *event;
     rdma_get_cm_event(ec, &event);
     rdma_ack_cm_event(event);
-
-    rdma_resolve_route(conn_id, 2000);
+    rdma_resolve_route(c->id, 2000);
     rdma_get_cm_event(ec, &event);
     rdma_ack_cm_event(event);
 
-    pd = ibv_alloc_pd(conn_id->verbs);
-    cq = ibv_create_cq(conn_id->verbs, 10, NULL, NULL, 0);
+    struct ibv_port_attr pa;
+    if (ibv_query_port(c->id->verbs, c->id->port_num, &pa)) { perror("ibv_query_port"); exit(1); }
+    uint32_t mtu = 128u << pa.active_mtu;
+    u->c = c;
+    u->dgram = mtu - (uint32_t)sizeof(struct msg_hdr);
+    u->slot = sizeof(struct msg_hdr) + u->dgram;
+    u->recv_slot = UD_GRH + mtu;
+    size_t size = (size_t)(u->window + 1) * u->slot + (size_t)UD_RECV * u->recv_slot;
+    c->buf = malloc(size);
+    u->seq = calloc(u->window, sizeof(*u->seq));
+    u->sent_at = calloc(u->window, sizeof(*u->sent_at));
+    u->acked = calloc(u->window, 1);
+    u->inflight = calloc(u->window + 1, sizeof(*u->inflight));
+    if (!c->buf || !u->seq || !u->sent_at || !u->acked || !u->inflight) { perror("alloc"); exit(1); }
 
+    c->pd = ibv_alloc_pd(c->id->verbs);
+    c->send_cq = ibv_create_cq(c->id->verbs, UD_SEND_DEPTH, NULL, NULL, 0);
+    c->recv_cq = ibv_create_cq(c->id->verbs, UD_RECV, NULL, NULL, 0);
     struct ibv_qp_init_attr qp_attr = {
-        .send_cq = cq, .recv_cq = cq, .qp_type = IBV_QPT_RC,
-        .cap = {.max_send_wr = 10, .max_recv_wr = 10,
-                .max_send_sge = 1, .max_recv_sge = 1}
+        .send_cq = c->send_cq, .recv_cq = c->recv_cq, .qp_type = IBV_QPT_UD,
+        .cap = {.max_send_wr = UD_SEND_DEPTH, .max_recv_wr = UD_RECV, .max_send_sge = 1, .max_recv_sge = 1}
     };
-    rdma_create_qp(conn_id, pd, &qp_attr);
-
-    mr = ibv_reg_mr(pd, buf, BUF_SIZE, IBV_ACCESS_LOCAL_WRITE);
+    if (rdma_create_qp(c->id, c->pd, &qp_attr)) { perror("rdma_create_qp"); exit(1); }
+    c->mr = ibv_reg_mr(c->pd, c->buf, size, IBV_ACCESS_LOCAL_WRITE);
+    if (!c->mr) { perror("ibv_reg_mr"); exit(1); }
+    for (int i = 0; i < UD_RECV; i++) ud_post_recv(u, i);
 
-    rdma_connect(conn_id, NULL);
+    // the server's answer names the UD QP this client is assigned to
+    rdma_connect(c->id, NULL);
     rdma_get_cm_event(ec, &event);
+    if (event->event != RDMA_CM_EVENT_ESTABLISHED) {
+        fprintf(stderr, "UD resolution failed: %s\n", rdma_event_str(event->event));
+        exit(1);
+    }
+    u->ah = ibv_create_ah(c->pd, &event->param.ud.ah_attr);
+    u->rqpn = event->param.ud.qp_num;
+    u->rqkey = event->param.ud.qkey;
     rdma_ack_cm_event(event);
+    if (!u->ah) { perror("ibv_create_ah"); exit(1); }
+}
 
-    printf("[Client] Connected to server. Sending file...\n");
+static void ud_disconnect(struct client_ctx *c, struct ud_ctx *u) {
+    while (u->posted > 0) ud_reap(u);
+    ibv_destroy_ah(u->ah);
+    rdma_destroy_qp(c->id);
+    ibv_dereg_mr(c->mr);
+    ibv_destroy_cq(c->send_cq);
+    ibv_destroy_cq(c->recv_cq);
+    ibv_dealloc_pd(c->pd);
+    free(c->buf);
+    rdma_destroy_id(c->id);
+    free(u->seq);
+    free(u->sent_at);
+    free(u->acked);
+    free(u->inflight);
+}
+
+// send a control message on its own slot until the server answers with the wanted type
+static void ud_exchange(struct ud_ctx *u, uint8_t type, uint64_t offset, const void *payload, uint32_t len,
+                        uint8_t want, char *reply, uint32_t cap) {
+    char *slot = ud_slot(u, u->window);
+    for (int tries = 0; ; tries++) {
+        if (tries == 100) { fprintf(stderr, "UD server not answering (type %u)\n", type); exit(1); }
+        while (u->inflight[u->window]) ud_reap(u);
+        msg_hdr_set((struct msg_hdr *)slot, type, 0, len, offset);
+        memcpy(slot + sizeof(struct msg_hdr), payload, len);
+        ud_post(u, u->window, (uint32_t)sizeof(struct msg_hdr) + len);
+        double deadline = now_sec() + u->rto;
+        while (now_sec() < deadline) {
+            ud_reap(u);
+            if (ud_recv(u, reply, cap) && ((struct msg_hdr *)reply)->type == want) return;
+        }
+        u->timeouts++;
+    }
+}
 
-    // open file in binary mode and get size
-    FILE *f = fopen(argv[2], "rb");
-    if (!f) { perror("fopen"); exit(1); }
+static void ud_resend(struct ud_ctx *u, uint64_t seq, uint64_t file_size, double now) {
+    uint32_t i = (uint32_t)(seq % u->window);
+    uint64_t off = seq * u->dgram;
+    uint32_t len = off + u->dgram <= file_size ? u->dgram : (uint32_t)(file_size - off);
+    ud_post(u, i, (uint32_t)sizeof(struct msg_hdr) + len);
+    u->sent_at[i] = now;
+    u->retransmits++;
+}
+
+static int send_ud(struct client_ctx *c, struct rdma_event_channel *ec, const struct rail *r, const char *src,
+                   const char *tenant, uint32_t window, double rto) {
+    struct datagen gen;
+    uint64_t file_size;
+    if (strncmp(src, "gen:", 4) == 0) {
+        if (datagen_parse_spec(src + 4, &gen, &file_size) != 0) { fprintf(stderr, "bad generator spec %s\n", src); exit(1); }
+        c->gen = &gen;
+    } else {
+        struct stat st;
+        if (!(c->f = fopen(src, "rb")) || fstat(fileno(c->f), &st) != 0) { perror("fopen"); exit(1); }
+        file_size = (uint64_t)st.st_size;
+    }
+    c->size = file_size;
+
+    struct ud_ctx u = {.window = window, .rto = rto};
+    ud_connect(c, &u, ec, r);
+    printf("[Client] UD path to QP %u: %u-byte datagrams, window %u, RTO %.1f ms. Sending file...\n",
+           u.rqpn, u.dgram, window, rto * 1e3);
+    uint64_t nseq = (file_size + u.dgram - 1) / u.dgram;
+
+    double t0 = now_sec();
+    struct usage data0;
+    usage_now(RUSAGE_SELF, &data0);
+    char reply[sizeof(struct msg_hdr) + sizeof(struct result_wire)];
+    struct ud_hello_wire hello = {.fh = {.qps = 1}, .dgram = htonl(u.dgram),
+                                  .nonce = ((uint64_t)getpid() << 32) ^ (uint64_t)(t0 * 1e9)};
+    memcpy(hello.fh.tenant, tenant, strnlen(tenant, sizeof(hello.fh.tenant)));
+    ud_exchange(&u, MSG_FILE_HDR, file_size, &hello, sizeof(hello), MSG_ACK, reply, sizeof(reply));
+
+    blake3_hasher_init(&c->hasher);
+    uint64_t base = 0, next = 0;
+    double progress = now_sec();
+    int stalls = 0;
+    while (base < nseq) {
+        double now = now_sec();
+        // fill the window with new datagrams; first sends go out in file order, so they feed the digest
+        while (next < nseq && next < base + window) {
+            uint32_t i = (uint32_t)(next % window);
+            while (u.inflight[i]) ud_reap(&u);
+            char *slot = ud_slot(&u, i);
+            uint64_t off = next * u.dgram;
+            size_t n = src_pread(c, slot + sizeof(struct msg_hdr), u.dgram, off);
+            blake3_hasher_update(&c->hasher, slot + sizeof(struct msg_hdr), n);
+            msg_hdr_set((struct msg_hdr *)slot, MSG_DATA, 0, (uint32_t)n, off);
+            ud_post(&u, i, (uint32_t)(sizeof(struct msg_hdr) + n));
+            u.seq[i] = next;
+            u.sent_at[i] = now;
+            u.acked[i] = 0;
+            u.datagrams++;
+            next++;
+        }
+        ud_reap(&u);
+
+        uint32_t got = ud_recv(&u, reply, sizeof(reply));
+        const struct msg_hdr *h = (const struct msg_hdr *)reply;
+        if (got >= sizeof(*h) + sizeof(struct ud_ack_wire) && h->type == MSG_ACK) {
+            struct ud_ack_wire a;
+            memcpy(&a, h + 1, sizeof(a));
+            uint64_t cum = ntohll(a.cum);
+            if (cum > next) cum = next;
+            if (cum > base) { base = cum; progress = now; stalls = 0; }
+            // holes below the highest datagram the server holds were lost or are very late
+            uint64_t high = 0;
+            for (uint64_t k = 0; k < UD_SACK_BITS && cum + k < next; k++)
+                if (a.sack[k / 8] & (1u << (k % 8))) { u.acked[(cum + k) % window] = 1; high = cum + k; }
+            for (uint64_t seq = base; seq < high; seq++) {
+                uint32_t i = (uint32_t)(seq % window);
+                if (!u.acked[i] && now - u.sent_at[i] > rto / 4) {
+                    ud_resend(&u, seq, file_size, now);
+                    u.nack_retransmits++;
+                }
+            }
+        }
+        if (now - progress > rto) {
+            if (++stalls > UD_MAX_STALLS) {
+                fprintf(stderr, "UD server stopped acknowledging at datagram %" PRIu64 "/%" PRIu64 "\n", base, nseq);
+                exit(1);
+            }
+            // nothing acknowledged for a whole RTO: the tail of the window or the ACKs were lost
+            for (uint64_t seq = base; seq < next; seq++)
+                if (!u.acked[seq % window]) ud_resend(&u, seq, file_size, now);
+            u.timeouts++;
+            progress = now;
+        }
+    }
+    double data_s = now_sec() - t0;
+
+    ud_exchange(&u, MSG_DONE, file_size, NULL, 0, MSG_RESULT, reply, sizeof(reply));
+    struct result_wire rw;
+    memcpy(&rw, reply + sizeof(struct msg_hdr), sizeof(rw));
+    double elapsed = now_sec() - t0;
+    if (c->f) fclose(c->f);
+
+    uint8_t digest[BLAKE3_OUT_LEN];
+    char hex[2 * BLAKE3_OUT_LEN + 1], server_hex[2 * BLAKE3_OUT_LEN + 1];
+    blake3_hasher_finalize(&c->hasher, digest);
+    blake3_hex(digest, hex);
+    blake3_hex(rw.digest, server_hex);
+    int digest_match = memcmp(digest, rw.digest, BLAKE3_OUT_LEN) == 0;
+    printf("[Client] File sent successfully (%" PRIu64 " bytes in %" PRIu64 " datagrams).\n", file_size, nseq);
+    printf("[Client] BLAKE3 %s (server %s)\n", hex, digest_match ? "matches" : "MISMATCH");
+    printf("[Client] UD: %" PRIu64 " retransmits (%" PRIu64 " on SACK holes), %" PRIu64 " timeouts\n",
+           u.retransmits, u.nack_retransmits, u.timeouts);
+    char rusage[1024];
+    usage_report(&data0, NULL, rusage, sizeof(rusage));
+    printf("RESULT {\"file_size\": %" PRIu64 ", \"elapsed_s\": %.6f, \"data_s\": %.6f, \"transport\": \"ud\", "
+           "\"dgram_bytes\": %u, \"window\": %u, \"rto_s\": %.6f, \"datagrams\": %" PRIu64 ", "
+           "\"retransmits\": %" PRIu64 ", \"nack_retransmits\": %" PRIu64 ", \"timeouts\": %" PRIu64 ", "
+           "\"bytes_sent\": %" PRIu64 ", \"bytes_written\": %" PRIu64 ", \"tenant\": \"%s\", \"rusage\": %s, "
+           "\"digest_alg\": \"blake3\", \"digest\": \"%s\", \"server_digest\": \"%s\", \"digest_match\": %s}\n",
+           file_size, elapsed, data_s, u.dgram, window, rto, u.datagrams, u.retransmits, u.nack_retransmits,
+           u.timeouts, ntohll(rw.bytes_received), ntohll(rw.bytes_written), tenant, rusage,
+           hex, server_hex, digest_match ? "true" : "false");
+    fflush(stdout);
+    ud_disconnect(c, &u);
+    return digest_match ? 0 : 2;
+}
+
+// ---------- zero-RTT tiny files ----------
+
+// a source small enough to ride in the connect request
+static int tiny_load(const char *src, struct tiny_req_wire *req) {
+    memset(req, 0, sizeof(*req));
+    req->magic = htonl(TINY_MAGIC);
+    if (strncmp(src, "gen:", 4) == 0) {
+        struct datagen gen;
+        uint64_t size;
+        if (datagen_parse_spec(src + 4, &gen, &size) != 0 || size > TINY_MAX) return 0;
+        datagen_fill(&gen, 0, req->data, (size_t)size);
+        req->len = (uint8_t)size;
+        return 1;
+    }
     struct stat st;
-    if (stat(argv[2], &st) != 0) { perror("stat"); exit(1); }
-    uint64_t file_size = (uint64_t)st.st_size;
-    uint64_t net_size = htonll(file_size);
+    if (stat(src, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > TINY_MAX) return 0;
+    FILE *f = fopen(src, "rb");
+    if (!f) return 0;
+    size_t n = fread(req->data, 1, (size_t)st.st_size, f);
+    fclose(f);
+    if (n != (size_t)st.st_size) return 0;
+    req->len = (uint8_t)n;
+    return 1;
+}
+
+// the server answered the connect request with its tiny_reply_wire
+static int tiny_report(struct client_ctx *c, const struct tiny_req_wire *req, double t0) {
+    double elapsed = now_sec() - t0;
+    struct tiny_reply_wire rep;
+    memcpy(&rep, c->reply, sizeof(rep));
+    if (ntohl(rep.magic) != TINY_MAGIC) { fprintf(stderr, "[Client] Server rejected the connection\n"); return 1; }
+    if (rep.status != TINY_OK) {
+        fprintf(stderr, "[Client] Server refused the zero-RTT transfer (status %u)\n", rep.status);
+        return 1;
+    }
+    uint8_t digest[BLAKE3_OUT_LEN];
+    char hex[2 * BLAKE3_OUT_LEN + 1], server_hex[2 * BLAKE3_OUT_LEN + 1];
+    blake3(req->data, req->len, digest);
+    blake3_hex(digest, hex);
+    blake3_hex(rep.digest, server_hex);
+    int digest_match = memcmp(digest, rep.digest, BLAKE3_OUT_LEN) == 0;
+    printf("[Client] File sent successfully (%u bytes, zero-RTT).\n", req->len);
+    printf("[Client] BLAKE3 %s (server %s)\n", hex, digest_match ? "matches" : "MISMATCH");
+    // the data rode in the connect request, so the data phase is the whole run
+    char rusage[1024];
+    usage_report(&run_usage0, NULL, rusage, sizeof(rusage));
+    printf("RESULT {\"file_size\": %u, \"elapsed_s\": %.6f, \"zero_rtt\": true, "
+           "\"bytes_sent\": %u, \"bytes_written\": %" PRIu64 ", \"rusage\": %s, "
+           "\"digest_alg\": \"blake3\", \"digest\": \"%s\", \"server_digest\": \"%s\", \"digest_match\": %s}\n",
+           req->len, elapsed, req->len, ntohll(rep.bytes_written), rusage, hex, server_hex,
+           digest_match ? "true" : "false");
+    fflush(stdout);
+    return digest_match ? 0 : 2;
+}
+
+// single file, optionally with dedup or sparse handling
+static int send_file(struct client_ctx *c, const char *src, uint8_t xfer_flags, int zero_detect, int fill,
+                     const char *tenant) {
+    // open file in binary mode and get size, or set up a synthetic source
+    struct datagen gen;
+    uint64_t file_size;
+    if (strncmp(src, "gen:", 4) == 0) {
+        if (datagen_parse_spec(src + 4, &gen, &file_size) != 0) {
+            fprintf(stderr, "bad generator spec %s\n", src);
+            exit(1);
+        }
+        c->gen = &gen;
+    } else {
+        c->f = fopen(src, "rb");
+        if (!c->f) { perror("fopen"); exit(1); }
+        struct stat st;
+        if (stat(src, &st) != 0) { perror("stat"); exit(1); }
+        file_size = (uint64_t)st.st_size;
+    }
+    c->size = file_size;
+
+    double t0 = now_sec();
+    struct usage data0;
+    usage_now(RUSAGE_SELF, &data0);
+    blake3_hasher_init(&c->hasher);
 
-    struct ibv_sge sge;
-    struct ibv_send_wr wr = {.wr_id=1, .sg_list=&sge, .num_sge=1,
-        .opcode=IBV_WR_SEND, .send_flags=IBV_SEND_SIGNALED};
+    // 1) file header
+    send_file_hdr(c, xfer_flags, file_size, tenant, 0, 1);
+
+    // 2) file contents
+    if (xfer_flags & XFER_F_DEDUP) send_dedup(c);
+    else if (xfer_flags & XFER_F_SPARSE) send_sparse(c, zero_detect, fill);
+    else if (xfer_flags & XFER_F_RING) send_ring(c);
+    else send_plain(c);
+    if (c->f) fclose(c->f);
+
+    // 3) end marker; the server answers with its view of the transfer
+    send_msg(c, MSG_DONE, 0, file_size, NULL, 0);
+    uint32_t rlen;
+    const char *payload = wait_reply(c, MSG_RESULT, &rlen);
+    struct result_wire rw;
+    memcpy(&rw, payload, sizeof(rw));
+    double elapsed = now_sec() - t0;
+
+    uint8_t digest[BLAKE3_OUT_LEN];
+    char hex[2 * BLAKE3_OUT_LEN + 1], server_hex[2 * BLAKE3_OUT_LEN + 1];
+    blake3_hasher_finalize(&c->hasher, digest);
+    blake3_hex(digest, hex);
+    blake3_hex(rw.digest, server_hex);
+    int digest_match = memcmp(digest, rw.digest, BLAKE3_OUT_LEN) == 0;
+
+    printf("[Client] File sent successfully (%" PRIu64 " bytes).\n", file_size);
+    printf("[Client] BLAKE3 %s (server %s)\n", hex, digest_match ? "matches" : "MISMATCH");
+    uint64_t bytes_dup = ntohll(rw.bytes_dup);
+    uint64_t chunks_total = ntohll(rw.chunks_total);
+    uint64_t chunks_dup = ntohll(rw.chunks_dup);
+    if (xfer_flags & XFER_F_DEDUP)
+        printf("[Client] Dedup: %" PRIu64 "/%" PRIu64 " chunks already on server, %" PRIu64 " bytes saved.\n",
+               chunks_dup, chunks_total, bytes_dup);
+
+    if (xfer_flags & XFER_F_SPARSE)
+        printf("[Client] Sparse: %" PRIu64 " bytes sent as holes (%" PRIu64 " zero chunks detected).\n",
+               c->hole_bytes, c->zero_chunks);
+    if (xfer_flags & XFER_F_FILL)
+        printf("[Client] Fill: %" PRIu64 " bytes elided in %" PRIu64 " run descriptors.\n", c->fill_bytes, c->fill_msgs);
+    if (xfer_flags & XFER_F_RING)
+        printf("[Client] Ring: %" PRIu64 " head reads, %.3f s with the ring full.\n", c->ring_reads, c->ring_full_wait);
+
+    char phases[256], rusage[1024];
+    print_phases(c);
+    phases_json(c, phases, sizeof(phases));
+    usage_report(&data0, NULL, rusage, sizeof(rusage));
+
+    // machine-readable summary for the GUI (one line, prefixed with RESULT)
+    printf("RESULT {\"file_size\": %" PRIu64 ", \"elapsed_s\": %.6f, \"dedup\": %s, "
+           "\"sparse\": %s, \"hole_bytes\": %" PRIu64 ", \"zero_chunks\": %" PRIu64 ", "
+           "\"fill_bytes\": %" PRIu64 ", \"fill_runs\": %" PRIu64 ", "
+           "\"bytes_sent\": %" PRIu64 ", \"bytes_written\": %" PRIu64 ", "
+           "\"chunks_total\": %" PRIu64 ", \"chunks_dup\": %" PRIu64 ", \"bytes_saved\": %" PRIu64 ", "
+           "\"chunks_reflinked\": %" PRIu64 ", \"dedup_ratio\": %.4f, "
+           "\"tenant\": \"%s\", \"queue_delay_s\": %.6f, \"credit_wait_s\": %.6f, "
+           "\"ring\": %s, \"ring_head_reads\": %" PRIu64 ", \"ring_full_wait_s\": %.6f, \"phases\": %s, "
+           "\"rusage\": %s, \"digest_alg\": \"blake3\", \"digest\": \"%s\", \"server_digest\": \"%s\", \"digest_match\": %s}\n",
+           file_size, elapsed, (xfer_flags & XFER_F_DEDUP) ? "true" : "false",
+           (xfer_flags & XFER_F_SPARSE) ? "true" : "false", c->hole_bytes, c->zero_chunks,
+           c->fill_bytes, c->fill_msgs,
+           ntohll(rw.bytes_received), ntohll(rw.bytes_written),
+           chunks_total, chunks_dup, bytes_dup, ntohll(rw.chunks_reflinked),
+           file_size ? (double)bytes_dup / (double)file_size : 0.0,
+           tenant, ntohll(rw.queue_delay_us) / 1e6, c->credit_wait,
+           (xfer_flags & XFER_F_RING) ? "true" : "false", c->ring_reads, c->ring_full_wait, phases, rusage,
+           hex, server_hex, digest_match ? "true" : "false");
+    fflush(stdout);
+    return digest_match ? 0 : 2;
+}
+
+// ---------- bench: raw verbs microbenchmarks ----------
+
+// perftest-style SEND / RDMA WRITE / RDMA READ bandwidth and latency on a
+// connection made by client_connect, so file-transfer numbers can be read as
+// a fraction of what the same QP setup achieves with no protocol on top.
+#define BENCH_MAX_DEPTH RING_BATCH      // the QP's send queue
+#define BENCH_MAX_LIST 24
+
+enum bench_op { BENCH_SEND, BENCH_WRITE, BENCH_READ, NUM_BENCH_OPS };
+static const char *const BENCH_OP_NAMES[NUM_BENCH_OPS] = {"send", "write", "read"};
+
+struct bench_ctx {
+    struct client_ctx *c;
+    char *buf;
+    struct ibv_mr *mr;
+    uint64_t raddr;
+    uint32_t rkey;
+};
+
+// every operation uses the same local buffer and remote address, as perftest does
+static void bench_post(struct bench_ctx *b, enum bench_op op, uint32_t size, int signaled) {
+    static const enum ibv_wr_opcode codes[NUM_BENCH_OPS] = {IBV_WR_SEND, IBV_WR_RDMA_WRITE, IBV_WR_RDMA_READ};
+    struct ibv_sge sge = {.addr = (uintptr_t)b->buf, .length = size, .lkey = b->mr->lkey};
+    struct ibv_send_wr wr = {.wr_id = op, .sg_list = &sge, .num_sge = 1, .opcode = codes[op],
+        .send_flags = signaled ? IBV_SEND_SIGNALED : 0};
+    wr.wr.rdma.remote_addr = b->raddr;
+    wr.wr.rdma.rkey = b->rkey;
     struct ibv_send_wr *bad;
+    if (ibv_post_send(b->c->id->qp, &wr, &bad)) { perror("ibv_post_send"); exit(1); }
+}
+
+static void bench_wait(struct bench_ctx *b, enum bench_op op) {
     struct ibv_wc wc;
+    if (poll_one(b->c->send_cq, &wc)) { fprintf(stderr, "bench %s failed\n", BENCH_OP_NAMES[op]); exit(1); }
+}
 
-    // 1) send 8-byte file size header
-    memcpy(buf, &net_size, sizeof(net_size));
-    sge.addr = (uintptr_t)buf;
-    sge.length = sizeof(net_size);
-    sge.lkey = mr->lkey;
-    if (ibv_post_send(conn_id->qp, &wr, &bad)) { perror("ibv_post_send header"); exit(1); }
-    while (ibv_poll_cq(cq, 1, &wc) == 0);
-    if (wc.status != IBV_WC_SUCCESS) { fprintf(stderr, "header send failed\n"); exit(1); }
+// exactly iters operations with up to depth in flight; seconds taken. Only the
+// last of every batch is signaled, so at most four completions wait in the send CQ.
+static double bench_bw(struct bench_ctx *b, enum bench_op op, uint32_t size, int depth, int iters) {
+    int batch = depth >= 4 ? depth / 4 : 1, inflight = 0, posted = 0, done = 0;
+    depth -= depth % batch;
+    double t = now_sec();
+    while (done < iters) {
+        while (inflight + batch <= depth && posted < iters) {
+            int n = iters - posted < batch ? iters - posted : batch;
+            for (int i = 0; i < n; i++) bench_post(b, op, size, i == n - 1);
+            posted += n;
+            inflight += n;
+        }
+        // completions come in order and only the newest batch can be short
+        int n = posted - done < batch ? posted - done : batch;
+        bench_wait(b, op);
+        inflight -= n;
+        done += n;
+    }
+    return now_sec() - t;
+}
 
-    // 2) send file contents in binary chunks
-    size_t r;
-    while ((r = fread(buf, 1, BUF_SIZE, f)) > 0) {
-        sge.addr = (uintptr_t)buf;
-        sge.length = r;               // use exact bytes read
-        sge.lkey = mr->lkey;
-        wr.opcode = IBV_WR_SEND;
-        if (ibv_post_send(conn_id->qp, &wr, &bad)) { perror("ibv_post_send data"); exit(1); }
-        while (ibv_poll_cq(cq, 1, &wc) == 0);
-        if (wc.status != IBV_WC_SUCCESS) { fprintf(stderr, "data send failed\n"); exit(1); }
+// post-to-completion time of one operation at a time, sorted into lat[iters]
+static void bench_lat(struct bench_ctx *b, enum bench_op op, uint32_t size, int iters, double *lat) {
+    for (int i = 0; i < iters; i++) {
+        double t = now_sec();
+        bench_post(b, op, size, 1);
+        bench_wait(b, op);
+        lat[i] = now_sec() - t;
     }
-    fclose(f);
+    qsort(lat, (size_t)iters, sizeof(double), cmp_double);
+}
+
+// "64,4K,1M" into out; returns the count or -1
+static int bench_list(const char *s, uint64_t *out, uint64_t max) {
+    int n = 0;
+    char *copy = strdup(s), *save = NULL;
+    for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        uint64_t v = datagen_parse_size(tok);
+        if (v == 0 || v > max || n == BENCH_MAX_LIST) { n = -1; break; }
+        out[n++] = v;
+    }
+    free(copy);
+    return n;
+}
+
+static int bench_main(const char *prog, int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s bench <server_ip> [--ops send,write,read] [--sizes 64,4K,64K,1M] "
+                        "[--depths 1,8,32] [--iters N] [--no-lat] [--no-bw]\n", prog);
+        return 1;
+    }
+    const char *ops_arg = "send,write,read";
+    uint64_t sizes[BENCH_MAX_LIST] = {64, 4096, 65536, 1 << 20}, depths[BENCH_MAX_LIST] = {1, 8, BENCH_MAX_DEPTH};
+    int nsizes = 4, ndepths = 3, iters = 1000, do_lat = 1, do_bw = 1;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) ops_arg = argv[++i];
+        else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) nsizes = bench_list(argv[++i], sizes, BENCH_MAX_REGION);
+        else if (strcmp(argv[i], "--depths") == 0 && i + 1 < argc) ndepths = bench_list(argv[++i], depths, BENCH_MAX_DEPTH);
+        else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) iters = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--no-lat") == 0) do_lat = 0;
+        else if (strcmp(argv[i], "--no-bw") == 0) do_bw = 0;
+        else fprintf(stderr, "[Client] Ignoring unknown option %s\n", argv[i]);
+    }
+    int ops[NUM_BENCH_OPS] = {0};
+    for (int o = 0; o < NUM_BENCH_OPS; o++) ops[o] = strstr(ops_arg, BENCH_OP_NAMES[o]) != NULL;
+    if (nsizes < 1 || ndepths < 1 || iters < 1) {
+        fprintf(stderr, "--sizes must be 1..%u bytes, --depths 1..%d, and --iters positive\n", BENCH_MAX_REGION, BENCH_MAX_DEPTH);
+        return 1;
+    }
+    uint64_t max_size = 0;
+    for (int i = 0; i < nsizes; i++) if (sizes[i] > max_size) max_size = sizes[i];
+
+    struct rail r = {.remote = argv[1]};
+    struct rdma_addrinfo hints = {.ai_port_space = RDMA_PS_TCP};
+    if (rdma_getaddrinfo(r.remote, PORT, &hints, &r.dst)) { perror(r.remote); return 1; }
+    struct rdma_event_channel *ec = rdma_create_event_channel();
+    struct client_ctx c = {0};
+    if (!ec || client_connect(&c, ec, &r, NULL, 0)) { fprintf(stderr, "[Client] Cannot connect to %s\n", r.remote); return 1; }
 
-    printf("[Client] File sent successfully (%PRIu64 bytes).\n", file_size);
+    struct bench_wire bw = {.len = htonl((uint32_t)max_size)};
+    char *payload = c.buf + SEND_OFF + sizeof(struct msg_hdr);
+    memcpy(payload, &bw, sizeof(bw));
+    send_msg(&c, MSG_BENCH, 0, 0, payload, sizeof(bw));
+    uint32_t len;
+    memcpy(&bw, wait_reply(&c, MSG_BENCH, &len), sizeof(bw));
+    struct bench_ctx b = {.c = &c, .raddr = ntohll(bw.addr), .rkey = ntohl(bw.rkey)};
+    if (ntohl(bw.len) < max_size) { fprintf(stderr, "server region of %u bytes is too small\n", ntohl(bw.len)); return 1; }
+    // zeroed, so every SEND starts with byte 0 and the server sinks it
+    if (posix_memalign((void **)&b.buf, 4096, max_size) != 0) { perror("posix_memalign"); return 1; }
+    memset(b.buf, 0, max_size);
+    if (!(b.mr = ibv_reg_mr(c.pd, b.buf, max_size, IBV_ACCESS_LOCAL_WRITE))) { perror("ibv_reg_mr"); return 1; }
+    printf("[Client] Bench against %s: %d sizes, %d depths, %d iterations each\n", r.remote, nsizes, ndepths, iters);
 
-    rdma_disconnect(conn_id);
-    rdma_destroy_qp(conn_id);
-    ibv_dereg_mr(mr);
-    free(buf);
-    rdma_destroy_id(conn_id);
+    size_t cap = (size_t)NUM_BENCH_OPS * nsizes * (ndepths + 1) * 160 + 1, used = 0, lused = 0;
+    char *bws = calloc(1, cap), *lats = calloc(1, cap);
+    double *lat = calloc((size_t)iters, sizeof(double));
+    double ceiling[NUM_BENCH_OPS] = {0};
+    if (!bws || !lats || !lat) { perror("calloc"); return 1; }
+    for (int o = 0; o < NUM_BENCH_OPS; o++) {
+        if (!ops[o]) continue;
+        for (int s = 0; s < nsizes; s++) {
+            uint32_t size = (uint32_t)sizes[s];
+            // SENDs land in the server's receive slots
+            if (o == BENCH_SEND && size > MSG_BUF_SIZE) {
+                printf("[Client] Bench send %u bytes: skipped, the server receives at most %zu bytes per SEND\n",
+                       size, MSG_BUF_SIZE);
+                continue;
+            }
+            for (int d = 0; do_bw && d < ndepths; d++) {
+                // more SENDs in flight than the server has receives posted only measures RNR retries
+                int depth = o == BENCH_SEND && depths[d] > RECV_DEPTH ? RECV_DEPTH : (int)depths[d];
+                double secs = bench_bw(&b, o, size, depth, iters);
+                double gbps = (double)size * iters * 8 / secs / 1e9, mops = iters / secs / 1e6;
+                if (gbps > ceiling[o]) ceiling[o] = gbps;
+                printf("[Client] Bench %-5s bw  %8u bytes, depth %2d: %8.2f Gbit/s, %6.3f Mops/s\n",
+                       BENCH_OP_NAMES[o], size, depth, gbps, mops);
+                used += (size_t)snprintf(bws + used, cap - used, "%s{\"op\": \"%s\", \"size\": %u, \"depth\": %d, "
+                                         "\"gbps\": %.3f, \"mops\": %.4f}", used ? ", " : "", BENCH_OP_NAMES[o], size,
+                                         depth, gbps, mops);
+            }
+            if (!do_lat) continue;
+            bench_lat(&b, o, size, iters, lat);
+            double sum = 0;
+            for (int i = 0; i < iters; i++) sum += lat[i];
+            double p50 = lat[(size_t)(0.50 * (iters - 1))], p99 = lat[(size_t)(0.99 * (iters - 1))];
+            printf("[Client] Bench %-5s lat %8u bytes: avg %.2f us, p50 %.2f us, p99 %.2f us, max %.2f us\n",
+                   BENCH_OP_NAMES[o], size, sum / iters * 1e6, p50 * 1e6, p99 * 1e6, lat[iters - 1] * 1e6);
+            lused += (size_t)snprintf(lats + lused, cap - lused, "%s{\"op\": \"%s\", \"size\": %u, \"avg_us\": %.3f, "
+                                      "\"p50_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f}", lused ? ", " : "",
+                                      BENCH_OP_NAMES[o], size, sum / iters * 1e6, p50 * 1e6, p99 * 1e6,
+                                      lat[iters - 1] * 1e6);
+        }
+    }
+    printf("[Client] Bench ceiling: send %.2f Gbit/s, write %.2f Gbit/s, read %.2f Gbit/s\n",
+           ceiling[BENCH_SEND], ceiling[BENCH_WRITE], ceiling[BENCH_READ]);
+    printf("RESULT {\"bench\": true, \"iters\": %d, \"ceiling_gbps\": {\"send\": %.3f, \"write\": %.3f, \"read\": %.3f}, "
+           "\"bw\": [%s], \"lat\": [%s]}\n", iters, ceiling[BENCH_SEND], ceiling[BENCH_WRITE], ceiling[BENCH_READ], bws, lats);
+
+    free(bws);
+    free(lats);
+    free(lat);
+    ibv_dereg_mr(b.mr);
+    free(b.buf);
+    client_disconnect(&c);
+    rdma_freeaddrinfo(r.dst);
     rdma_destroy_event_channel(ec);
     return 0;
-}
\ No newline at end of file
+}
+
+int main(int argc, char **argv) {
+    usage_now(RUSAGE_SELF, &run_usage0);
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) return bench_main(argv[0], argc - 1, argv + 1);
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s bench <server_ip> [options]\n"
+                        "       %s <server_ip> <file_to_send | gen:SIZE[:PROFILE[:COMPRESS[:DUP]]]> [more files...] "
+                        "[--dedup] [--sparse] [--ring] [--no-zero-rtt] [--serial-setup] [--zero-detect] [--fill] [--tenant NAME] "
+                        "[--jobs LIST] [--sched srpt|fifo] [--aging PER_S] [--quantum CHUNKS] [--qps N] [--rail LOCAL,REMOTE]... "
+                        "[--ud] [--ud-window N] [--ud-rto-us US]\n", argv[0], argv[0]);
+        return 1;
+    }
+    uint8_t xfer_flags = 0;
+    int zero_detect = 0, fill = 0;
+    const char *tenant = "default";
+    // more than one source switches to multi-job mode
+    static struct job jobs[MAX_JOBS];
+    const char *extra[MAX_JOBS];
+    const char *jobs_file = NULL;
+    int njobs = 0, nextra = 0, quantum = 8, nqps = 1;
+    enum sched_policy policy = JOBS_SRPT;
+    double aging = 1.0;
+    struct rail rails[MAX_QPS] = {{0}};
+    int nrails = 0;
+    int use_ud = 0, ud_window = 256, zero_rtt = 1;
+    double ud_rto = 2e-3;
+    for (int i = 3; i < argc; i++) {
+        if (argv[i][0] != '-' && nextra < MAX_JOBS - 1) extra[nextra++] = argv[i];
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) jobs_file = argv[++i];
+        else if (strcmp(argv[i], "--sched") == 0 && i + 1 < argc) {
+            const char *p = argv[++i];
+            if (strcmp(p, "fifo") == 0) policy = JOBS_FIFO;
+            else if (strcmp(p, "srpt") == 0) policy = JOBS_SRPT;
+            else { fprintf(stderr, "unknown scheduler %s\n", p); return 1; }
+        }
+        else if (strcmp(argv[i], "--qps") == 0 && i + 1 < argc) nqps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--rail") == 0 && i + 1 < argc && nrails < MAX_QPS) {
+            char *pair = strdup(argv[++i]), *comma = strchr(pair, ',');
+            if (!comma) { fprintf(stderr, "--rail wants LOCAL,REMOTE\n"); return 1; }
+            *comma = '\0';
+            rails[nrails++] = (struct rail){.local = pair, .remote = comma + 1};
+        }
+        else if (strcmp(argv[i], "--ud") == 0) use_ud = 1;
+        else if (strcmp(argv[i], "--ud-window") == 0 && i + 1 < argc) ud_window = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--ud-rto-us") == 0 && i + 1 < argc) ud_rto = atof(argv[++i]) / 1e6;
+        else if (strcmp(argv[i], "--aging") == 0 && i + 1 < argc) aging = atof(argv[++i]);
+        else if (strcmp(argv[i], "--quantum") == 0 && i + 1 < argc) quantum = atoi(argv[++i]) > 0 ? atoi(argv[i]) : 1;
+        else if (strcmp(argv[i], "--dedup") == 0) xfer_flags |= XFER_F_DEDUP;
+        else if (strcmp(argv[i], "--ring") == 0) xfer_flags |= XFER_F_RING;
+        else if (strcmp(argv[i], "--no-zero-rtt") == 0) zero_rtt = 0;
+        else if (strcmp(argv[i], "--serial-setup") == 0) overlap_setup = 0;
+        else if (strcmp(argv[i], "--sparse") == 0) xfer_flags |= XFER_F_SPARSE;
+        else if (strcmp(argv[i], "--zero-detect") == 0) { xfer_flags |= XFER_F_SPARSE; zero_detect = 1; }
+        else if (strcmp(argv[i], "--fill") == 0) { xfer_flags |= XFER_F_SPARSE | XFER_F_FILL; fill = 1; }
+        else if (strcmp(argv[i], "--tenant") == 0 && i + 1 < argc) tenant = argv[++i];
+        else fprintf(stderr, "[Client] Ignoring unknown option %s\n", argv[i]);
+    }
+    if ((xfer_flags & XFER_F_DEDUP) && (xfer_flags & XFER_F_SPARSE)) {
+        fprintf(stderr, "--dedup cannot be combined with --sparse/--zero-detect/--fill\n");
+        return 1;
+    }
+    if ((xfer_flags & XFER_F_RING) && (xfer_flags & ~XFER_F_RING)) {
+        fprintf(stderr, "--ring sends plain data only\n");
+        return 1;
+    }
+    // without --rail there is one rail: whatever device routes to server_ip
+    if (nrails == 0) rails[nrails++] = (struct rail){.remote = argv[1]};
+    if (nqps < 1 || nqps * nrails > MAX_QPS) {
+        fprintf(stderr, "--qps times the number of rails must be between 1 and %d\n", MAX_QPS);
+        return 1;
+    }
+    nqps *= nrails;
+    if (nqps > 1 && (xfer_flags || nextra > 0 || jobs_file)) {
+        fprintf(stderr, "--qps/--rail send a single file with plain data only\n");
+        return 1;
+    }
+    if (use_ud && (nqps > 1 || xfer_flags || nextra > 0 || jobs_file)) {
+        fprintf(stderr, "--ud sends a single file with plain data only\n");
+        return 1;
+    }
+    if (ud_window < 1 || ud_window > 65536 || ud_rto <= 0) {
+        fprintf(stderr, "--ud-window must be 1..65536 and --ud-rto-us positive\n");
+        return 1;
+    }
+    if (nextra > 0 || jobs_file) {
+        if (xfer_flags) { fprintf(stderr, "multi-job mode sends plain data only\n"); return 1; }
+        if (job_open(&jobs[njobs++], argv[2], 0, 0) != 0) { fprintf(stderr, "cannot open %s\n", argv[2]); return 1; }
+        for (int i = 0; i < nextra; i++)
+            if (job_open(&jobs[njobs++], extra[i], 0, 0) != 0) { fprintf(stderr, "cannot open %s\n", extra[i]); return 1; }
+        if (jobs_file && load_jobs(jobs_file, jobs, &njobs) != 0) return 1;
+    }
+
+    struct rdma_event_channel *ec = rdma_create_event_channel();
+    for (int r = 0; r < nrails; r++) {
+        struct rdma_addrinfo hints = {.ai_port_space = RDMA_PS_TCP};
+        if (rdma_getaddrinfo(rails[r].remote, PORT, &hints, &rails[r].dst)) { perror(rails[r].remote); return 1; }
+        struct rdma_addrinfo local_hints = {.ai_flags = RAI_PASSIVE, .ai_port_space = RDMA_PS_TCP};
+        if (rails[r].local && rdma_getaddrinfo(rails[r].local, NULL, &local_hints, &rails[r].src)) {
+            perror(rails[r].local);
+            return 1;
+        }
+    }
+
+    int rc;
+    if (use_ud) {
+        struct client_ctx uc = {0};
+        rc = send_ud(&uc, ec, &rails[0], argv[2], tenant, (uint32_t)ud_window, ud_rto);
+    } else {
+        // QP i runs on rail i % nrails
+        struct client_ctx *cs = calloc((size_t)nqps, sizeof(*cs));
+        if (!cs) { perror("calloc"); exit(1); }
+        // a tiny plain file is offered inside the connect request first
+        struct tiny_req_wire tiny;
+        int try_tiny = zero_rtt && nqps == 1 && njobs == 0 && !xfer_flags && tiny_load(argv[2], &tiny);
+        double t0 = now_sec();
+        int crc = try_tiny ? client_connect(&cs[0], ec, &rails[0], &tiny, sizeof(tiny)) : 0;
+        if (crc == 1) {
+            rc = tiny_report(&cs[0], &tiny, t0);
+        } else {
+            for (int i = try_tiny; i < nqps && crc == 0; i++)
+                crc = client_connect(&cs[i], ec, &rails[i % nrails], NULL, 0);
+            if (crc) {
+                fprintf(stderr, crc > 0 ? "[Client] Server rejected the connection\n"
+                                        : "[Client] Cannot connect to the server\n");
+                return 1;
+            }
+
+            printf("[Client] Connected to server. Sending file...\n");
+
+            rc = nqps > 1 ? send_multi_qp(cs, nqps, rails, nrails, argv[2], tenant)
+               : njobs > 0 ? run_jobs(&cs[0], jobs, njobs, tenant, policy, aging, quantum)
+               : send_file(&cs[0], argv[2], xfer_flags, zero_detect, fill, tenant);
+
+            for (int i = 0; i < nqps; i++) client_disconnect(&cs[i]);
+        }
+        free(cs);
+    }
+    for (int r = 0; r < nrails; r++) {
+        rdma_freeaddrinfo(rails[r].dst);
+        if (rails[r].src) rdma_freeaddrinfo(rails[r].src);
+    }
+    rdma_destroy_event_channel(ec);
+    return rc;
+}
@@ -1,112 +1,1919 @@
 // rdma_file_server.c (fixed)
+#define _GNU_SOURCE
 #include <rdma/rdma_cma.h>
 #include <infiniband/verbs.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <arpa/inet.h> // ntohll helper
+#include <errno.h>
+#include <signal.h>
 #include <inttypes.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include "rdma_common.h"
+#define BLAKE3_PARALLEL
+#include "blake3.h"
+#include "rusage.h"
 
-#define PORT "7471"
-#define BUF_SIZE 4096
+#define OUT_PATH "received_file.bin"
+#define STORE_DIR "chunk_store"
+#define MAX_TENANTS 32
 
-// helper for 64-bit ntoh
-static inline uint64_t ntohll(uint64_t x) {
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-    return (((uint64_t)ntohl(x & 0xFFFFFFFFULL)) << 32) | ntohl(x >> 32);
-#else
-    return x;
-#endif
-}
+// registered buffer layout per connection: [RECV_DEPTH recv slots][send slot]
+#define SEND_OFF ((size_t)RECV_DEPTH * MSG_BUF_SIZE)
+#define REG_SIZE (SEND_OFF + MSG_BUF_SIZE)
 
-int main() {
-    struct rdma_event_channel *ec = rdma_create_event_channel();
-    struct rdma_cm_id *listen_id = NULL, *conn_id = NULL;
-    struct rdma_addrinfo hints = {}, *res;
+// registered connection buffers prepared per device before clients arrive
+#define POOL_BUFS 16
+
+struct conn_buf {
+    char *buf;
+    struct ibv_mr *mr;
+    struct conn_buf *next;
+};
+
+// an RC QP with its CQs, kept in RESET between connections
+struct qp_slot {
+    struct ibv_qp *qp;
+    struct ibv_cq *send_cq, *recv_cq;
+    struct conn *conn;      // current owner; completion events for a recycled slot are dropped
+    int armed;              // recv CQ notification requested and not yet delivered
+    struct rdma_cm_id *id;  // parked: the old connection's id, destroyed with its TIMEWAIT_EXIT
+    double parked_at;
+    struct qp_slot *next;
+};
+
+struct dev_res {
+    struct ibv_context *verbs;
+    struct ibv_pd *pd;          // shared by every connection on the device
+    struct ibv_comp_channel *chan;  // receive completions of all its connections, watched by the reactor
+    struct conn_buf *free;
+    int bufs;
+    struct qp_slot *qps;
+    struct qp_slot *parked;     // still in the old connection's timewait, not yet reusable
+    int nqps;
+    int max_rd_atom;            // device limits for the responder resources / initiator depth we accept
+    int max_init_rd_atom;
+    struct dev_res *next;
+};
+
+// transfers up to small_threshold bytes get strict priority for credits
+enum xfer_class { CLASS_SMALL, CLASS_BULK, NUM_CLASSES };
+static const char *const CLASS_NAMES[NUM_CLASSES] = {"small", "bulk"};
+
+// one file being received
+struct xfer {
+    enum xfer_class cls;
+    double start;
+    // a multi-QP client sends one file over several connections that join by session id
+    uint64_t session;
+    int expect, done;   // member streams announced / closed with MSG_DONE
+    struct xfer *next;  // srv.sessions
+    int fd;
+    FILE *recipe;
+    char path[64];
+    uint8_t flags;
+    uint64_t file_size;
+    // dedup: hashes of the current batch and which of them we asked for
+    uint64_t batch_base;
+    uint8_t batch_hash[DEDUP_BATCH][DEDUP_HASH_LEN];
+    uint8_t batch_need[DEDUP_BATCH / 8];
+    struct result_wire stats;   // host byte order until sent
+    // whole-file digest, streamed while data arrives in file order
+    blake3_hasher hasher;
+    uint64_t hash_off;
+};
+
+// a connection's handle on a transfer; one connection can carry several, told apart by msg_hdr.stream
+struct stream {
+    uint16_t id;
+    struct xfer *x;
+    double wait_base;   // the connection's queueing delay when it joined the transfer
+    uint64_t granted;   // --srpt: bytes worth of the connection's credits counted against this stream
+    struct stream *next;
+};
+
+// RDMA WRITE target of an XFER_F_RING stream; the server only polls its memory
+struct data_ring {
+    char *mem;          // [struct ring_ctrl][RING_SLOTS * RING_SLOT_SIZE]
+    struct ibv_mr *mr;
+    uint64_t head;
+    struct stream *st;
+    int done;           // MSG_DONE arrived; close the stream once the ring is drained
+    uint64_t polls, records;
+};
+
+// bench: the region the client WRITEs and READs, and the raw SENDs it has sunk
+struct bench_region {
+    char *mem;
+    struct ibv_mr *mr;
+    uint32_t len;
+    uint64_t sends, bytes;
+};
+
+// ---------- bandwidth policy ----------
+
+// token bucket in bytes; rate 0 means unlimited
+struct bucket {
+    double rate, burst, tokens, last;
+};
+
+struct tenant {
+    char name[TENANT_NAME_LEN];
+    double weight;
+    struct bucket tb;
+    double vtime;       // weighted bytes granted; lowest goes first among bulk transfers
+    int active;         // connections currently transferring
+};
+
+struct class_stats {
+    uint64_t transfers, bytes;
+    double busy_s;      // summed transfer durations
+    uint64_t waits;
+    double wait_s;      // time clients sat with zero credits while the server had free slots
+};
+
+// idle connections have no open transfer; they are kept at one credit so they can start the next one
+enum conn_state { CONN_IDLE, CONN_ACTIVE };
+
+struct conn {
+    struct rdma_cm_id *id;
+    struct dev_res *dev;
+    struct conn_buf *cb;
+    struct qp_slot *qs;
     struct ibv_pd *pd;
-    struct ibv_cq *cq;
+    struct ibv_qp *qp;
+    struct ibv_cq *send_cq, *recv_cq;
     struct ibv_mr *mr;
-    char *buf = malloc(BUF_SIZE);
-    if (!buf) { perror("malloc"); exit(1); }
+    char *buf;
+    int num;
+    enum conn_state state;
+    struct stream *streams;
+    struct data_ring *ring;
+    struct bench_region *bench;
+    int failed;         // broke the protocol; disconnected after this reactor pass
+    uint64_t active_bytes;  // total size of the open transfers; decides the connection's class
+    struct tenant *tenant;
+    enum xfer_class cls;
+    struct bucket tb;
+    int outstanding;    // credits the client holds
+    int pending;        // credits picked this scheduling round, sent as one MSG_CREDIT
+    double granted;     // bytes worth of credits granted so far
+    int srpt_ok;        // --srpt: may get scheduled credits this round
+    double wait_since;  // set while the client holds no credits; 0 otherwise
+    double wait_total;
+    uint64_t waits;
+    double start;
+    struct conn *next;
+};
 
-    hints.ai_flags = RAI_PASSIVE;
-    hints.ai_port_space = RDMA_PS_TCP;
-    rdma_getaddrinfo(NULL, PORT, &hints, &res);
+static struct {
+    int multi;
+    int ud;                     // UD QPs (one thread each); 0 = RC
+    double conn_rate;           // bytes/s per connection, 0 = unlimited
+    int pool;                   // receive credits shared by all connections
+    uint64_t small_threshold;
+    int srpt;                   // grant to the fewest remaining bytes first instead of by class and tenant
+    uint64_t unsched;           // --srpt: bytes every transfer gets before it is scheduled
+    int overcommit;             // --srpt: scheduled connections that may hold credits at once
+    uint64_t grants_unsched, grants_sched;
+    struct tenant tenants[MAX_TENANTS];
+    int num_tenants;
+    double vclock;              // vtime of the last tenant served
+    struct conn *conns;
+    struct dev_res *devs;
+    int qp_pool;                // QPs created per device at startup
+    uint64_t accepts, pool_misses;
+    double accept_s, accept_max;
+    struct xfer *sessions;      // transfers open to further connections
+    int next_num;
+    struct class_stats cls[NUM_CLASSES];
+} srv = {.pool = 4 * RECV_DEPTH, .small_threshold = 1 << 20, .qp_pool = 64, .unsched = 64 << 10, .overcommit = 2};
 
-    rdma_create_id(ec, &listen_id, NULL, RDMA_PS_TCP);
-    rdma_bind_addr(listen_id, res->ai_src_addr);
-    rdma_listen(listen_id, 1);
-    printf("[Server] Listening on port %s...\n", PORT);
+static volatile sig_atomic_t stop;
 
-    struct rdma_cm_event *event;
-    rdma_get_cm_event(ec, &event);
-    conn_id = event->id;
-    rdma_ack_cm_event(event);
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// a thread's usage has no peak RSS of its own (see rusage.h)
+static void print_usage(const char *what, const struct usage *u) {
+    printf("[Server] %s: user %.3f s, sys %.3f s, %ld voluntary / %ld involuntary context switches, "
+           "%ld minor / %ld major faults", what, u->user_s, u->sys_s, u->vcsw, u->ivcsw, u->minflt, u->majflt);
+    if (u->max_rss_kb >= 0) printf(", peak RSS %ld KiB", u->max_rss_kb);
+    printf("\n");
+}
+
+static void bucket_init(struct bucket *b, double rate) {
+    b->rate = rate;
+    b->burst = rate * 0.02 + 8.0 * BUF_SIZE;
+    b->tokens = b->burst;
+    b->last = now_sec();
+}
+
+static void bucket_refill(struct bucket *b, double now) {
+    if (b->rate <= 0) return;
+    b->tokens += (now - b->last) * b->rate;
+    if (b->tokens > b->burst) b->tokens = b->burst;
+    b->last = now;
+}
+
+static int bucket_has(const struct bucket *b, double n) { return b->rate <= 0 || b->tokens >= n; }
+static void bucket_take(struct bucket *b, double n) { if (b->rate > 0) b->tokens -= n; }
+
+static struct tenant *tenant_get(const char *name) {
+    for (int i = 0; i < srv.num_tenants; i++)
+        if (strncmp(srv.tenants[i].name, name, TENANT_NAME_LEN) == 0) return &srv.tenants[i];
+    if (srv.num_tenants == MAX_TENANTS) return &srv.tenants[0];
+    struct tenant *t = &srv.tenants[srv.num_tenants++];
+    snprintf(t->name, sizeof(t->name), "%s", name);
+    t->weight = 1.0;
+    bucket_init(&t->tb, 0);
+    return t;
+}
+
+// ---------- reactor ----------
+
+// one epoll set per event loop: the CM channel, a completion channel per
+// device and the admin socket. The loop busy-polls while there is work and
+// only arms CQ notifications and sleeps in epoll_wait after spin_us of quiet.
+enum src_kind { SRC_CM, SRC_CQ, SRC_ADMIN };
+
+struct ev_source {
+    enum src_kind kind;
+    void *ptr;
+};
+
+static struct {
+    int epfd;
+    double spin;                // seconds of idle busy-polling before sleeping
+    uint64_t loops, sleeps, wakeups;
+    double busy_s;              // time in loop iterations that found work
+} rx = {.epfd = -1, .spin = 50e-6};
+
+static void set_nonblock(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) { perror("fcntl"); exit(1); }
+}
 
-    pd = ibv_alloc_pd(conn_id->verbs);
-    cq = ibv_create_cq(conn_id->verbs, 10, NULL, NULL, 0);
+static void reactor_add(int fd, enum src_kind kind, void *ptr) {
+    if (rx.epfd < 0) return;
+    struct ev_source *src = malloc(sizeof(*src));
+    if (!src) { perror("malloc"); exit(1); }
+    *src = (struct ev_source){.kind = kind, .ptr = ptr};
+    set_nonblock(fd);
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = src};
+    if (epoll_ctl(rx.epfd, EPOLL_CTL_ADD, fd, &ev) != 0) { perror("epoll_ctl"); exit(1); }
+}
+
+// ---------- device resources ----------
+
+static struct conn_buf *conn_buf_new(struct dev_res *d) {
+    struct conn_buf *b = calloc(1, sizeof(*b));
+    if (!b || !(b->buf = malloc(REG_SIZE))) { perror("malloc"); exit(1); }
+    b->mr = ibv_reg_mr(d->pd, b->buf, REG_SIZE, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE);
+    if (!b->mr) { perror("ibv_reg_mr"); exit(1); }
+    d->bufs++;
+    return b;
+}
 
+static struct qp_slot *qp_slot_new(struct dev_res *d) {
+    struct qp_slot *q = calloc(1, sizeof(*q));
+    if (!q) { perror("calloc"); exit(1); }
+    q->send_cq = ibv_create_cq(d->verbs, 10, NULL, NULL, 0);
+    q->recv_cq = ibv_create_cq(d->verbs, RECV_DEPTH, q, d->chan, 0);
+    if (!q->send_cq || !q->recv_cq) { perror("ibv_create_cq"); exit(1); }
     struct ibv_qp_init_attr qp_attr = {
-        .send_cq = cq, .recv_cq = cq, .qp_type = IBV_QPT_RC,
-        .cap = {.max_send_wr = 10, .max_recv_wr = 10,
+        .send_cq = q->send_cq, .recv_cq = q->recv_cq, .qp_type = IBV_QPT_RC,
+        .cap = {.max_send_wr = 10, .max_recv_wr = RECV_DEPTH,
                 .max_send_sge = 1, .max_recv_sge = 1}
     };
-    rdma_create_qp(conn_id, pd, &qp_attr);
+    if (!(q->qp = ibv_create_qp(d->pd, &qp_attr))) { perror("ibv_create_qp"); exit(1); }
+    d->nqps++;
+    return q;
+}
+
+// back to RESET: the send and receive queues are emptied, and whatever
+// completions are left in the CQs are thrown away
+static void qp_slot_recycle(struct dev_res *d, struct qp_slot *q) {
+    struct ibv_qp_attr a = {.qp_state = IBV_QPS_RESET};
+    struct ibv_wc wc[RECV_DEPTH];
+    if (ibv_modify_qp(q->qp, &a, IBV_QP_STATE)) {
+        perror("ibv_modify_qp RESET");
+        ibv_destroy_qp(q->qp);
+        ibv_destroy_cq(q->send_cq);
+        ibv_destroy_cq(q->recv_cq);
+        free(q);
+        d->nqps--;
+        return;
+    }
+    while (ibv_poll_cq(q->send_cq, RECV_DEPTH, wc) > 0);
+    while (ibv_poll_cq(q->recv_cq, RECV_DEPTH, wc) > 0);
+    q->conn = NULL;
+    q->next = d->qps;
+    d->qps = q;
+}
+
+// a QP number reused while the peer may still send to the old connection would
+// take its stray packets, so a slot waits in ERROR for rdma_cm's TIMEWAIT_EXIT.
+// iWARP never reports one; slots parked longer than TIMEWAIT_MAX_S go back anyway.
+#define TIMEWAIT_MAX_S 30.0
+
+static void qp_slot_park(struct dev_res *d, struct qp_slot *q, struct rdma_cm_id *id) {
+    struct ibv_qp_attr a = {.qp_state = IBV_QPS_ERR};
+    if (ibv_modify_qp(q->qp, &a, IBV_QP_STATE)) perror("ibv_modify_qp ERR");
+    q->conn = NULL;
+    q->id = id;
+    q->parked_at = now_sec();
+    id->context = NULL;
+    q->next = d->parked;
+    d->parked = q;
+}
 
-    mr = ibv_reg_mr(pd, buf, BUF_SIZE, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE);
+// id's timewait is over (or, with id NULL, every slot parked too long is given up on)
+static void qp_slot_unpark(struct rdma_cm_id *id) {
+    double now = now_sec();
+    for (struct dev_res *d = srv.devs; d; d = d->next) {
+        for (struct qp_slot **p = &d->parked, *q; (q = *p); ) {
+            if (id ? q->id != id : now - q->parked_at < TIMEWAIT_MAX_S) {
+                p = &q->next;
+                continue;
+            }
+            *p = q->next;
+            rdma_destroy_id(q->id);
+            q->id = NULL;
+            qp_slot_recycle(d, q);
+        }
+    }
+}
 
-    struct ibv_sge sge = {.addr=(uintptr_t)buf, .length=BUF_SIZE, .lkey=mr->lkey};
-    struct ibv_recv_wr wr = {.wr_id=1, .sg_list=&sge, .num_sge=1};
+static struct dev_res *dev_get(struct ibv_context *verbs) {
+    for (struct dev_res *d = srv.devs; d; d = d->next)
+        if (d->verbs == verbs) return d;
+    struct dev_res *d = calloc(1, sizeof(*d));
+    if (!d) { perror("calloc"); exit(1); }
+    d->verbs = verbs;
+    if (!(d->pd = ibv_alloc_pd(verbs))) { perror("ibv_alloc_pd"); exit(1); }
+    struct ibv_device_attr da;
+    if (ibv_query_device(verbs, &da)) { perror("ibv_query_device"); exit(1); }
+    if (!(d->chan = ibv_create_comp_channel(verbs))) { perror("ibv_create_comp_channel"); exit(1); }
+    reactor_add(d->chan->fd, SRC_CQ, d);
+    d->max_rd_atom = da.max_qp_rd_atom;
+    d->max_init_rd_atom = da.max_qp_init_rd_atom;
+    d->next = srv.devs;
+    srv.devs = d;
+    return d;
+}
+
+// PDs, a pool of registered buffers and a pool of QPs with their CQs on every
+// RDMA device, so accepting a client costs three QP state changes instead of
+// page pinning and queue allocation. The contexts are the ones rdma_cm hands
+// out in cm_id->verbs.
+static void devs_prepare(void) {
+    double t = now_sec();
+    int n = 0, bufs = 0, qps = 0;
+    struct ibv_context **list = rdma_get_devices(&n);
+    for (int i = 0; list && i < n; i++) {
+        struct dev_res *d = dev_get(list[i]);
+        while (d->bufs < POOL_BUFS) {
+            struct conn_buf *b = conn_buf_new(d);
+            b->next = d->free;
+            d->free = b;
+        }
+        while (d->nqps < srv.qp_pool) {
+            struct qp_slot *q = qp_slot_new(d);
+            q->next = d->qps;
+            d->qps = q;
+        }
+        bufs += d->bufs;
+        qps += d->nqps;
+    }
+    if (list) rdma_free_devices(list);
+    printf("[Server] Prepared %d device%s, %d registered buffers, %d QPs in %.1f ms\n", n, n == 1 ? "" : "s",
+           bufs, qps, (now_sec() - t) * 1e3);
+}
+
+static void devs_release(void) {
+    while (srv.devs) {
+        struct dev_res *d = srv.devs;
+        while (d->free) {
+            struct conn_buf *b = d->free;
+            d->free = b->next;
+            ibv_dereg_mr(b->mr);
+            free(b->buf);
+            free(b);
+        }
+        while (d->parked) {
+            struct qp_slot *q = d->parked;
+            d->parked = q->next;
+            rdma_destroy_id(q->id);
+            q->next = d->qps;
+            d->qps = q;
+        }
+        while (d->qps) {
+            struct qp_slot *q = d->qps;
+            d->qps = q->next;
+            ibv_destroy_qp(q->qp);
+            ibv_destroy_cq(q->send_cq);
+            ibv_destroy_cq(q->recv_cq);
+            free(q);
+        }
+        ibv_destroy_comp_channel(d->chan);
+        ibv_dealloc_pd(d->pd);
+        srv.devs = d->next;
+        free(d);
+    }
+}
+
+// ---------- connections ----------
+
+static void post_recv(struct conn *c, int slot) {
+    struct ibv_sge sge = {.addr = (uintptr_t)(c->buf + (size_t)slot * MSG_BUF_SIZE), .length = MSG_BUF_SIZE,
+                          .lkey = c->mr->lkey};
+    struct ibv_recv_wr wr = {.wr_id = (uint64_t)slot, .sg_list = &sge, .num_sge = 1};
     struct ibv_recv_wr *bad;
+    if (ibv_post_recv(c->qp, &wr, &bad)) { perror("ibv_post_recv"); exit(1); }
+}
+
+static void send_reply(struct conn *c, uint8_t type, uint16_t stream, const void *payload, uint32_t len) {
+    struct msg_hdr *h = (struct msg_hdr *)(c->buf + SEND_OFF);
+    msg_hdr_set(h, type, 0, len, 0);
+    h->stream = htons(stream);
+    memcpy(h + 1, payload, len);
+    struct ibv_sge sge = {.addr = (uintptr_t)h, .length = sizeof(*h) + len, .lkey = c->mr->lkey};
+    struct ibv_send_wr wr = {.wr_id = type, .sg_list = &sge, .num_sge = 1,
+        .opcode = IBV_WR_SEND, .send_flags = IBV_SEND_SIGNALED};
+    struct ibv_send_wr *bad;
+    struct ibv_wc wc;
+    if (ibv_post_send(c->qp, &wr, &bad)) { perror("ibv_post_send"); exit(1); }
+    if (poll_one(c->send_cq, &wc)) { fprintf(stderr, "reply send failed\n"); exit(1); }
+}
+
+static void qp_move(struct conn *c, enum ibv_qp_state state, int rd_atom, int init_rd_atom) {
+    struct ibv_qp_attr a = {.qp_state = state};
+    int mask;
+    if (rdma_init_qp_attr(c->id, &a, &mask)) { perror("rdma_init_qp_attr"); exit(1); }
+    if (state == IBV_QPS_RTR) a.max_dest_rd_atomic = (uint8_t)rd_atom;
+    if (state == IBV_QPS_RTS) a.max_rd_atomic = (uint8_t)init_rd_atom;
+    if (ibv_modify_qp(c->qp, &a, mask)) { perror("ibv_modify_qp"); exit(1); }
+}
+
+// rd_atom / init_rd_atom: the RDMA READ depths the client asked for in its connect request
+static void conn_create(struct rdma_cm_id *id, int rd_atom, int init_rd_atom) {
+    double t = now_sec();
+    struct conn *c = calloc(1, sizeof(*c));
+    if (!c) { perror("calloc"); exit(1); }
+    c->dev = dev_get(id->verbs);
+    if ((c->cb = c->dev->free)) c->dev->free = c->cb->next;
+    else c->cb = conn_buf_new(c->dev);
+    c->pd = c->dev->pd;
+    c->buf = c->cb->buf;
+    c->mr = c->cb->mr;
+    c->id = id;
+    c->num = srv.next_num++;
+    c->state = CONN_IDLE;
+    c->outstanding = 1;     // every client may send its first file header unasked
+    id->context = c;
+
+    // a pooled QP is not attached to the cm_id, so it is walked to RTS here the way rdma_accept would
+    if (!c->dev->qps && c->dev->parked) qp_slot_unpark(NULL);
+    if ((c->qs = c->dev->qps)) {
+        c->dev->qps = c->qs->next;
+    } else {
+        c->qs = qp_slot_new(c->dev);
+        srv.pool_misses++;
+    }
+    c->qp = c->qs->qp;
+    c->qs->conn = c;
+    c->send_cq = c->qs->send_cq;
+    c->recv_cq = c->qs->recv_cq;
+    if (rd_atom > c->dev->max_rd_atom) rd_atom = c->dev->max_rd_atom;
+    if (init_rd_atom > c->dev->max_init_rd_atom) init_rd_atom = c->dev->max_init_rd_atom;
+    qp_move(c, IBV_QPS_INIT, 0, 0);
+    for (int i = 0; i < RECV_DEPTH; i++) post_recv(c, i);
+    qp_move(c, IBV_QPS_RTR, rd_atom, 0);
+    qp_move(c, IBV_QPS_RTS, 0, init_rd_atom);
+
+    struct rdma_conn_param param = {.qp_num = c->qp->qp_num, .responder_resources = (uint8_t)rd_atom,
+                                    .initiator_depth = (uint8_t)init_rd_atom, .rnr_retry_count = 7};
+    if (rdma_accept(id, &param)) { perror("rdma_accept"); exit(1); }
+    c->next = srv.conns;
+    srv.conns = c;
+    double took = now_sec() - t;
+    srv.accepts++;
+    srv.accept_s += took;
+    if (took > srv.accept_max) srv.accept_max = took;
+    printf("[Server] Connection %d accepted in %.0f us. Waiting for file...\n", c->num, took * 1e6);
+}
+
+static void xfer_close(struct xfer *x) {
+    if (x->recipe) fclose(x->recipe);
+    if (x->fd >= 0) close(x->fd);
+    free(x);
+}
+
+static void drop_streams(struct conn *c);
+
+static void ring_close(struct conn *c) {
+    ibv_dereg_mr(c->ring->mr);
+    free(c->ring->mem);
+    free(c->ring);
+    c->ring = NULL;
+}
+
+static void bench_close(struct conn *c) {
+    struct bench_region *b = c->bench;
+    printf("[Server] Connection %d bench: %" PRIu64 " raw SENDs (%" PRIu64 " bytes) sunk, %u-byte region\n",
+           c->num, b->sends, b->bytes, b->len);
+    ibv_dereg_mr(b->mr);
+    free(b->mem);
+    free(b);
+    c->bench = NULL;
+}
+
+static void conn_destroy(struct conn *c) {
+    for (struct conn **p = &srv.conns; *p; p = &(*p)->next)
+        if (*p == c) { *p = c->next; break; }
+    if (c->ring) ring_close(c);
+    if (c->bench) bench_close(c);
+    drop_streams(c);
+    if (c->tenant && c->state == CONN_ACTIVE) c->tenant->active--;
+    // the registered buffer goes back to its device's pool for the next client, the QP once its timewait is over
+    qp_slot_park(c->dev, c->qs, c->id);
+    c->cb->next = c->dev->free;
+    c->dev->free = c->cb;
+    free(c);
+}
+
+// ---------- content-addressed chunk store ----------
+
+// STORE_DIR/ab/abcd... (first byte of the hash as fan-out directory)
+static void chunk_path(const uint8_t *hash, char *path, size_t n) {
+    char hex[2 * BLAKE3_OUT_LEN + 1];
+    blake3_hex(hash, hex);
+    snprintf(path, n, STORE_DIR "/%.2s/%s", hex, hex);
+}
+
+static void store_chunk(const uint8_t *hash, const char *data, size_t len) {
+    char path[256], tmp[300];
+    chunk_path(hash, path, sizeof(path));
+    mkdir(STORE_DIR, 0755);
+    char dir[64];
+    snprintf(dir, sizeof(dir), "%.*s", (int)(strlen(STORE_DIR) + 3), path);
+    mkdir(dir, 0755);
+    // write-then-rename so a crash never leaves a truncated chunk under its hash
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid());
+    int fd = open(tmp, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) { perror("open chunk"); return; }
+    if (write(fd, data, len) != (ssize_t)len) { perror("write chunk"); close(fd); unlink(tmp); return; }
+    close(fd);
+    if (rename(tmp, path) != 0) { perror("rename chunk"); unlink(tmp); }
+}
+
+// place a stored chunk at offset in the output: reflink when the filesystem can, copy otherwise
+static int materialize_chunk(struct xfer *x, const uint8_t *hash, uint64_t offset, size_t *len_out) {
+    char path[256];
+    chunk_path(hash, path, sizeof(path));
+    int cfd = open(path, O_RDONLY);
+    if (cfd < 0) return -1;
+    struct stat st;
+    if (fstat(cfd, &st) != 0 || st.st_size <= 0 || st.st_size > BUF_SIZE) { close(cfd); return -1; }
+    size_t len = (size_t)st.st_size;
+
+    struct file_clone_range fcr = {.src_fd = cfd, .src_offset = 0, .src_length = len, .dest_offset = offset};
+    if (ioctl(x->fd, FICLONERANGE, &fcr) == 0) {
+        x->stats.chunks_reflinked++;
+    } else {
+        char tmp[BUF_SIZE];
+        if (pread(cfd, tmp, len, 0) != (ssize_t)len || pwrite(x->fd, tmp, len, (off_t)offset) != (ssize_t)len) {
+            close(cfd);
+            return -1;
+        }
+    }
+    close(cfd);
+    *len_out = len;
+    return 0;
+}
+
+// feed bytes that land at offset into the streaming digest if they continue it
+static void digest_update(struct xfer *x, uint64_t offset, const void *data, size_t len) {
+    if (offset != x->hash_off) return;
+    blake3_hasher_update(&x->hasher, data, len);
+    x->hash_off += len;
+}
+
+static void digest_zeros(struct xfer *x, uint64_t offset, uint64_t len) {
+    static const uint8_t zeros[BUF_SIZE];
+    while (len > 0 && offset == x->hash_off) {
+        size_t n = len < BUF_SIZE ? (size_t)len : BUF_SIZE;
+        digest_update(x, offset, zeros, n);
+        offset += n;
+        len -= n;
+    }
+}
+
+// finish the digest; out-of-order writes fall back to a tree-parallel pass over the written file
+static void digest_final(struct xfer *x, uint8_t out[BLAKE3_OUT_LEN]) {
+    if (x->hash_off == x->file_size) { blake3_hasher_finalize(&x->hasher, out); return; }
+    if (x->file_size == 0) { blake3(NULL, 0, out); return; }
+    void *map = mmap(NULL, x->file_size, PROT_READ, MAP_SHARED, x->fd, 0);
+    if (map == MAP_FAILED) { perror("mmap"); memset(out, 0, BLAKE3_OUT_LEN); return; }
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    blake3_parallel(map, x->file_size, ncpu > 0 ? (int)ncpu : 1, out);
+    munmap(map, x->file_size);
+}
+
+static void handle_hashes(struct xfer *x, uint64_t base, const char *payload, uint32_t len) {
+    size_t n = len / DEDUP_HASH_LEN;
+    if (n > DEDUP_BATCH) n = DEDUP_BATCH;
+    x->batch_base = base;
+    memset(x->batch_need, 0, sizeof(x->batch_need));
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *hash = (const uint8_t *)payload + i * DEDUP_HASH_LEN;
+        uint64_t offset = base + i * BUF_SIZE;
+        size_t got;
+        memcpy(x->batch_hash[i], hash, DEDUP_HASH_LEN);
+        x->stats.chunks_total++;
+        if (materialize_chunk(x, hash, offset, &got) == 0) {
+            x->stats.chunks_dup++;
+            x->stats.bytes_dup += got;
+            x->stats.bytes_written += got;
+        } else {
+            x->batch_need[i / 8] |= (uint8_t)(1u << (i % 8));
+        }
+        if (x->recipe) {
+            char hex[2 * BLAKE3_OUT_LEN + 1];
+            blake3_hex(hash, hex);
+            fprintf(x->recipe, "%" PRIu64 " %s\n", offset, hex);
+        }
+    }
+}
+
+// the per-transfer handlers return -1 on a client protocol error, which costs the client its connection
+static int handle_data(struct xfer *x, uint64_t offset, const char *payload, uint32_t len) {
+    if (offset > x->file_size || len > x->file_size - offset) {
+        fprintf(stderr, "data beyond end of file at offset %" PRIu64 "\n", offset);
+        return -1;
+    }
+    if (pwrite(x->fd, payload, len, (off_t)offset) != (ssize_t)len) { perror("pwrite"); exit(1); }
+    digest_update(x, offset, payload, len);
+    x->stats.bytes_received += len;
+    x->stats.bytes_written += len;
+    if (!(x->flags & XFER_F_DEDUP)) return 0;
+
+    uint64_t idx = (offset - x->batch_base) / BUF_SIZE;
+    if (offset < x->batch_base || idx >= DEDUP_BATCH || !(x->batch_need[idx / 8] & (1u << (idx % 8)))) {
+        fprintf(stderr, "unrequested dedup chunk at offset %" PRIu64 "\n", offset);
+        return -1;
+    }
+    uint8_t hash[DEDUP_HASH_LEN];
+    blake3(payload, len, hash);
+    if (memcmp(hash, x->batch_hash[idx], DEDUP_HASH_LEN) != 0) {
+        fprintf(stderr, "chunk hash mismatch at offset %" PRIu64 "\n", offset);
+        return -1;
+    }
+    store_chunk(hash, payload, len);
+    return 0;
+}
+
+// a hole reads back as zeros; punch it in case the range already held data
+static int handle_hole(struct xfer *x, uint64_t offset, uint64_t len) {
+    if (offset > x->file_size || len > x->file_size - offset) { fprintf(stderr, "hole beyond end of file\n"); return -1; }
+    if (fallocate(x->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)len) != 0 &&
+        errno != EOPNOTSUPP)
+        perror("fallocate");
+    digest_zeros(x, offset, len);
+    x->stats.bytes_hole += len;
+    return 0;
+}
+
+// expand a constant-byte run; zero runs are left as holes
+static int handle_fill(struct xfer *x, uint64_t offset, uint64_t len, uint8_t byte) {
+    if (offset > x->file_size || len > x->file_size - offset) { fprintf(stderr, "fill beyond end of file\n"); return -1; }
+    if (byte == 0) return handle_hole(x, offset, len);
+    char pat[BUF_SIZE];
+    memset(pat, byte, sizeof(pat));
+    for (uint64_t pos = offset; pos < offset + len; ) {
+        size_t n = offset + len - pos < BUF_SIZE ? (size_t)(offset + len - pos) : BUF_SIZE;
+        if (pwrite(x->fd, pat, n, (off_t)pos) != (ssize_t)n) { perror("pwrite"); exit(1); }
+        digest_update(x, pos, pat, n);
+        pos += n;
+    }
+    x->stats.bytes_fill += len;
+    x->stats.bytes_written += len;
+    return 0;
+}
 
-    // post initial recv (for header)
-    if (ibv_post_recv(conn_id->qp, &wr, &bad)) { perror("ibv_post_recv"); exit(1); }
+static void result_fill(struct xfer *x, struct result_wire *out) {
+    struct result_wire rw = {
+        .bytes_received = htonll(x->stats.bytes_received),
+        .bytes_written = htonll(x->stats.bytes_written),
+        .chunks_total = htonll(x->stats.chunks_total),
+        .chunks_dup = htonll(x->stats.chunks_dup),
+        .bytes_dup = htonll(x->stats.bytes_dup),
+        .chunks_reflinked = htonll(x->stats.chunks_reflinked),
+        .bytes_hole = htonll(x->stats.bytes_hole),
+        .bytes_fill = htonll(x->stats.bytes_fill),
+    };
+    digest_final(x, rw.digest);
+    memcpy(x->stats.digest, rw.digest, sizeof(rw.digest));
+    *out = rw;
+}
+
+// log a client's protocol error; the reactor disconnects it once the current pass is over
+static __attribute__((format(printf, 2, 3))) int conn_fail(struct conn *c, const char *fmt, ...) {
+    va_list ap;
+    fprintf(stderr, "[Server] Connection %d: ", c->num);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, ", disconnecting\n");
+    c->failed = 1;
+    return -1;
+}
+
+// ---------- credit scheduling ----------
+
+// credits belong to the connection, so each grant is counted against one of
+// its streams: one still in its unscheduled prefix, else the one with the least left
+static uint64_t stream_remaining(const struct stream *st) {
+    return st->x->file_size > st->granted ? st->x->file_size - st->granted : 0;
+}
+
+static struct stream *grant_stream(const struct conn *c) {
+    struct stream *best = NULL;
+    for (struct stream *st = c->streams; st; st = st->next) {
+        if (st->granted < srv.unsched) return st;
+        if (stream_remaining(st) && (!best || stream_remaining(st) < stream_remaining(best))) best = st;
+    }
+    return best ? best : c->streams;
+}
+
+static uint64_t conn_remaining(const struct conn *c) {
+    uint64_t left = 0;
+    for (const struct stream *st = c->streams; st; st = st->next) left += stream_remaining(st);
+    return left;
+}
+
+static int conn_unscheduled(const struct conn *c) {
+    for (const struct stream *st = c->streams; st; st = st->next)
+        if (st->granted < srv.unsched) return 1;
+    return 0;
+}
+
+// order in which waiting connections get the next credit: small transfers
+// first, then the tenant furthest behind its weighted share, then the
+// connection of that tenant that has received the least. With --srpt a
+// transfer's unscheduled prefix goes first, then the fewest remaining bytes
+static int conn_before(const struct conn *a, const struct conn *b) {
+    if (srv.srpt) {
+        if (conn_unscheduled(a) != conn_unscheduled(b)) return conn_unscheduled(a);
+        if (conn_remaining(a) != conn_remaining(b)) return conn_remaining(a) < conn_remaining(b);
+        return a->num < b->num;
+    }
+    if (a->cls != b->cls) return a->cls < b->cls;
+    if (a->tenant->vtime != b->tenant->vtime) return a->tenant->vtime < b->tenant->vtime;
+    return a->granted < b->granted;
+}
+
+// --srpt: only the overcommit connections with the least left past their
+// prefix are granted to, so a few short transfers finish at full speed
+// instead of every sender trickling into the same receive buffers
+static void srpt_select(void) {
+    for (struct conn *c = srv.conns; c; c = c->next) {
+        if (c->state != CONN_ACTIVE || conn_unscheduled(c)) {
+            c->srpt_ok = 1;
+            continue;
+        }
+        int ahead = 0;
+        for (struct conn *o = srv.conns; o; o = o->next)
+            if (o != c && o->state == CONN_ACTIVE && !conn_unscheduled(o) && conn_before(o, c)) ahead++;
+        c->srpt_ok = ahead < srv.overcommit;
+    }
+}
 
-    rdma_accept(conn_id, NULL);
-    printf("[Server] Connection accepted. Waiting for file...\n");
+// hand out free receive credits; one credit lets the client send one message
+// of up to BUF_SIZE payload bytes and costs BUF_SIZE tokens from both the
+// connection's and the tenant's bucket
+static void schedule_credits(void) {
+    double now = now_sec();
+    int in_use = 0;
+    for (int i = 0; i < srv.num_tenants; i++) bucket_refill(&srv.tenants[i].tb, now);
+    for (struct conn *c = srv.conns; c; c = c->next) {
+        if (c->state != CONN_ACTIVE) continue;
+        in_use += c->outstanding;
+        bucket_refill(&c->tb, now);
+    }
+    if (srv.srpt) srpt_select();
+
+    while (in_use < srv.pool) {
+        struct conn *best = NULL;
+        for (struct conn *c = srv.conns; c; c = c->next) {
+            if (c->state != CONN_ACTIVE || c->outstanding + c->pending >= RECV_DEPTH) continue;
+            if (srv.srpt && !c->srpt_ok) continue;
+            if (!bucket_has(&c->tb, BUF_SIZE) || !bucket_has(&c->tenant->tb, BUF_SIZE)) continue;
+            if (!best || conn_before(c, best)) best = c;
+        }
+        if (!best) break;
+        bucket_take(&best->tb, BUF_SIZE);
+        bucket_take(&best->tenant->tb, BUF_SIZE);
+        best->tenant->vtime += BUF_SIZE / best->tenant->weight;
+        srv.vclock = best->tenant->vtime;
+        best->granted += BUF_SIZE;
+        int was_unsched = conn_unscheduled(best);
+        if (was_unsched) srv.grants_unsched++;
+        else srv.grants_sched++;
+        grant_stream(best)->granted += BUF_SIZE;
+        // leaving the prefix makes it one of the scheduled, which the overcommit limit counts
+        if (srv.srpt && was_unsched && !conn_unscheduled(best)) srpt_select();
+        best->pending++;
+        in_use++;
+    }
+
+    for (struct conn *c = srv.conns; c; c = c->next) {
+        if (c->state == CONN_IDLE && c->outstanding == 0) c->pending = 1;
+        if (c->pending == 0) {
+            // client holds nothing and nothing is in flight: it is queued behind the policy
+            if (c->state == CONN_ACTIVE && c->outstanding == 0 && c->wait_since == 0) {
+                c->wait_since = now;
+                c->waits++;
+            }
+            continue;
+        }
+        if (c->wait_since != 0) {
+            c->wait_total += now - c->wait_since;
+            c->wait_since = 0;
+        }
+        uint32_t n = htonl((uint32_t)c->pending);
+        c->outstanding += c->pending;
+        c->pending = 0;
+        send_reply(c, MSG_CREDIT, 0, &n, sizeof(n));
+    }
+}
+
+// ---------- transfers ----------
+
+static struct stream *find_stream(struct conn *c, uint16_t id) {
+    for (struct stream *st = c->streams; st; st = st->next)
+        if (st->id == id) return st;
+    return NULL;
+}
+
+static void set_conn_class(struct conn *c) {
+    c->cls = c->active_bytes <= srv.small_threshold ? CLASS_SMALL : CLASS_BULK;
+}
+
+static struct xfer *new_xfer(int num, uint16_t id, uint8_t flags, uint64_t file_size) {
+    struct xfer *x = calloc(1, sizeof(*x));
+    if (!x) { perror("calloc"); exit(1); }
+    x->file_size = file_size;
+    x->flags = flags;
+    // the first connection's stream 0 keeps the historical name; everything else gets its own file
+    int numbered = srv.multi || num > 0;
+    if (numbered && id) snprintf(x->path, sizeof(x->path), "received_file.%d.%u.bin", num, id);
+    else if (numbered) snprintf(x->path, sizeof(x->path), "received_file.%d.bin", num);
+    else if (id) snprintf(x->path, sizeof(x->path), "received_file.%u.bin", id);
+    else snprintf(x->path, sizeof(x->path), "%s", OUT_PATH);
+    x->fd = open(x->path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (x->fd < 0) { perror("open"); exit(1); }
+    // size the file up front so holes can be punched anywhere in it
+    if (ftruncate(x->fd, (off_t)file_size) != 0) perror("ftruncate");
+    blake3_hasher_init(&x->hasher);
+    if (flags & XFER_F_DEDUP) {
+        char recipe[80];
+        snprintf(recipe, sizeof(recipe), "%s.recipe", x->path);
+        x->recipe = fopen(recipe, "w");
+    }
+    x->cls = file_size <= srv.small_threshold ? CLASS_SMALL : CLASS_BULK;
+    x->start = now_sec();
+    x->expect = 1;
+    return x;
+}
+
+static int start_stream(struct conn *c, uint16_t id, uint8_t flags, uint64_t file_size,
+                        const char *payload, uint32_t len) {
+    if (find_stream(c, id)) return conn_fail(c, "stream %u already open", id);
+    char name[TENANT_NAME_LEN + 1] = "default";
+    uint64_t session = 0;
+    int qps = 1;
+    if (len >= offsetof(struct file_hdr_wire, session) && payload[0]) {
+        memcpy(name, ((const struct file_hdr_wire *)payload)->tenant, TENANT_NAME_LEN);
+        name[TENANT_NAME_LEN] = '\0';
+    }
+    if (len >= sizeof(struct file_hdr_wire)) {
+        const struct file_hdr_wire *fh = (const struct file_hdr_wire *)payload;
+        session = ntohll(fh->session);
+        qps = fh->qps ? fh->qps : 1;
+    }
 
+    struct xfer *x = NULL;
+    if (session)
+        for (x = srv.sessions; x && x->session != session; x = x->next);
+    if (x) {
+        if (x->file_size != file_size || x->flags != flags)
+            return conn_fail(c, "joins session %" PRIx64 " with a different header", session);
+        printf("[Server] Connection %d joins the transfer to %s\n", c->num, x->path);
+    } else {
+        x = new_xfer(c->num, id, flags, file_size);
+        x->expect = qps;
+        if (session) {
+            x->session = session;
+            x->next = srv.sessions;
+            srv.sessions = x;
+        }
+    }
+
+    struct stream *st = calloc(1, sizeof(*st));
+    if (!st) { perror("calloc"); exit(1); }
+    st->id = id;
+    st->x = x;
+    st->wait_base = c->wait_total;
+    st->next = c->streams;
+    c->streams = st;
+
+    if (!c->tenant) {
+        c->tenant = tenant_get(name);
+        bucket_init(&c->tb, srv.conn_rate);
+    }
+    if (c->state == CONN_IDLE) {
+        // a tenant coming back from idle starts at the current virtual time, not with banked credit
+        if (c->tenant->active++ == 0 && c->tenant->vtime < srv.vclock) c->tenant->vtime = srv.vclock;
+        c->state = CONN_ACTIVE;
+    }
+    c->active_bytes += file_size;
+    set_conn_class(c);
+    printf("[Server] Connection %d stream %u: %" PRIu64 " bytes, tenant %s, class %s\n",
+           c->num, id, file_size, c->tenant->name, CLASS_NAMES[x->cls]);
+    return 0;
+}
+
+// unlink a stream from its connection; the connection goes idle with its last stream
+static void remove_stream(struct conn *c, struct stream *st) {
+    for (struct stream **p = &c->streams; *p; p = &(*p)->next)
+        if (*p == st) { *p = st->next; break; }
+    c->active_bytes -= st->x->file_size;
+    free(st);
+    set_conn_class(c);
+    if (!c->streams && c->state == CONN_ACTIVE) {
+        srv.cls[c->cls].waits += c->waits;
+        c->waits = 0;
+        c->wait_since = 0;
+        c->tenant->active--;
+        c->state = CONN_IDLE;
+    }
+}
+
+// every member stream has sent MSG_DONE (or gone away): answer each of them and close the file
+static void finish_xfer(struct xfer *x) {
+    if (ftruncate(x->fd, (off_t)x->file_size) != 0) perror("ftruncate");
+    struct result_wire rw;
+    result_fill(x, &rw);
+    double now = now_sec(), secs = now - x->start, queued = 0;
+    int members = 0;
+
+    for (struct conn *c = srv.conns; c; c = c->next) {
+        struct stream *st = c->streams;
+        while (st) {
+            struct stream *next = st->next;
+            if (st->x == x) {
+                if (c->wait_since != 0) {
+                    c->wait_total += now - c->wait_since;
+                    c->wait_since = now;
+                }
+                // the transfer waited as long as its most throttled member
+                double q = c->wait_total - st->wait_base;
+                if (q > queued) queued = q;
+                rw.queue_delay_us = htonll((uint64_t)(q * 1e6));
+                send_reply(c, MSG_RESULT, st->id, &rw, sizeof(rw));
+                members++;
+                remove_stream(c, st);
+            }
+            st = next;
+        }
+    }
+    for (struct xfer **p = &srv.sessions; *p; p = &(*p)->next)
+        if (*p == x) { *p = x->next; break; }
+
+    struct class_stats *cs = &srv.cls[x->cls];
+    cs->transfers++;
+    cs->bytes += x->stats.bytes_written;
+    cs->busy_s += secs;
+    cs->wait_s += queued;
+
+    printf("[Server] File saved to %s (%" PRIu64 " bytes)\n", x->path, x->stats.bytes_written);
+    char hex[2 * BLAKE3_OUT_LEN + 1];
+    blake3_hex(x->stats.digest, hex);
+    printf("[Server] BLAKE3 %s\n", hex);
+    if (x->flags & XFER_F_SPARSE)
+        printf("[Server] Sparse: %" PRIu64 " bytes left as holes, %" PRIu64 " bytes expanded from fill runs\n",
+               x->stats.bytes_hole, x->stats.bytes_fill);
+    if (x->flags & XFER_F_DEDUP)
+        printf("[Server] Dedup: %" PRIu64 "/%" PRIu64 " chunks from store (%" PRIu64 " reflinked), %" PRIu64 " bytes saved\n",
+               x->stats.chunks_dup, x->stats.chunks_total, x->stats.chunks_reflinked, x->stats.bytes_dup);
+    printf("[Server] %s (%s, %d connection%s): %.3f s, %.2f MB/s, queued %.3f s\n",
+           x->path, CLASS_NAMES[x->cls], members, members == 1 ? "" : "s", secs,
+           secs > 0 ? x->stats.bytes_written / secs / 1e6 : 0.0, queued);
+    fflush(stdout);
+    xfer_close(x);
+}
+
+static void close_stream(struct stream *st) {
+    struct xfer *x = st->x;
+    if (++x->done >= x->expect) finish_xfer(x);
+}
+
+// connection went away: its streams stop counting towards their transfers
+static void drop_streams(struct conn *c) {
+    while (c->streams) {
+        struct stream *st = c->streams;
+        struct xfer *x = st->x;
+        fprintf(stderr, "[Server] Connection %d closed mid-transfer (%s)\n", c->num, x->path);
+        c->streams = st->next;
+        free(st);
+        x->expect--;
+        int refs = 0;
+        for (struct conn *o = srv.conns; o; o = o->next)
+            for (struct stream *os = o->streams; os; os = os->next) refs += os->x == x;
+        if (refs == 0) {
+            for (struct xfer **p = &srv.sessions; *p; p = &(*p)->next)
+                if (*p == x) { *p = x->next; break; }
+            xfer_close(x);
+        } else if (x->done >= x->expect) {
+            finish_xfer(x);
+        }
+    }
+}
+
+// ---------- one-sided ring ----------
+
+static int ring_open(struct conn *c, struct stream *st) {
+    if (c->ring) return conn_fail(c, "second ring stream");
+    struct data_ring *r = calloc(1, sizeof(*r));
+    size_t size = sizeof(struct ring_ctrl) + (size_t)RING_SLOTS * RING_SLOT_SIZE;
+    if (!r || posix_memalign((void **)&r->mem, 4096, size) != 0) { perror("alloc ring"); exit(1); }
+    memset(r->mem, 0, size);
+    r->mr = ibv_reg_mr(c->pd, r->mem, size, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ);
+    if (!r->mr) { perror("ibv_reg_mr ring"); exit(1); }
+    r->st = st;
+    c->ring = r;
+    struct ring_wire rw = {.addr = htonll((uintptr_t)r->mem), .rkey = htonl(r->mr->rkey),
+                           .slots = htonl(RING_SLOTS), .slot_size = htonl((uint32_t)RING_SLOT_SIZE)};
+    send_reply(c, MSG_RING, st->id, &rw, sizeof(rw));
+    return 0;
+}
+
+// consume whatever the client has written since the last look; the per-record
+// work is a load of the tail word and the record itself. Records are taken only
+// while the connection and tenant buckets allow, so the bandwidth policy holds
+// back the head and with it the client.
+static int ring_poll(struct conn *c) {
+    struct data_ring *r = c->ring;
+    struct ring_ctrl *ctl = (struct ring_ctrl *)r->mem;
+    uint64_t tail = ntohll(__atomic_load_n(&ctl->tail, __ATOMIC_ACQUIRE));
+    int n = 0;
+    r->polls++;
+    while (r->head < tail && n < RING_SLOTS) {
+        if (!bucket_has(&c->tb, BUF_SIZE) || !bucket_has(&c->tenant->tb, BUF_SIZE)) break;
+        const char *slot = r->mem + sizeof(*ctl) + (size_t)(r->head % RING_SLOTS) * RING_SLOT_SIZE;
+        struct ring_rec rec;
+        memcpy(&rec, slot, sizeof(rec));
+        uint32_t len = ntohl(rec.len);
+        if (ntohl(rec.seq) != (uint32_t)r->head || len > BUF_SIZE ||
+            handle_data(r->st->x, ntohll(rec.offset), slot + sizeof(rec), len)) {
+            conn_fail(c, "ring record %" PRIu64 " is corrupt", r->head);
+            return n;
+        }
+        bucket_take(&c->tb, len);
+        bucket_take(&c->tenant->tb, len);
+        r->head++;
+        n++;
+    }
+    if (n) {
+        __atomic_store_n(&ctl->head, htonll(r->head), __ATOMIC_RELEASE);
+        r->records += (uint64_t)n;
+    }
+    if (r->done && r->head == tail) {
+        struct stream *st = r->st;
+        printf("[Server] Connection %d ring: %" PRIu64 " records, %.2f per poll\n", c->num, r->records,
+               r->polls ? (double)r->records / (double)r->polls : 0.0);
+        ring_close(c);
+        close_stream(st);
+    }
+    return n;
+}
+
+// ---------- bench ----------
+
+static int bench_open(struct conn *c, const char *payload, uint32_t len) {
+    struct bench_wire bw;
+    if (len < sizeof(bw)) return conn_fail(c, "short bench message");
+    memcpy(&bw, payload, sizeof(bw));
+    uint32_t size = ntohl(bw.len);
+    if (size == 0 || size > BENCH_MAX_REGION) size = BENCH_MAX_REGION;
+    if (c->bench) bench_close(c);
+    struct bench_region *b = calloc(1, sizeof(*b));
+    if (!b || posix_memalign((void **)&b->mem, 4096, size) != 0) { perror("alloc bench region"); exit(1); }
+    memset(b->mem, 0, size);
+    b->mr = ibv_reg_mr(c->pd, b->mem, size, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ);
+    if (!b->mr) { perror("ibv_reg_mr bench"); exit(1); }
+    b->len = size;
+    c->bench = b;
+    printf("[Server] Connection %d bench: %u-byte region\n", c->num, size);
+    bw = (struct bench_wire){.addr = htonll((uintptr_t)b->mem), .rkey = htonl(b->mr->rkey), .len = htonl(size)};
+    send_reply(c, MSG_BENCH, 0, &bw, sizeof(bw));
+    return 0;
+}
+
+static void print_class_stats(void) {
+    for (int i = 0; i < NUM_CLASSES; i++) {
+        const struct class_stats *cs = &srv.cls[i];
+        if (cs->transfers == 0) continue;
+        printf("[Server] Class %s: %" PRIu64 " transfers, %" PRIu64 " bytes, %.2f MB/s, "
+               "mean queueing delay %.3f ms (%" PRIu64 " waits)\n",
+               CLASS_NAMES[i], cs->transfers, cs->bytes, cs->busy_s > 0 ? cs->bytes / cs->busy_s / 1e6 : 0.0,
+               cs->wait_s * 1e3 / cs->transfers, cs->waits);
+    }
+}
+
+static int handle_msg(struct conn *c, const char *slot, uint32_t byte_len) {
+    const struct msg_hdr *h = (const struct msg_hdr *)slot;
+    if (byte_len < sizeof(*h)) return conn_fail(c, "message too small");
+    uint32_t len = ntohl(h->len);
+    uint64_t offset = ntohll(h->offset);
+    const char *payload = (const char *)(h + 1);
+    if (len > byte_len - sizeof(*h)) return conn_fail(c, "truncated message");
+    if (c->outstanding == 0) return conn_fail(c, "sent without a credit");
+    c->outstanding--;
+    uint16_t stream = ntohs(h->stream);
+    struct stream *st = NULL;
+    struct xfer *x = NULL;
+    if (h->type != MSG_FILE_HDR && h->type != MSG_BENCH) {
+        if (!(st = find_stream(c, stream))) return conn_fail(c, "message for unknown stream %u", stream);
+        x = st->x;
+    }
+
+    switch (h->type) {
+    case MSG_FILE_HDR:
+        if (start_stream(c, stream, h->flags, offset, payload, len)) return -1;
+        if (h->flags & XFER_F_RING) return ring_open(c, find_stream(c, stream));
+        return 0;
+    case MSG_DATA:
+        if (handle_data(x, offset, payload, len)) return conn_fail(c, "bad data message");
+        return 0;
+    case MSG_HASHES:
+        handle_hashes(x, offset, payload, len);
+        send_reply(c, MSG_NEED, stream, x->batch_need, sizeof(x->batch_need));
+        return 0;
+    case MSG_HOLE: {
+        uint64_t hole_len;
+        if (len < sizeof(hole_len)) return conn_fail(c, "short hole message");
+        memcpy(&hole_len, payload, sizeof(hole_len));
+        if (handle_hole(x, offset, ntohll(hole_len))) return conn_fail(c, "bad hole message");
+        return 0;
+    }
+    case MSG_FILL: {
+        struct fill_wire fw;
+        if (len < sizeof(fw)) return conn_fail(c, "short fill message");
+        memcpy(&fw, payload, sizeof(fw));
+        if (handle_fill(x, offset, ntohll(fw.len), fw.byte)) return conn_fail(c, "bad fill message");
+        return 0;
+    }
+    case MSG_BENCH:
+        return bench_open(c, payload, len);
+    case MSG_DONE:
+        // the tail written before MSG_DONE may still be ahead of the server's head
+        if (c->ring && c->ring->st == st) c->ring->done = 1;
+        else close_stream(st);
+        return 0;
+    default:
+        return conn_fail(c, "unknown message type %u", h->type);
+    }
+}
+
+// drain a connection's receive queue; each slot is reposted once its message is handled
+static int poll_conn(struct conn *c) {
+    struct ibv_wc wc[RECV_DEPTH];
+    int n = ibv_poll_cq(c->recv_cq, RECV_DEPTH, wc);
+    if (n < 0) { fprintf(stderr, "ibv_poll_cq failed\n"); exit(1); }
+    for (int i = 0; i < n; i++) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            // flushed receives after a disconnect are expected
+            if (wc[i].status != IBV_WC_WR_FLUSH_ERR)
+                fprintf(stderr, "recv failed on connection %d: %s\n", c->num, ibv_wc_status_str(wc[i].status));
+            continue;
+        }
+        int slot = (int)wc[i].wr_id;
+        const char *msg = c->buf + (size_t)slot * MSG_BUF_SIZE;
+        if (c->bench && wc[i].byte_len > 0 && msg[0] == 0) {
+            c->bench->sends++;
+            c->bench->bytes += wc[i].byte_len;
+        } else if (handle_msg(c, msg, wc[i].byte_len)) {
+            break;      // the rest of the queue belongs to a connection that is going away
+        }
+        post_recv(c, slot);
+    }
+    return n;
+}
+
+// single-shot mode ends once a transfer has completed and no connection is still sending
+static int srv_finished(void) {
+    if (srv.cls[CLASS_SMALL].transfers + srv.cls[CLASS_BULK].transfers == 0) return 0;
+    for (struct conn *c = srv.conns; c; c = c->next)
+        if (c->state == CONN_ACTIVE) return 0;
+    return 1;
+}
+
+// zero-RTT file from a connect request: write it and answer in the reject, no QP needed
+static void tiny_commit(struct rdma_cm_id *id, const struct tiny_req_wire *req) {
+    struct tiny_reply_wire rep = {.magic = htonl(TINY_MAGIC), .status = TINY_OK};
+    if (req->len > TINY_MAX) {
+        rep.status = TINY_BAD;
+    } else if (!srv.multi && srv_finished()) {
+        rep.status = TINY_REFUSED;
+    } else {
+        double t0 = now_sec();
+        struct xfer *x = new_xfer(srv.next_num++, 0, 0, req->len);
+        handle_data(x, 0, (const char *)req->data, req->len);
+        struct result_wire rw;
+        result_fill(x, &rw);
+        rep.bytes_written = rw.bytes_written;
+        memcpy(rep.digest, rw.digest, sizeof(rep.digest));
+        struct class_stats *cs = &srv.cls[x->cls];
+        cs->transfers++;
+        cs->bytes += x->stats.bytes_written;
+        cs->busy_s += now_sec() - t0;
+        printf("[Server] File saved to %s (%u bytes, zero-RTT)\n", x->path, req->len);
+        fflush(stdout);
+        xfer_close(x);
+    }
+    rdma_reject(id, &rep, sizeof(rep));
+    rdma_destroy_id(id);
+}
+
+static int handle_cm_events(struct rdma_event_channel *ec) {
+    struct rdma_cm_event *event;
+    int n = 0;
+    while (rdma_get_cm_event(ec, &event) == 0) {
+        struct rdma_cm_id *id = event->id;
+        enum rdma_cm_event_type type = event->event;
+        // private data lives in the event, so it is copied out before the ack
+        struct tiny_req_wire tiny = {0};
+        if (type == RDMA_CM_EVENT_CONNECT_REQUEST && event->param.conn.private_data_len >= sizeof(tiny))
+            memcpy(&tiny, event->param.conn.private_data, sizeof(tiny));
+        // the client's READ initiator depth is our responder resources and vice versa
+        int rd_atom = event->param.conn.initiator_depth, init_rd_atom = event->param.conn.responder_resources;
+        rdma_ack_cm_event(event);
+        n++;
+        if (type == RDMA_CM_EVENT_CONNECT_REQUEST) {
+            if (ntohl(tiny.magic) == TINY_MAGIC) {
+                tiny_commit(id, &tiny);
+                continue;
+            }
+            if (!srv.multi && srv_finished()) {
+                // single-shot mode is winding down
+                rdma_reject(id, NULL, 0);
+                rdma_destroy_id(id);
+                continue;
+            }
+            conn_create(id, rd_atom, init_rd_atom);
+        } else if (type == RDMA_CM_EVENT_DISCONNECTED && id->context) {
+            conn_destroy(id->context);
+        } else if (type == RDMA_CM_EVENT_TIMEWAIT_EXIT && !id->context) {
+            qp_slot_unpark(id);
+        }
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) { perror("rdma_get_cm_event"); exit(1); }
+    return n;
+}
+
+// ---------- reactor loop ----------
+
+// completion channel readable: the CQs that fired are polled by the next pass over the connections
+static int drain_cq_events(struct dev_res *d) {
+    struct ibv_cq *cq;
+    void *ctx;
+    int n = 0;
+    while (ibv_get_cq_event(d->chan, &cq, &ctx) == 0) {
+        ((struct qp_slot *)ctx)->armed = 0;
+        ibv_ack_cq_events(cq, 1);
+        n++;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) { perror("ibv_get_cq_event"); exit(1); }
+    return n;
+}
+
+// a client that broke the protocol loses its own connection, not the server
+static void reap_failed(void) {
+    for (struct conn *c = srv.conns, *next; c; c = next) {
+        next = c->next;
+        if (!c->failed) continue;
+        rdma_disconnect(c->id);
+        conn_destroy(c);
+    }
+}
+
+// ask for an event on every receive CQ, then look once more so nothing that
+// landed before the request is slept through
+static int arm_and_poll(void) {
+    int busy = 0;
+    for (struct conn *c = srv.conns; c; c = c->next) {
+        if (!c->qs->armed) {
+            if (ibv_req_notify_cq(c->recv_cq, 0)) { perror("ibv_req_notify_cq"); exit(1); }
+            c->qs->armed = 1;
+        }
+        busy += poll_conn(c);
+    }
+    reap_failed();
+    return busy;
+}
+
+// a client with no credits may be waiting on a token bucket, which only refills with time
+static int credits_blocked(void) {
+    for (struct conn *c = srv.conns; c; c = c->next)
+        if (c->state == CONN_ACTIVE && c->outstanding == 0) return 1;
+    return 0;
+}
+
+// admin socket: every connection gets one JSON line of counters and is closed
+static void admin_serve(int lfd) {
+    int fd;
+    while ((fd = accept(lfd, NULL, NULL)) >= 0) {
+        int conns = 0, active = 0;
+        for (struct conn *c = srv.conns; c; c = c->next) {
+            conns++;
+            active += c->state == CONN_ACTIVE;
+        }
+        struct usage u;
+        char ru[320], buf[1536];
+        usage_now(RUSAGE_SELF, &u);
+        usage_json(&u, ru, sizeof(ru));
+        int n = snprintf(buf, sizeof(buf),
+            "{\"connections\": %d, \"active\": %d, \"accepts\": %" PRIu64 ", \"qp_pool_misses\": %" PRIu64 ", "
+            "\"transfers\": {\"small\": %" PRIu64 ", \"bulk\": %" PRIu64 "}, "
+            "\"bytes\": {\"small\": %" PRIu64 ", \"bulk\": %" PRIu64 "}, "
+            "\"reactor\": {\"loops\": %" PRIu64 ", \"sleeps\": %" PRIu64 ", \"wakeups\": %" PRIu64 ", \"busy_s\": %.6f}, "
+            "\"grants\": {\"srpt\": %s, \"unscheduled\": %" PRIu64 ", \"scheduled\": %" PRIu64 "}, \"rusage\": %s}\n",
+            conns, active, srv.accepts, srv.pool_misses,
+            srv.cls[CLASS_SMALL].transfers, srv.cls[CLASS_BULK].transfers,
+            srv.cls[CLASS_SMALL].bytes, srv.cls[CLASS_BULK].bytes,
+            rx.loops, rx.sleeps, rx.wakeups, rx.busy_s,
+            srv.srpt ? "true" : "false", srv.grants_unsched, srv.grants_sched, ru);
+        if (write(fd, buf, (size_t)n) != n) perror("admin write");
+        close(fd);
+    }
+}
+
+static int admin_listen(const char *path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un sa = {.sun_family = AF_UNIX};
+    if (fd < 0 || strlen(path) >= sizeof(sa.sun_path)) { fprintf(stderr, "bad admin socket %s\n", path); exit(1); }
+    memcpy(sa.sun_path, path, strlen(path));
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(fd, 16) != 0) { perror("admin socket"); exit(1); }
+    reactor_add(fd, SRC_ADMIN, NULL);
+    printf("[Server] Admin socket at %s\n", path);
+    return fd;
+}
+
+static void reactor_run(struct rdma_event_channel *ec, int admin_fd) {
+    double last_work = now_sec();
+    while (!stop) {
+        double t = now_sec();
+        int busy = handle_cm_events(ec), rings = 0;
+        for (struct conn *c = srv.conns; c; c = c->next) {
+            busy += poll_conn(c);
+            if (c->ring && !c->failed) {
+                rings++;
+                busy += ring_poll(c);
+            }
+        }
+        reap_failed();
+        schedule_credits();
+        if (!srv.multi && srv_finished()) break;
+        rx.loops++;
+        double now = now_sec();
+        if (busy) {
+            rx.busy_s += now - t;
+            last_work = now;
+            continue;
+        }
+        // ring streams produce no completions, so their memory is polled for as long as they last
+        if (rings || now - last_work < rx.spin) continue;
+        if (arm_and_poll()) {
+            last_work = now;
+            continue;
+        }
+
+        struct epoll_event evs[16];
+        rx.sleeps++;
+        int n = epoll_wait(rx.epfd, evs, 16, credits_blocked() ? 1 : 100);
+        if (n < 0 && errno != EINTR) { perror("epoll_wait"); exit(1); }
+        for (int i = 0; i < n; i++) {
+            struct ev_source *src = evs[i].data.ptr;
+            if (src->kind == SRC_CQ) drain_cq_events(src->ptr);
+            else if (src->kind == SRC_ADMIN) admin_serve(admin_fd);
+            // SRC_CM: picked up by handle_cm_events at the top of the loop
+        }
+        if (n > 0) {
+            rx.wakeups++;
+            last_work = now_sec();
+        }
+    }
+}
+
+// ---------- UD transport (experimental) ----------
+
+// --ud: every client is a session on one of a few shared UD QPs instead of an RC
+// QP of its own. Datagrams can be lost or reordered, so each session tracks which
+// sequence numbers arrived and the client retransmits what the ACKs say is missing.
+#define UD_RECV_DEPTH 1024
+#define UD_HASH 256
+#define UD_ACK_EVERY 32
+#define UD_IDLE_S 10.0
+
+struct ud_session {
+    // the session key: QP numbers are only unique per port, and get reused
+    uint32_t qpn;
+    uint16_t slid;
+    union ibv_gid gid;      // zero when the client sent no GRH
+    uint64_t nonce;
+    struct ibv_ah *ah;
+    struct xfer *x;         // NULL once the result is in
+    int num;
+    uint32_t dgram;
+    uint64_t nseq, cum, top;    // datagrams in the file; all below cum arrived; highest seen + 1
+    uint8_t *seen;
+    int unacked;            // new datagrams since the last ACK
+    struct result_wire result;
+    uint64_t datagrams, dups;
+    double last;
+    struct ud_session *next;
+};
+
+struct ud_thread {
+    pthread_t thread;
+    int index;
+    struct ibv_context *verbs;
+    uint8_t port;
+    struct ibv_pd *pd;
+    struct ibv_cq *send_cq, *recv_cq;
+    struct ibv_qp *qp;
+    struct ibv_mr *mr;
+    char *buf;              // [UD_RECV_DEPTH recv slots][send slot]
+    size_t slot;            // UD_GRH + path MTU
+    struct ud_session *sessions[UD_HASH];
+    uint64_t datagrams, acks, sessions_done;
+    struct usage usage;     // the worker thread's own, filled in when it exits
+};
+
+static struct ud_thread *ud;
+
+static void ud_post_recv(struct ud_thread *t, int i) {
+    struct ibv_sge sge = {.addr = (uintptr_t)(t->buf + (size_t)i * t->slot), .length = (uint32_t)t->slot,
+                          .lkey = t->mr->lkey};
+    struct ibv_recv_wr wr = {.wr_id = (uint64_t)i, .sg_list = &sge, .num_sge = 1};
+    struct ibv_recv_wr *bad;
+    if (ibv_post_recv(t->qp, &wr, &bad)) { perror("ibv_post_recv"); exit(1); }
+}
+
+// the QP is brought up by hand: rdma_cm only hands its number to connecting clients
+static void ud_thread_init(struct ud_thread *t, struct ibv_context *verbs, uint8_t port) {
+    struct ibv_port_attr pa;
+    if (ibv_query_port(verbs, port, &pa)) { perror("ibv_query_port"); exit(1); }
+    t->verbs = verbs;
+    t->port = port;
+    t->slot = UD_GRH + (size_t)(128u << pa.active_mtu);
+    t->buf = malloc((size_t)(UD_RECV_DEPTH + 1) * t->slot);
+    if (!t->buf) { perror("malloc"); exit(1); }
+    t->pd = ibv_alloc_pd(verbs);
+    t->send_cq = ibv_create_cq(verbs, 16, NULL, NULL, 0);
+    t->recv_cq = ibv_create_cq(verbs, UD_RECV_DEPTH, NULL, NULL, 0);
+    struct ibv_qp_init_attr qp_attr = {
+        .send_cq = t->send_cq, .recv_cq = t->recv_cq, .qp_type = IBV_QPT_UD,
+        .cap = {.max_send_wr = 16, .max_recv_wr = UD_RECV_DEPTH, .max_send_sge = 1, .max_recv_sge = 1}
+    };
+    if (!(t->qp = ibv_create_qp(t->pd, &qp_attr))) { perror("ibv_create_qp"); exit(1); }
+    struct ibv_qp_attr a = {.qp_state = IBV_QPS_INIT, .pkey_index = 0, .port_num = port, .qkey = RDMA_UDP_QKEY};
+    if (ibv_modify_qp(t->qp, &a, IBV_QP_STATE | IBV_QP_PKEY_INDEX | IBV_QP_PORT | IBV_QP_QKEY)) {
+        perror("ibv_modify_qp INIT");
+        exit(1);
+    }
+    a = (struct ibv_qp_attr){.qp_state = IBV_QPS_RTR};
+    if (ibv_modify_qp(t->qp, &a, IBV_QP_STATE)) { perror("ibv_modify_qp RTR"); exit(1); }
+    a = (struct ibv_qp_attr){.qp_state = IBV_QPS_RTS, .sq_psn = 0};
+    if (ibv_modify_qp(t->qp, &a, IBV_QP_STATE | IBV_QP_SQ_PSN)) { perror("ibv_modify_qp RTS"); exit(1); }
+    t->mr = ibv_reg_mr(t->pd, t->buf, (size_t)(UD_RECV_DEPTH + 1) * t->slot, IBV_ACCESS_LOCAL_WRITE);
+    if (!t->mr) { perror("ibv_reg_mr"); exit(1); }
+    for (int i = 0; i < UD_RECV_DEPTH; i++) ud_post_recv(t, i);
+}
+
+static void ud_send(struct ud_thread *t, struct ud_session *s, uint8_t type, uint64_t offset,
+                    const void *payload, uint32_t len) {
+    struct msg_hdr *h = (struct msg_hdr *)(t->buf + (size_t)UD_RECV_DEPTH * t->slot);
+    msg_hdr_set(h, type, 0, len, offset);
+    memcpy(h + 1, payload, len);
+    struct ibv_sge sge = {.addr = (uintptr_t)h, .length = sizeof(*h) + len, .lkey = t->mr->lkey};
+    struct ibv_send_wr wr = {.wr_id = type, .sg_list = &sge, .num_sge = 1,
+        .opcode = IBV_WR_SEND, .send_flags = IBV_SEND_SIGNALED};
+    wr.wr.ud.ah = s->ah;
+    wr.wr.ud.remote_qpn = s->qpn;
+    wr.wr.ud.remote_qkey = RDMA_UDP_QKEY;
+    struct ibv_send_wr *bad;
     struct ibv_wc wc;
+    if (ibv_post_send(t->qp, &wr, &bad)) { perror("ibv_post_send"); exit(1); }
+    if (poll_one(t->send_cq, &wc)) { fprintf(stderr, "UD send failed\n"); exit(1); }
+}
+
+static void ud_ack(struct ud_thread *t, struct ud_session *s) {
+    struct ud_ack_wire a = {.cum = htonll(s->cum)};
+    for (uint64_t i = 0; i < UD_SACK_BITS && s->cum + i < s->top; i++)
+        if (s->seen[(s->cum + i) / 8] & (1u << ((s->cum + i) % 8))) a.sack[i / 8] |= (uint8_t)(1u << (i % 8));
+    ud_send(t, s, MSG_ACK, 0, &a, sizeof(a));
+    s->unacked = 0;
+    t->acks++;
+}
+
+static void ud_source(const struct ibv_wc *wc, const char *grh, union ibv_gid *gid) {
+    memset(gid, 0, sizeof(*gid));
+    if (wc->wc_flags & IBV_WC_GRH) memcpy(gid, &((const struct ibv_grh *)grh)->sgid, sizeof(*gid));
+}
 
-    // 1) Wait for header (8 bytes)
-    while (ibv_poll_cq(cq, 1, &wc) == 0);
-    if (wc.status != IBV_WC_SUCCESS) { fprintf(stderr, "header recv failed\n"); exit(1); }
-    uint64_t net_size;
-    if (wc.byte_len < sizeof(net_size)) {
-        fprintf(stderr, "header too small\n"); exit(1);
+static struct ud_session **ud_find(struct ud_thread *t, const struct ibv_wc *wc, const char *grh) {
+    union ibv_gid gid;
+    ud_source(wc, grh, &gid);
+    struct ud_session **p = &t->sessions[wc->src_qp % UD_HASH];
+    while (*p && ((*p)->qpn != wc->src_qp || (*p)->slid != wc->slid || memcmp(&(*p)->gid, &gid, sizeof(gid))))
+        p = &(*p)->next;
+    return p;
+}
+
+static void ud_free(struct ud_session **p) {
+    struct ud_session *s = *p;
+    *p = s->next;
+    if (s->x) {
+        fprintf(stderr, "[Server] UD session %d abandoned at %" PRIu64 "/%" PRIu64 " datagrams (%s)\n",
+                s->num, s->cum, s->nseq, s->x->path);
+        xfer_close(s->x);
     }
-    memcpy(&net_size, buf, sizeof(net_size));
-    uint64_t file_size = ntohll(net_size);
-    // repost recv for next data
-    if (ibv_post_recv(conn_id->qp, &wr, &bad)) { perror("ibv_post_recv"); exit(1); }
+    ibv_destroy_ah(s->ah);
+    free(s->seen);
+    free(s);
+}
 
-    int fd = open("received_file.bin", O_CREAT | O_WRONLY | O_TRUNC, 0644);
-    if (fd < 0) { perror("open"); exit(1); }
+static void ud_start(struct ud_thread *t, const struct ibv_wc *wc, const char *grh, uint64_t file_size,
+                     const char *payload, uint32_t len) {
+    struct ud_hello_wire hello;
+    if (len < sizeof(hello)) { fprintf(stderr, "[Server] Short UD hello from QP %u\n", wc->src_qp); return; }
+    memcpy(&hello, payload, sizeof(hello));
+    uint32_t dgram = ntohl(hello.dgram);
+    if (dgram == 0 || dgram > t->slot - UD_GRH - sizeof(struct msg_hdr)) {
+        fprintf(stderr, "[Server] UD hello from QP %u wants %u-byte datagrams\n", wc->src_qp, dgram);
+        return;
+    }
+    struct ud_session *s = calloc(1, sizeof(*s));
+    if (!s) { perror("calloc"); exit(1); }
+    s->ah = ibv_create_ah_from_wc(t->pd, (struct ibv_wc *)wc, (struct ibv_grh *)grh, t->port);
+    if (!s->ah) { perror("ibv_create_ah_from_wc"); free(s); return; }
+    s->qpn = wc->src_qp;
+    s->slid = wc->slid;
+    ud_source(wc, grh, &s->gid);
+    s->nonce = hello.nonce;
+    s->dgram = dgram;
+    s->nseq = (file_size + dgram - 1) / dgram;
+    s->seen = calloc((size_t)(s->nseq / 8 + 1), 1);
+    if (!s->seen) { perror("calloc"); exit(1); }
+    s->num = __atomic_fetch_add(&srv.next_num, 1, __ATOMIC_RELAXED);
+    s->x = new_xfer(s->num, 0, 0, file_size);
+    s->next = t->sessions[s->qpn % UD_HASH];
+    t->sessions[s->qpn % UD_HASH] = s;
+    char name[TENANT_NAME_LEN + 1] = {0};
+    memcpy(name, hello.fh.tenant, TENANT_NAME_LEN);
+    printf("[Server] UD session %d on QP %d: %" PRIu64 " bytes in %" PRIu64 " datagrams of %u, tenant %s\n",
+           s->num, t->index, file_size, s->nseq, dgram, name[0] ? name : "default");
+    fflush(stdout);
+}
 
-    uint64_t total = 0;
-    while (total < file_size) {
-        while (ibv_poll_cq(cq, 1, &wc) == 0);
-        if (wc.status != IBV_WC_SUCCESS) { fprintf(stderr, "recv failed\n"); break; }
-        size_t got = wc.byte_len; // exact length received
-        if (got > 0) {
-            ssize_t w = write(fd, buf, got); // write exact bytes
-            if (w < 0) { perror("write"); break; }
-            total += (uint64_t)w;
+static void ud_data(struct ud_thread *t, struct ud_session *s, uint64_t offset, const char *payload, uint32_t len) {
+    uint64_t seq = offset / s->dgram;
+    uint64_t want = seq + 1 < s->nseq ? s->dgram : s->x->file_size - seq * s->dgram;
+    if (offset % s->dgram || seq >= s->nseq || len != want) {
+        fprintf(stderr, "[Server] UD session %d: bad datagram at offset %" PRIu64 "\n", s->num, offset);
+        return;
+    }
+    s->datagrams++;
+    if (s->seen[seq / 8] & (1u << (seq % 8))) {
+        // the client retransmitted something we have: its view is stale, refresh it
+        s->dups++;
+        ud_ack(t, s);
+        return;
+    }
+    if (handle_data(s->x, offset, payload, len)) return;
+    s->seen[seq / 8] |= (uint8_t)(1u << (seq % 8));
+    int skipped = seq > s->top;
+    if (seq >= s->top) s->top = seq + 1;
+    while (s->cum < s->nseq && (s->seen[s->cum / 8] & (1u << (s->cum % 8)))) s->cum++;
+    // a gap opening is reported straight away so the client can fill it early
+    if (++s->unacked >= UD_ACK_EVERY || skipped || s->cum == s->nseq) ud_ack(t, s);
+}
+
+static void ud_done(struct ud_thread *t, struct ud_session *s) {
+    if (s->x && s->cum < s->nseq) { ud_ack(t, s); return; }
+    if (s->x) {
+        struct xfer *x = s->x;
+        if (ftruncate(x->fd, (off_t)x->file_size) != 0) perror("ftruncate");
+        result_fill(x, &s->result);
+        double secs = now_sec() - x->start;
+        char hex[2 * BLAKE3_OUT_LEN + 1];
+        blake3_hex(x->stats.digest, hex);
+        printf("[Server] File saved to %s (%" PRIu64 " bytes)\n", x->path, x->stats.bytes_written);
+        printf("[Server] BLAKE3 %s\n", hex);
+        printf("[Server] %s (UD session %d): %.3f s, %.2f MB/s, %" PRIu64 " datagrams, %" PRIu64 " duplicates\n",
+               x->path, s->num, secs, secs > 0 ? x->stats.bytes_written / secs / 1e6 : 0.0, s->datagrams, s->dups);
+        fflush(stdout);
+        xfer_close(x);
+        s->x = NULL;
+        t->sessions_done++;
+    }
+    // the client repeats MSG_DONE until it sees this, so a lost result is just sent again
+    ud_send(t, s, MSG_RESULT, 0, &s->result, sizeof(s->result));
+}
+
+static void ud_handle(struct ud_thread *t, const struct ibv_wc *wc, const char *slot) {
+    const struct msg_hdr *h = (const struct msg_hdr *)(slot + UD_GRH);
+    if (wc->byte_len < UD_GRH + sizeof(*h)) return;
+    uint32_t len = ntohl(h->len);
+    if (len > wc->byte_len - UD_GRH - sizeof(*h)) return;
+    uint64_t offset = ntohll(h->offset);
+    const char *payload = (const char *)(h + 1);
+    t->datagrams++;
+
+    struct ud_session **p = ud_find(t, wc, slot), *s = *p;
+    if (h->type == MSG_FILE_HDR && s && len >= sizeof(struct ud_hello_wire) &&
+        memcmp(&s->nonce, payload + offsetof(struct ud_hello_wire, nonce), sizeof(s->nonce))) {
+        // a new transfer from a QP number an earlier, unswept session still holds
+        ud_free(p);
+        s = NULL;
+    }
+    if (h->type == MSG_FILE_HDR && !s) {
+        ud_start(t, wc, slot, offset, payload, len);
+        s = *ud_find(t, wc, slot);
+    }
+    // datagrams for sessions we never saw or already swept are stale copies; drop them
+    if (!s) return;
+    s->last = now_sec();
+    switch (h->type) {
+    case MSG_FILE_HDR:
+        ud_ack(t, s);
+        break;
+    case MSG_DATA:
+        // a late copy after the result: the final ACK moves the client on to MSG_DONE
+        if (s->x) ud_data(t, s, offset, payload, len);
+        else ud_ack(t, s);
+        break;
+    case MSG_DONE:
+        ud_done(t, s);
+        break;
+    default:
+        fprintf(stderr, "[Server] UD session %d: unexpected message type %u\n", s->num, h->type);
+    }
+}
+
+static void ud_sweep(struct ud_thread *t, double older_than) {
+    for (int i = 0; i < UD_HASH; i++) {
+        struct ud_session **p = &t->sessions[i];
+        while (*p) {
+            if ((*p)->last < older_than) ud_free(p);
+            else p = &(*p)->next;
         }
-        // repost for next chunk
-        if (ibv_post_recv(conn_id->qp, &wr, &bad)) { perror("ibv_post_recv"); exit(1); }
     }
+}
 
-    printf("[Server] File saved to received_file.bin (%" PRIu64 " bytes)\n", total);
-    close(fd);
+static void *ud_worker(void *arg) {
+    struct ud_thread *t = arg;
+    double next_sweep = now_sec() + 1.0;
+    int idle = 0;
+    struct usage u0;
+    usage_now(RUSAGE_THREAD, &u0);
+    while (!stop) {
+        struct ibv_wc wc[32];
+        int n = ibv_poll_cq(t->recv_cq, 32, wc);
+        if (n < 0) { fprintf(stderr, "ibv_poll_cq failed\n"); exit(1); }
+        for (int i = 0; i < n; i++) {
+            int slot = (int)wc[i].wr_id;
+            if (wc[i].status == IBV_WC_SUCCESS) ud_handle(t, &wc[i], t->buf + (size_t)slot * t->slot);
+            else fprintf(stderr, "[Server] UD recv failed: %s\n", ibv_wc_status_str(wc[i].status));
+            ud_post_recv(t, slot);
+        }
+        // spin while traffic flows, back off once the QP has been quiet for a while
+        if (n > 0) { idle = 0; continue; }
+        if (++idle > 4096) usleep(100);
+        double now = now_sec();
+        if (now >= next_sweep) {
+            // finished sessions linger so a repeated MSG_DONE still gets its result
+            ud_sweep(t, now - UD_IDLE_S);
+            next_sweep = now + 1.0;
+        }
+    }
+    ud_sweep(t, INFINITY);
+    t->usage = usage_since(&u0, RUSAGE_THREAD);
+    return NULL;
+}
+
+// all UD QPs live on the device of the first client; later clients are told their QP numbers round-robin
+static int ud_serve(int nthreads) {
+    struct rdma_event_channel *ec = rdma_create_event_channel();
+    struct rdma_cm_id *listen_id = NULL;
+    struct rdma_addrinfo hints = {.ai_flags = RAI_PASSIVE, .ai_port_space = RDMA_PS_UDP}, *res;
+    if (rdma_getaddrinfo(NULL, PORT, &hints, &res)) { perror("rdma_getaddrinfo"); exit(1); }
+    rdma_create_id(ec, &listen_id, NULL, RDMA_PS_UDP);
+    if (rdma_bind_addr(listen_id, res->ai_src_addr) || rdma_listen(listen_id, 64)) { perror("rdma_listen"); exit(1); }
+    rdma_freeaddrinfo(res);
+    printf("[Server] Listening on port %s (UD, %d QP%s)...\n", PORT, nthreads, nthreads == 1 ? "" : "s");
+    fflush(stdout);
+
+    ud = calloc((size_t)nthreads, sizeof(*ud));
+    if (!ud) { perror("calloc"); exit(1); }
+    int started = 0, next = 0;
+    while (!stop) {
+        struct pollfd pfd = {.fd = ec->fd, .events = POLLIN};
+        if (poll(&pfd, 1, 100) <= 0) continue;
+        struct rdma_cm_event *event;
+        if (rdma_get_cm_event(ec, &event)) { perror("rdma_get_cm_event"); exit(1); }
+        struct rdma_cm_id *id = event->id;
+        enum rdma_cm_event_type type = event->event;
+        rdma_ack_cm_event(event);
+        if (type != RDMA_CM_EVENT_CONNECT_REQUEST) continue;
+        if (!started) {
+            for (int i = 0; i < nthreads; i++) {
+                ud[i].index = i;
+                ud_thread_init(&ud[i], id->verbs, id->port_num);
+                if (pthread_create(&ud[i].thread, NULL, ud_worker, &ud[i]) != 0) { perror("pthread_create"); exit(1); }
+            }
+            started = 1;
+        }
+        if (id->verbs != ud[0].verbs) {
+            fprintf(stderr, "[Server] UD client arrived on another device; rejecting\n");
+            rdma_reject(id, NULL, 0);
+        } else {
+            struct rdma_conn_param param = {.qp_num = ud[next].qp->qp_num};
+            next = (next + 1) % nthreads;
+            if (rdma_accept(id, &param)) perror("rdma_accept");
+        }
+        rdma_destroy_id(id);
+    }
+
+    for (int i = 0; i < nthreads && started; i++) {
+        struct ud_thread *t = &ud[i];
+        pthread_join(t->thread, NULL);
+        printf("[Server] UD QP %d: %" PRIu64 " datagrams, %" PRIu64 " ACKs, %" PRIu64 " transfers\n",
+               i, t->datagrams, t->acks, t->sessions_done);
+        char what[32];
+        snprintf(what, sizeof(what), "UD QP %d thread", i);
+        print_usage(what, &t->usage);
+        ibv_destroy_qp(t->qp);
+        ibv_dereg_mr(t->mr);
+        ibv_destroy_cq(t->send_cq);
+        ibv_destroy_cq(t->recv_cq);
+        ibv_dealloc_pd(t->pd);
+        free(t->buf);
+    }
+    free(ud);
+    struct usage u;
+    usage_now(RUSAGE_SELF, &u);
+    print_usage("Process", &u);
+    rdma_destroy_id(listen_id);
+    rdma_destroy_event_channel(ec);
+    return 0;
+}
 
-    rdma_disconnect(conn_id);
-    rdma_destroy_qp(conn_id);
-    ibv_dereg_mr(mr);
-    free(buf);
-    rdma_destroy_id(conn_id);
+static void on_signal(int sig) { (void)sig; stop = 1; }
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--multi] [--ud [QPS]] [--conn-rate MBPS] [--tenant NAME:MBPS[:WEIGHT]]... "
+                    "[--credits N] [--small-threshold BYTES] [--srpt] [--unsched BYTES] [--overcommit N] "
+                    "[--qp-pool N] [--spin-us US] [--admin SOCKET]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *admin_path = NULL;
+    setvbuf(stdout, NULL, _IOLBF, 0);   // logs redirected to a file are read while the server runs
+    tenant_get("default");
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--multi") == 0) {
+            srv.multi = 1;
+        } else if (strcmp(argv[i], "--ud") == 0) {
+            srv.ud = i + 1 < argc && argv[i + 1][0] != '-' ? atoi(argv[++i]) : 1;
+            if (srv.ud < 1) usage(argv[0]);
+        } else if (strcmp(argv[i], "--conn-rate") == 0 && i + 1 < argc) {
+            srv.conn_rate = atof(argv[++i]) * 1e6;
+        } else if (strcmp(argv[i], "--credits") == 0 && i + 1 < argc) {
+            srv.pool = atoi(argv[++i]);
+            if (srv.pool < 1) usage(argv[0]);
+        } else if (strcmp(argv[i], "--spin-us") == 0 && i + 1 < argc) {
+            rx.spin = atof(argv[++i]) / 1e6;
+        } else if (strcmp(argv[i], "--admin") == 0 && i + 1 < argc) {
+            admin_path = argv[++i];
+        } else if (strcmp(argv[i], "--qp-pool") == 0 && i + 1 < argc) {
+            srv.qp_pool = atoi(argv[++i]);
+            if (srv.qp_pool < 0) usage(argv[0]);
+        } else if (strcmp(argv[i], "--srpt") == 0) {
+            srv.srpt = 1;
+        } else if (strcmp(argv[i], "--unsched") == 0 && i + 1 < argc) {
+            srv.unsched = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--overcommit") == 0 && i + 1 < argc) {
+            srv.overcommit = atoi(argv[++i]);
+            if (srv.overcommit < 1) usage(argv[0]);
+        } else if (strcmp(argv[i], "--small-threshold") == 0 && i + 1 < argc) {
+            srv.small_threshold = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--tenant") == 0 && i + 1 < argc) {
+            char spec[64], *save;
+            snprintf(spec, sizeof(spec), "%s", argv[++i]);
+            char *name = strtok_r(spec, ":", &save), *rate = strtok_r(NULL, ":", &save);
+            char *weight = strtok_r(NULL, ":", &save);
+            if (!name || !rate) usage(argv[0]);
+            struct tenant *t = tenant_get(name);
+            bucket_init(&t->tb, atof(rate) * 1e6);
+            if (weight) t->weight = atof(weight) > 0 ? atof(weight) : 1.0;
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    // UD sessions come and go on their own; the server runs until interrupted
+    if (srv.ud) {
+        srv.multi = 1;
+        return ud_serve(srv.ud);
+    }
+
+    struct rdma_event_channel *ec = rdma_create_event_channel();
+    struct rdma_cm_id *listen_id = NULL;
+    struct rdma_addrinfo hints = {}, *res;
+
+    hints.ai_flags = RAI_PASSIVE;
+    hints.ai_port_space = RDMA_PS_TCP;
+    if (rdma_getaddrinfo(NULL, PORT, &hints, &res)) { perror("rdma_getaddrinfo"); exit(1); }
+
+    // a connection storm should queue in the backlog, not be refused, while the QP pool lasts
+    rdma_create_id(ec, &listen_id, NULL, RDMA_PS_TCP);
+    int backlog = srv.qp_pool > 64 ? srv.qp_pool : 64;
+    if (rdma_bind_addr(listen_id, res->ai_src_addr) || rdma_listen(listen_id, backlog)) { perror("rdma_listen"); exit(1); }
+    rdma_freeaddrinfo(res);
+    printf("[Server] Listening on port %s...\n", PORT);
+    rx.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (rx.epfd < 0) { perror("epoll_create1"); exit(1); }
+    reactor_add(ec->fd, SRC_CM, NULL);
+    int admin_fd = admin_path ? admin_listen(admin_path) : -1;
+    devs_prepare();
+    for (int i = 0; i < srv.num_tenants; i++)
+        if (srv.tenants[i].tb.rate > 0 || srv.tenants[i].weight != 1.0)
+            printf("[Server] Tenant %s: %.1f MB/s, weight %.2f\n", srv.tenants[i].name,
+                   srv.tenants[i].tb.rate / 1e6, srv.tenants[i].weight);
+    if (srv.srpt)
+        printf("[Server] SRPT grants: %" PRIu64 " unscheduled bytes per transfer, overcommit %d\n",
+               srv.unsched, srv.overcommit);
+
+    reactor_run(ec, admin_fd);
+
+    if (srv.multi) print_class_stats();
+    printf("[Server] Reactor: %" PRIu64 " loop passes, %" PRIu64 " sleeps, %" PRIu64 " wakeups, %.3f s busy\n",
+           rx.loops, rx.sleeps, rx.wakeups, rx.busy_s);
+    if (srv.srpt)
+        printf("[Server] SRPT: %" PRIu64 " unscheduled and %" PRIu64 " scheduled credits granted\n",
+               srv.grants_unsched, srv.grants_sched);
+    if (srv.accepts)
+        printf("[Server] %" PRIu64 " connections accepted, mean %.0f us, max %.0f us, %" PRIu64 " QPs created on demand\n",
+               srv.accepts, srv.accept_s / srv.accepts * 1e6, srv.accept_max * 1e6, srv.pool_misses);
+    struct usage u;
+    usage_now(RUSAGE_SELF, &u);
+    print_usage("Process", &u);
+    while (srv.conns) {
+        rdma_disconnect(srv.conns->id);
+        conn_destroy(srv.conns);
+    }
+    devs_release();
+    if (admin_fd >= 0) {
+        close(admin_fd);
+        unlink(admin_path);
+    }
+    close(rx.epfd);
     rdma_destroy_id(listen_id);
     rdma_destroy_event_channel(ec);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,99 @@
+// rdma_gen_data.c -- write synthetic test files (see datagen.h for the profiles)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include "datagen.h"
+
+#define GEN_SPAN (256 * DATAGEN_BLOCK)  // bytes generated per pwrite
+
+struct gen_worker {
+    pthread_t tid;
+    const struct datagen *g;
+    int fd;
+    uint64_t begin, end;    // byte range owned by this thread
+};
+
+static int all_zero(const uint8_t *p, size_t n) {
+    for (size_t i = 0; i < n; i++) if (p[i]) return 0;
+    return 1;
+}
+
+static void *gen_thread(void *arg) {
+    struct gen_worker *w = arg;
+    uint8_t *buf = malloc(GEN_SPAN);
+    if (!buf) { perror("malloc"); exit(1); }
+    for (uint64_t off = w->begin; off < w->end; off += GEN_SPAN) {
+        size_t n = w->end - off < GEN_SPAN ? (size_t)(w->end - off) : GEN_SPAN;
+        datagen_fill(w->g, off, buf, n);
+        // leave zero blocks unwritten so zeros/sparse profiles produce real holes
+        for (size_t b = 0; b < n; b += DATAGEN_BLOCK) {
+            size_t bn = n - b < DATAGEN_BLOCK ? n - b : DATAGEN_BLOCK;
+            if (all_zero(buf + b, bn)) continue;
+            size_t run = bn;
+            while (b + run < n && !all_zero(buf + b + run, n - b - run < DATAGEN_BLOCK ? n - b - run : DATAGEN_BLOCK))
+                run += n - b - run < DATAGEN_BLOCK ? n - b - run : DATAGEN_BLOCK;
+            if (pwrite(w->fd, buf + b, run, (off_t)(off + b)) != (ssize_t)run) { perror("pwrite"); exit(1); }
+            b += run - bn;
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <output> <size> [--profile random|text|zeros|sparse] "
+                        "[--compress FRACTION] [--dup FRACTION] [--seed N] [--threads N]\n", argv[0]);
+        return 1;
+    }
+    struct datagen g = {.profile = DG_RANDOM, .seed = 0x5D1F00D5ULL};
+    uint64_t size = datagen_parse_size(argv[2]);
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 3; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--profile") == 0) {
+            if (datagen_parse_profile(argv[i + 1], &g.profile) != 0) {
+                fprintf(stderr, "unknown profile %s\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--compress") == 0) g.compressibility = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--dup") == 0) g.dup_ratio = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--seed") == 0) g.seed = strtoull(argv[i + 1], NULL, 0);
+        else if (strcmp(argv[i], "--threads") == 0) threads = atol(argv[i + 1]);
+        else { fprintf(stderr, "unknown option %s\n", argv[i]); return 1; }
+    }
+    if (threads < 1) threads = 1;
+    if (threads > 64) threads = 64;
+
+    int fd = open(argv[1], O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) { perror("open"); return 1; }
+    if (ftruncate(fd, (off_t)size) != 0) { perror("ftruncate"); return 1; }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    // split on GEN_SPAN boundaries so threads never share a block
+    uint64_t spans = (size + GEN_SPAN - 1) / GEN_SPAN;
+    if ((uint64_t)threads > spans) threads = spans ? (long)spans : 1;
+    struct gen_worker w[64];
+    for (long t = 0; t < threads; t++) {
+        w[t].g = &g;
+        w[t].fd = fd;
+        w[t].begin = spans * t / threads * GEN_SPAN;
+        w[t].end = spans * (t + 1) / threads * GEN_SPAN;
+        if (w[t].end > size) w[t].end = size;
+        if (pthread_create(&w[t].tid, NULL, gen_thread, &w[t]) != 0) { perror("pthread_create"); return 1; }
+    }
+    for (long t = 0; t < threads; t++) pthread_join(w[t].tid, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    close(fd);
+
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("[Gen] Wrote %s (%" PRIu64 " bytes, profile=%s, compress=%.2f, dup=%.2f) in %.3f s (%.1f MB/s, %ld threads)\n",
+           argv[1], size, datagen_profile_name(g.profile), g.compressibility, g.dup_ratio,
+           secs, secs > 0 ? size / secs / (1024 * 1024) : 0.0, threads);
+    return 0;
+}
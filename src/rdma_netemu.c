@@ -0,0 +1,374 @@
+// rdma_netemu.c -- the transfer protocol over an emulated link (netemu.h)
+//
+// Runs the client and server halves of an RC SEND transfer -- file header,
+// MSG_DATA under receive credits, MSG_DONE, the result -- over the emulated
+// transport and sweeps the sender's window and the server's credit depth.
+// No RDMA device or rdma-core is needed, and with the virtual clock every
+// run is reproducible, so window sizes, window autotuning and flow control
+// can be compared on any Linux box.
+#define _GNU_SOURCE
+#define RDMA_COMMON_NO_VERBS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "rdma_common.h"
+#include "datagen.h"
+#include "netemu.h"
+
+#define MAX_WINDOW 256
+#define MAX_LIST 16
+#define MAX_REPLIES 4       // answers that may be in flight besides credits, as in rdma_file_client
+#define TUNE_EPOCH 64       // send completions per autotuning measurement, at least
+
+struct sim_cfg {
+    uint64_t size;
+    uint32_t msg;           // payload bytes per MSG_DATA
+    int window;             // sends in flight; 0: autotune
+    int credits;            // receives the server keeps posted
+    int use_credits;        // 0: ignore credits and let RNR NAKs pace the sender
+    double server_us;       // server CPU per MSG_DATA, e.g. the pwrite
+};
+
+struct sim_result {
+    double elapsed;
+    int window;             // the autotuned window, or the fixed one
+    double credit_wait;
+    uint64_t credit_msgs, rnr_naks, retransmits, drops;
+    const char *error;
+};
+
+struct sender {
+    struct emu_net *net;
+    const struct sim_cfg *cfg;
+    struct emu_qp qp;
+    struct emu_cq scq, rcq;
+    char *sbuf, *rbuf;
+    size_t slot;
+    int credits, outstanding, window;
+    uint64_t next_off, posted;
+    int hdr_sent, done_sent, done;
+    double wait_since, credit_wait;
+    // autotuning: double the window while each doubling still pays
+    int settled, epoch_n;
+    double epoch_t0, epoch_bytes, best_rate;
+};
+
+struct receiver {
+    struct emu_net *net;
+    const struct sim_cfg *cfg;
+    struct emu_qp qp;
+    struct emu_cq scq, rcq;
+    char *rbuf, *reply;
+    size_t slot;
+    int granted;            // credits the client holds or has spent on messages not yet processed
+    int replies_out;
+    uint64_t replies;
+    int busy;
+    double busy_until;
+    uint64_t cur_slot;
+    uint8_t cur_type;
+    uint64_t bytes;
+    uint64_t credit_msgs;
+};
+
+static void *xcalloc(size_t n, size_t size) {
+    void *p = calloc(n, size);
+    if (!p) { perror("calloc"); exit(1); }
+    return p;
+}
+
+static int reply_slots(const struct sim_cfg *cfg) { return cfg->credits + MAX_REPLIES; }
+
+static void receiver_reply(struct receiver *r, uint8_t type, const void *payload, uint32_t len) {
+    char *b = r->reply + (r->replies++ % (uint64_t)reply_slots(r->cfg)) * MSG_BUF_SIZE;
+    msg_hdr_set((struct msg_hdr *)b, type, 0, len, 0);
+    memcpy(b + sizeof(struct msg_hdr), payload, len);
+    if (emu_post_send(&r->qp, type, EMU_WR_SEND, b, (uint32_t)sizeof(struct msg_hdr) + len, NULL)) {
+        fprintf(stderr, "[Emu] server send queue full\n");
+        exit(1);
+    }
+    r->replies_out++;
+}
+
+// the message in cur_slot is processed: its receive goes back and, like the
+// server's schedule_credits, every free receive becomes a credit
+static void receiver_finish(struct receiver *r) {
+    r->busy = 0;
+    emu_post_recv(&r->qp, r->cur_slot, r->rbuf + r->cur_slot * r->slot, (uint32_t)r->slot);
+    r->granted--;
+    if (r->cur_type == MSG_DONE) {
+        uint64_t n = htonll(r->bytes);
+        receiver_reply(r, MSG_RESULT, &n, sizeof(n));
+        return;
+    }
+    int grant = r->cfg->credits - r->granted;
+    if (!r->cfg->use_credits || grant <= 0) return;
+    uint32_t n = htonl((uint32_t)grant);
+    receiver_reply(r, MSG_CREDIT, &n, sizeof(n));
+    r->granted += grant;
+    r->credit_msgs++;
+}
+
+static int receiver_step(struct receiver *r, struct sim_result *res) {
+    struct emu_wc wc[16];
+    int progress = 0, n = emu_poll_cq(r->net, &r->scq, 16, wc);
+    for (int i = 0; i < n; i++, progress = 1) {
+        if (wc[i].status != EMU_WC_SUCCESS) { res->error = emu_wc_status_str(wc[i].status); return 1; }
+        r->replies_out--;
+    }
+    if (r->busy && emu_now(r->net) >= r->busy_until) {
+        receiver_finish(r);
+        progress = 1;
+    }
+    // one message at a time, like the server's single thread; the rest wait in the CQ
+    if (r->busy || r->replies_out >= reply_slots(r->cfg) || emu_poll_cq(r->net, &r->rcq, 1, wc) == 0) return progress;
+    if (wc[0].status != EMU_WC_SUCCESS) { res->error = emu_wc_status_str(wc[0].status); return 1; }
+    const struct msg_hdr *h = (const struct msg_hdr *)(r->rbuf + wc[0].wr_id * r->slot);
+    r->cur_slot = wc[0].wr_id;
+    r->cur_type = h->type;
+    r->busy = 1;
+    r->busy_until = emu_now(r->net);
+    if (h->type == MSG_DATA) {
+        r->bytes += ntohl(h->len);
+        r->busy_until += r->cfg->server_us / 1e6;
+    }
+    if (r->busy_until > emu_now(r->net)) emu_wake_at(r->net, r->busy_until);
+    else receiver_finish(r);
+    return 1;
+}
+
+static void sender_tune(struct sender *s, uint32_t bytes) {
+    if (s->cfg->window || s->settled) return;
+    s->epoch_bytes += bytes;
+    int epoch = s->window * 4 > TUNE_EPOCH ? s->window * 4 : TUNE_EPOCH;
+    if (++s->epoch_n < epoch) return;
+    double now = emu_now(s->net), rate = s->epoch_bytes / (now - s->epoch_t0);
+    if (rate > s->best_rate * 1.05 && s->window < MAX_WINDOW) {
+        s->best_rate = rate;
+        s->window *= 2;
+    } else {
+        // the last doubling bought nothing: keep the smaller window
+        if (rate <= s->best_rate * 1.05 && s->window > 1) s->window /= 2;
+        s->settled = 1;
+    }
+    s->epoch_n = 0;
+    s->epoch_bytes = 0;
+    s->epoch_t0 = now;
+}
+
+static int sender_step(struct sender *s, struct sim_result *res) {
+    struct emu_wc wc[32];
+    int progress = 0, n = emu_poll_cq(s->net, &s->scq, 32, wc);
+    for (int i = 0; i < n; i++, progress = 1) {
+        if (wc[i].status != EMU_WC_SUCCESS) { res->error = emu_wc_status_str(wc[i].status); return 1; }
+        s->outstanding--;
+        if (wc[i].wr_id == MSG_DATA) sender_tune(s, wc[i].byte_len);
+    }
+    n = emu_poll_cq(s->net, &s->rcq, 32, wc);
+    for (int i = 0; i < n; i++, progress = 1) {
+        if (wc[i].status != EMU_WC_SUCCESS) { res->error = emu_wc_status_str(wc[i].status); return 1; }
+        char *b = s->rbuf + wc[i].wr_id * MSG_BUF_SIZE;
+        const struct msg_hdr *h = (const struct msg_hdr *)b;
+        if (h->type == MSG_CREDIT) {
+            uint32_t c;
+            memcpy(&c, h + 1, sizeof(c));
+            s->credits += (int)ntohl(c);
+        } else if (h->type == MSG_RESULT) {
+            s->done = 1;
+        }
+        emu_post_recv(&s->qp, wc[i].wr_id, b, MSG_BUF_SIZE);
+    }
+
+    while (s->outstanding < s->window) {
+        uint8_t type;
+        uint32_t len = 0;
+        if (!s->hdr_sent) type = MSG_FILE_HDR;
+        else if (s->next_off < s->cfg->size) type = MSG_DATA;
+        else if (!s->done_sent) type = MSG_DONE;
+        else break;
+        double now = emu_now(s->net);
+        if (s->cfg->use_credits && s->credits == 0) {
+            if (s->wait_since == 0) s->wait_since = now;
+            break;
+        }
+        if (s->wait_since != 0) {
+            s->credit_wait += now - s->wait_since;
+            s->wait_since = 0;
+        }
+        if (type == MSG_DATA) {
+            uint64_t left = s->cfg->size - s->next_off;
+            len = left < s->cfg->msg ? (uint32_t)left : s->cfg->msg;
+        }
+        // a slot is free again once its send completed, and sends complete in order
+        char *b = s->sbuf + (s->posted % MAX_WINDOW) * s->slot;
+        msg_hdr_set((struct msg_hdr *)b, type, 0, len, type == MSG_FILE_HDR ? s->cfg->size : s->next_off);
+        if (emu_post_send(&s->qp, type, EMU_WR_SEND, b, (uint32_t)sizeof(struct msg_hdr) + len, NULL)) break;
+        if (s->cfg->use_credits) s->credits--;
+        s->outstanding++;
+        s->posted++;
+        if (type == MSG_FILE_HDR) s->hdr_sent = 1;
+        else if (type == MSG_DATA) s->next_off += len;
+        else s->done_sent = 1;
+        progress = 1;
+    }
+    return progress;
+}
+
+static void run(const struct emu_link *link_cfg, enum emu_clock clock, uint64_t seed,
+                const struct sim_cfg *cfg, struct sim_result *res) {
+    struct emu_link link = *link_cfg;
+    uint32_t depth = (uint32_t)reply_slots(cfg);
+    link.max_send_wr = depth > MAX_WINDOW ? depth : MAX_WINDOW;
+    link.max_recv_wr = depth;
+    struct emu_net net;
+    struct sender s = {.net = &net, .cfg = cfg, .credits = 1, .window = cfg->window ? cfg->window : 1};
+    struct receiver r = {.net = &net, .cfg = cfg, .granted = 1};
+    if (emu_net_init(&net, &link, clock, seed) || emu_cq_init(&s.scq, MAX_WINDOW) || emu_cq_init(&s.rcq, (int)depth) ||
+        emu_cq_init(&r.scq, (int)depth) || emu_cq_init(&r.rcq, cfg->credits) ||
+        emu_qp_init(&s.qp, &net, &s.scq, &s.rcq) || emu_qp_init(&r.qp, &net, &r.scq, &r.rcq)) {
+        perror("netemu setup");
+        exit(1);
+    }
+    emu_connect(&s.qp, &r.qp);
+    s.slot = r.slot = sizeof(struct msg_hdr) + cfg->msg;
+    s.sbuf = xcalloc(MAX_WINDOW, s.slot);
+    s.rbuf = xcalloc(depth, MSG_BUF_SIZE);
+    r.rbuf = xcalloc((size_t)cfg->credits, r.slot);
+    r.reply = xcalloc(depth, MSG_BUF_SIZE);
+    for (uint32_t i = 0; i < depth; i++) emu_post_recv(&s.qp, i, s.rbuf + i * MSG_BUF_SIZE, MSG_BUF_SIZE);
+    for (int i = 0; i < cfg->credits; i++) emu_post_recv(&r.qp, (uint64_t)i, r.rbuf + (size_t)i * r.slot, (uint32_t)r.slot);
+
+    memset(res, 0, sizeof(*res));
+    double t0 = emu_now(&net);
+    s.epoch_t0 = t0;
+    while (!s.done && !res->error) {
+        int progress = sender_step(&s, res);
+        progress |= receiver_step(&r, res);
+        if (!progress && emu_step(&net) < 0) res->error = "stalled: no event pending";
+    }
+    res->elapsed = emu_now(&net) - t0;
+    res->window = s.window;
+    res->credit_wait = s.credit_wait;
+    res->credit_msgs = r.credit_msgs;
+    res->rnr_naks = s.qp.stats.rnr_naks + r.qp.stats.rnr_naks;
+    res->retransmits = s.qp.stats.retransmits + r.qp.stats.retransmits;
+    res->drops = s.qp.stats.drops + r.qp.stats.drops;
+
+    free(s.sbuf);
+    free(s.rbuf);
+    free(r.rbuf);
+    free(r.reply);
+    emu_qp_destroy(&s.qp);
+    emu_qp_destroy(&r.qp);
+    emu_cq_destroy(&s.scq);
+    emu_cq_destroy(&s.rcq);
+    emu_cq_destroy(&r.scq);
+    emu_cq_destroy(&r.rcq);
+    emu_net_destroy(&net);
+}
+
+// "1,2,4" or, where auto_ok, "auto" (stored as 0)
+static int parse_list(const char *s, int *out, int auto_ok) {
+    int n = 0;
+    char *copy = strdup(s), *save = NULL;
+    for (char *tok = strtok_r(copy, ",", &save); tok && n < MAX_LIST; tok = strtok_r(NULL, ",", &save)) {
+        int is_auto = auto_ok && strcmp(tok, "auto") == 0, v = is_auto ? 0 : atoi(tok);
+        if ((v <= 0 && !is_auto) || v > MAX_WINDOW) { n = -1; break; }
+        out[n++] = v;
+    }
+    free(copy);
+    return n;
+}
+
+int main(int argc, char **argv) {
+    struct emu_link link = emu_link_default();
+    struct sim_cfg cfg = {.size = 100ULL << 20, .msg = BUF_SIZE, .use_credits = 1, .server_us = 0.5};
+    int windows[MAX_LIST] = {1}, credits[MAX_LIST] = {RECV_DEPTH}, nw = 1, nc = 1;
+    enum emu_clock clock = EMU_CLOCK_VIRTUAL;
+    uint64_t seed = 1;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i], *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(a, "--no-credits") == 0) { cfg.use_credits = 0; continue; }
+        if (!v) { fprintf(stderr, "[Emu] Ignoring option %s without a value\n", a); continue; }
+        i++;
+        if (strcmp(a, "--size") == 0) cfg.size = datagen_parse_size(v);
+        else if (strcmp(a, "--msg") == 0) cfg.msg = (uint32_t)datagen_parse_size(v);
+        else if (strcmp(a, "--window") == 0) nw = parse_list(v, windows, 1);
+        else if (strcmp(a, "--credits") == 0) nc = parse_list(v, credits, 0);
+        else if (strcmp(a, "--server-us") == 0) cfg.server_us = atof(v);
+        else if (strcmp(a, "--gbps") == 0) link.gbps = atof(v);
+        else if (strcmp(a, "--lat-us") == 0) link.latency_us = atof(v);
+        else if (strcmp(a, "--jitter-us") == 0) link.jitter_us = atof(v);
+        else if (strcmp(a, "--loss") == 0) link.loss = atof(v);
+        else if (strcmp(a, "--timeout-us") == 0) link.timeout_us = atof(v);
+        else if (strcmp(a, "--retry") == 0) link.retry_cnt = atoi(v);
+        else if (strcmp(a, "--rnr-us") == 0) link.rnr_timer_us = atof(v);
+        else if (strcmp(a, "--rnr-retry") == 0) link.rnr_retry = atoi(v);
+        else if (strcmp(a, "--queue-kb") == 0) link.queue_bytes = (size_t)atol(v) << 10;
+        else if (strcmp(a, "--mtu") == 0) link.mtu = (uint32_t)atoi(v);
+        else if (strcmp(a, "--seed") == 0) seed = strtoull(v, NULL, 0);
+        else if (strcmp(a, "--clock") == 0) clock = strcmp(v, "real") == 0 ? EMU_CLOCK_REAL : EMU_CLOCK_VIRTUAL;
+        else fprintf(stderr, "[Emu] Ignoring unknown option %s\n", a);
+    }
+    if (nw <= 0 || nc <= 0 || cfg.size == 0 || cfg.msg == 0 || cfg.msg > (1u << 20) || link.gbps <= 0 || link.mtu == 0) {
+        fprintf(stderr, "Usage: %s [--size BYTES] [--msg BYTES] [--window N,...|auto] [--credits N,...] [--no-credits] "
+                "[--server-us US] [--gbps G] [--lat-us US] [--jitter-us US] [--loss P] [--timeout-us US] [--retry N] "
+                "[--rnr-us US] [--rnr-retry N] [--queue-kb KB] [--mtu BYTES] [--clock virtual|real] [--seed N]\n", argv[0]);
+        return 1;
+    }
+
+    printf("[Emu] Link: %.1f Gbit/s, %.2f us one way, jitter %.2f us, loss %g, queue %s, %s clock, seed %" PRIu64 "\n",
+           link.gbps, link.latency_us, link.jitter_us, link.loss, link.queue_bytes ? "bounded" : "unbounded",
+           clock == EMU_CLOCK_VIRTUAL ? "virtual" : "real", seed);
+    printf("[Emu] Transfer: %.1f MiB in %u-byte messages, server %.2f us per message, %s\n", cfg.size / 1048576.0,
+           cfg.msg, cfg.server_us, cfg.use_credits ? "credit flow control" : "no flow control (RNR-paced)");
+
+    size_t cap = (size_t)nw * nc * 512 + 1, used = 0;
+    char *runs = xcalloc(1, cap);
+    int failed = 0;
+    for (int w = 0; w < nw; w++) {
+        for (int c = 0; c < nc; c++) {
+            struct sim_cfg rc = cfg;
+            struct sim_result res;
+            rc.window = windows[w];
+            rc.credits = credits[c];
+            run(&link, clock, seed, &rc, &res);
+            // a failed run moved less than the whole size, so it has no throughput
+            double gbps = !res.error && res.elapsed > 0 ? cfg.size * 8 / res.elapsed / 1e9 : 0;
+            char gbps_json[32] = "null", util_json[32] = "null";
+            if (!res.error) {
+                snprintf(gbps_json, sizeof(gbps_json), "%.3f", gbps);
+                snprintf(util_json, sizeof(util_json), "%.4f", gbps / link.gbps);
+            }
+            char wname[16];
+            if (rc.window) snprintf(wname, sizeof(wname), "%d", rc.window);
+            else snprintf(wname, sizeof(wname), "auto->%d", res.window);
+            if (res.error) {
+                failed++;
+                printf("[Emu] window %s, credits %d: failed after %.3f ms: %s\n", wname, rc.credits, res.elapsed * 1e3, res.error);
+            } else {
+                printf("[Emu] window %s, credits %d: %.3f ms, %.2f Gbit/s (%.1f%% of link), credit wait %.3f ms, "
+                       "%" PRIu64 " credit messages, %" PRIu64 " RNR NAKs, %" PRIu64 " retransmits\n", wname, rc.credits,
+                       res.elapsed * 1e3, gbps, 100 * gbps / link.gbps, res.credit_wait * 1e3, res.credit_msgs,
+                       res.rnr_naks, res.retransmits);
+            }
+            used += (size_t)snprintf(runs + used, cap - used, "%s{\"window\": %d, \"autotuned\": %s, \"credits\": %d, "
+                                     "\"elapsed_s\": %.9f, \"gbps\": %s, \"link_util\": %s, \"credit_wait_s\": %.9f, "
+                                     "\"credit_msgs\": %" PRIu64 ", \"rnr_naks\": %" PRIu64 ", \"retransmits\": %" PRIu64 ", "
+                                     "\"drops\": %" PRIu64 ", \"error\": %s%s%s}", used ? ", " : "", res.window,
+                                     rc.window ? "false" : "true", rc.credits, res.elapsed, gbps_json, util_json,
+                                     res.credit_wait, res.credit_msgs, res.rnr_naks, res.retransmits, res.drops,
+                                     res.error ? "\"" : "", res.error ? res.error : "null", res.error ? "\"" : "");
+        }
+    }
+    printf("RESULT {\"link\": {\"gbps\": %.3f, \"latency_us\": %.3f, \"jitter_us\": %.3f, \"loss\": %g, \"timeout_us\": %.3f, "
+           "\"retry\": %d, \"rnr_timer_us\": %.3f, \"rnr_retry\": %d, \"queue_bytes\": %zu, \"mtu\": %u}, "
+           "\"clock\": \"%s\", \"seed\": %" PRIu64 ", \"size\": %" PRIu64 ", \"msg\": %u, \"server_us\": %.3f, "
+           "\"flow_control\": \"%s\", \"runs\": [%s]}\n", link.gbps, link.latency_us, link.jitter_us, link.loss,
+           link.timeout_us, link.retry_cnt, link.rnr_timer_us, link.rnr_retry, link.queue_bytes, link.mtu,
+           clock == EMU_CLOCK_VIRTUAL ? "virtual" : "real", seed, cfg.size, cfg.msg, cfg.server_us,
+           cfg.use_credits ? "credits" : "none", runs);
+    free(runs);
+    return failed ? 2 : 0;
+}
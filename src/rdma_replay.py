@@ -0,0 +1,227 @@
+#!/usr/bin/env python3
+# rdma_replay.py -- trace-driven workload replay against rdma_file_server
+#
+# Arrivals are open loop: every transfer starts at its trace timestamp
+# whether or not earlier ones have finished, and its completion time is
+# measured from that timestamp, so queueing anywhere (including in this
+# driver) is counted. A client's transfers run one after another on the
+# in-process engine; different clients run in parallel. The workload is a
+# trace of "timestamp_s size client_id" lines, or Poisson arrivals with
+# sizes drawn from a distribution, optionally fitted to a trace.
+
+import argparse
+import csv
+import ctypes
+import json
+import math
+import os
+import queue
+import random
+import statistics
+import sys
+import threading
+import time
+
+from rdma_engine import load_engine, EngineError
+from rdma_results import parse_size, percentile, record
+
+BASE_DIR = os.path.dirname(os.path.abspath(__file__))
+
+# completion times are reported per size bucket; upper bounds in bytes
+BUCKETS = [("<=4K", 4 << 10), ("4K-64K", 64 << 10), ("64K-1M", 1 << 20), ("1M-16M", 16 << 20),
+           ("16M-256M", 256 << 20), (">256M", float("inf"))]
+
+
+def load_trace(path):
+    """[(t, size, client)] from "timestamp_s size client_id" lines (spaces or commas), starting at t = 0."""
+    records = []
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.split("#", 1)[0].replace(",", " ").split()
+            if not line:
+                continue
+            if len(line) < 2:
+                sys.exit(f"[Replay] {path}:{lineno}: want timestamp size [client]")
+            records.append((float(line[0]), max(1, parse_size(line[1])), line[2] if len(line) > 2 else "0"))
+    records.sort(key=lambda r: r[0])
+    t0 = records[0][0] if records else 0.0
+    return [(t - t0, size, client) for t, size, client in records]
+
+
+def fit_lognormal(records):
+    """mu, sigma of log sizes and the mean arrival rate of a trace."""
+    logs = [math.log(size) for _, size, _ in records]
+    span = records[-1][0] - records[0][0] if len(records) > 1 else 0.0
+    return statistics.fmean(logs), statistics.pstdev(logs), (len(records) - 1) / span if span > 0 else 1.0
+
+
+def synthesize(dist, rate, count, duration, clients, seed):
+    """Poisson arrivals at rate per second, count of them or up to duration seconds;
+    dist is lognormal:MU,SIGMA (of ln bytes) or pareto:ALPHA,XMIN."""
+    kind, _, params = dist.partition(":")
+    a, b = (params.split(",") + ["", ""])[:2]
+    rng = random.Random(seed)
+    if kind == "lognormal":
+        draw = lambda: rng.lognormvariate(float(a), float(b))
+    elif kind == "pareto":
+        xmin = parse_size(b)
+        draw = lambda: xmin * rng.paretovariate(float(a))
+    else:
+        sys.exit(f"[Replay] unknown distribution {dist}")
+    t, records = 0.0, []
+    while (t < duration) if duration else (len(records) < count):
+        records.append((t, max(1, int(draw())), str(rng.randrange(clients))))
+        t += rng.expovariate(rate)
+    return records
+
+
+class Client(threading.Thread):
+    """One client id: its transfers, one at a time, each started no earlier than its arrival."""
+
+    def __init__(self, engine, server, out):
+        super().__init__(daemon=True)
+        self.engine = engine
+        self.server = server
+        self.out = out
+        self.q = queue.Queue()
+
+    def run(self):
+        while (item := self.q.get()) is not None:
+            arrival, size, client = item
+            start = time.perf_counter()
+            try:
+                result, error = self.engine.send_file(self.server, f"gen:{size}"), None
+            except EngineError as e:
+                result, error = None, str(e)
+            self.out.append((arrival, start, time.perf_counter(), size, client, result, error))
+
+
+def replay(engine, server, records, speed):
+    out = []
+    clients = {}
+    for _, _, client in records:
+        if client not in clients:
+            clients[client] = Client(engine, server, out)
+            clients[client].start()
+    t0 = time.perf_counter() + 0.1
+    for t, size, client in records:
+        arrival = t0 + t / speed
+        delay = arrival - time.perf_counter()
+        if delay > 0:
+            time.sleep(delay)
+        clients[client].q.put((arrival, size, client))
+    for c in clients.values():
+        c.q.put(None)
+    for c in clients.values():
+        c.join()
+    return out, t0
+
+
+def bucket_of(size):
+    for name, upper in BUCKETS:
+        if size <= upper:
+            return name
+
+
+def summarize(out, t0):
+    ok = [r for r in out if r[5] and not r[6]]
+    buckets = []
+    for name, _ in BUCKETS:
+        rs = [r for r in ok if bucket_of(r[3]) == name]
+        if not rs:
+            continue
+        ct = sorted(end - arrival for arrival, _, end, *_ in rs)
+        # slowdown: completion time over the transfer's own data-phase time
+        sd = sorted((end - arrival) / max(result["elapsed_s"], 1e-9) for arrival, _, end, _, _, result, _ in rs)
+        buckets.append({"bucket": name, "count": len(rs), "mean_s": statistics.fmean(ct),
+                        "p50_s": percentile(ct, 50), "p95_s": percentile(ct, 95), "p99_s": percentile(ct, 99),
+                        "max_s": ct[-1], "mean_slowdown": statistics.fmean(sd), "p99_slowdown": percentile(sd, 99)})
+    lag = sorted(start - arrival for arrival, start, *_ in out)
+    span = max((r[2] for r in out), default=t0) - t0
+    total = sum(r[3] for r in ok)
+    return {"arrivals": len(out), "completed": len(ok), "failed": len(out) - len(ok),
+            "span_s": span, "achieved_gbps": total * 8 / span / 1e9 if span > 0 else 0.0,
+            "start_lag_p50_s": percentile(lag, 50), "start_lag_p99_s": percentile(lag, 99), "buckets": buckets}
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Open-loop trace replay against rdma_file_server")
+    ap.add_argument("server", nargs="?", default="127.0.0.1")
+    ap.add_argument("--trace", help='file of "timestamp_s size client_id" lines')
+    ap.add_argument("--dist", help="lognormal:MU,SIGMA | pareto:ALPHA,XMIN | fit (lognormal fitted to --trace)")
+    ap.add_argument("--rate", type=float, help="arrivals per second for --dist (fit: the trace's rate)")
+    ap.add_argument("--count", type=int, default=1000, help="arrivals for --dist")
+    ap.add_argument("--duration", type=float, help="seconds of arrivals for --dist, instead of --count")
+    ap.add_argument("--clients", type=int, default=8, help="client ids for --dist")
+    ap.add_argument("--speed", type=float, default=1.0, help="replay faster (>1) or slower than recorded")
+    ap.add_argument("--seed", type=int, default=1)
+    ap.add_argument("--out", help="write one CSV row per transfer here")
+    ap.add_argument("--no-store", action="store_true", help="do not append the results to the result store")
+    args = ap.parse_args()
+
+    engine = load_engine()
+    if not engine:
+        sys.exit("[Replay] needs librdma_engine.so (see README, Python binding)")
+    if args.dist:
+        dist, rate = args.dist, args.rate
+        if dist == "fit":
+            if not args.trace:
+                sys.exit("[Replay] --dist fit needs --trace")
+            mu, sigma, trace_rate = fit_lognormal(load_trace(args.trace))
+            dist, rate = f"lognormal:{mu},{sigma}", rate or trace_rate
+            print(f"[Replay] Fitted lognormal mu {mu:.3f}, sigma {sigma:.3f} at {rate:.1f} arrivals/s")
+        records = synthesize(dist, rate or 10.0, args.count, args.duration, args.clients, args.seed)
+    elif args.trace:
+        records = load_trace(args.trace)
+    else:
+        sys.exit("[Replay] give --trace or --dist")
+    if not records:
+        sys.exit("[Replay] empty workload")
+
+    offered = sum(r[1] for r in records)
+    duration = records[-1][0] / args.speed
+    print(f"[Replay] {len(records)} arrivals from {len({r[2] for r in records})} clients over {duration:.2f} s, "
+          f"{offered / (1 << 20):.1f} MiB offered ({offered * 8 / max(duration, 1e-9) / 1e9:.3f} Gbit/s)")
+
+    # the engine's per-transfer output goes to a log rather than drowning the summary
+    log = os.path.join(BASE_DIR, "logs", "rdma_replay_client.log")
+    os.makedirs(os.path.dirname(log), exist_ok=True)
+    sys.stdout.flush()
+    saved = os.dup(1)
+    with open(log, "w") as f:
+        os.dup2(f.fileno(), 1)
+        try:
+            out, t0 = replay(engine, args.server, records, args.speed)
+        finally:
+            ctypes.CDLL(None).fflush(None)
+            os.dup2(saved, 1)
+            os.close(saved)
+
+    summary = summarize(out, t0)
+    for b in summary["buckets"]:
+        print(f"[Replay] {b['bucket']:>9}: {b['count']:5d} transfers, completion p50 {b['p50_s'] * 1e3:9.2f} ms, "
+              f"p99 {b['p99_s'] * 1e3:9.2f} ms, max {b['max_s'] * 1e3:9.2f} ms, "
+              f"slowdown mean {b['mean_slowdown']:.2f} / p99 {b['p99_slowdown']:.2f}")
+    print(f"[Replay] {summary['completed']} completed, {summary['failed']} failed in {summary['span_s']:.2f} s "
+          f"({summary['achieved_gbps']:.3f} Gbit/s); start lag p99 {summary['start_lag_p99_s'] * 1e3:.2f} ms")
+    if args.out:
+        with open(args.out, "w", newline="") as f:
+            w = csv.writer(f)
+            w.writerow(["arrival_s", "start_s", "end_s", "size", "client", "elapsed_s", "error"])
+            for arrival, start, end, size, client, result, error in sorted(out):
+                w.writerow([f"{arrival - t0:.6f}", f"{start - t0:.6f}", f"{end - t0:.6f}", size, client,
+                            f"{result['elapsed_s']:.6f}" if result else "", error or ""])
+    if not args.no_store and summary["completed"]:
+        workload = f"dist/{args.dist}" if args.dist else f"trace/{os.path.basename(args.trace)}"
+        metrics = {"achieved_gbps": summary["achieved_gbps"], "start_lag_p99_s": summary["start_lag_p99_s"]}
+        for b in summary["buckets"]:
+            metrics[f"completion_p99_s/{b['bucket']}"] = b["p99_s"]
+            metrics[f"slowdown_p99/{b['bucket']}"] = b["p99_slowdown"]
+        record(f"replay/{workload}/x{args.speed:g}", metrics, "rdma_replay",
+               {"server": args.server, "seed": args.seed, "arrivals": len(records), "failed": summary["failed"]})
+    print("RESULT " + json.dumps(dict(summary, server=args.server, speed=args.speed, offered_bytes=offered)))
+    return 0 if summary["failed"] == 0 else 2
+
+
+if __name__ == "__main__":
+    sys.exit(main())
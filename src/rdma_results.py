@@ -0,0 +1,331 @@
+#!/usr/bin/env python3
+# rdma_results.py -- persistent benchmark results and regression checks
+#
+# The benchmark tools and the GUI append one JSON line per measurement to
+# logs/bench_results.jsonl (RDMA_BENCH_STORE overrides the path). Each line
+# names a scenario, holds its metrics (a number or a list of samples) and
+# records where it was measured: host, kernel, CPU, RDMA devices and git
+# commit. "compare" pools every sample of a scenario at a baseline commit
+# and at a candidate commit on the same host, and flags metrics that got
+# significantly worse. The baseline per scenario is pinned with "baseline",
+# or else it is the newest earlier commit that has results. "run" records the
+# RESULT line of any native tool. The size, RESULT-line and percentile
+# helpers the tools share live here too.
+
+import argparse
+import fnmatch
+import json
+import math
+import os
+import platform
+import random
+import re
+import statistics
+import subprocess
+import sys
+import time
+
+BASE_DIR = os.path.dirname(os.path.abspath(__file__))
+STORE = os.environ.get("RDMA_BENCH_STORE", os.path.join(BASE_DIR, "logs", "bench_results.jsonl"))
+
+# metrics named like these are better when larger; everything else (times, CPU, memory) when smaller
+HIGHER_IS_BETTER = ("mbps", "gbps", "throughput", "jain", "ops", "per_s")
+
+_meta = None
+
+
+# ---------- shared by the tools ----------
+
+def parse_size(s):
+    """4096, 64K, 10M, 2G, as rdma_gen_data takes them."""
+    s = s.strip()
+    mult = {"k": 1 << 10, "m": 1 << 20, "g": 1 << 30}.get(s[-1:].lower(), 1)
+    return int(float(s[:-1] if mult > 1 else s) * mult)
+
+
+def parse_result_line(output):
+    """The JSON summary the native tools print on a 'RESULT {...}' line, or None."""
+    if isinstance(output, bytes):
+        output = output.decode(errors="replace")
+    for line in reversed((output or "").splitlines()):
+        if line.startswith("RESULT "):
+            try:
+                return json.loads(line[len("RESULT "):])
+            except ValueError:
+                return None
+    return None
+
+
+def percentile(sorted_values, p):
+    """Nearest-rank percentile of an ascending list."""
+    if not sorted_values:
+        return 0.0
+    return sorted_values[max(0, math.ceil(p / 100 * len(sorted_values)) - 1)]
+
+
+# ---------- statistics ----------
+
+def bootstrap_ci(xs, stat, rng, n=2000, level=0.95):
+    """Percentile bootstrap interval of stat over xs."""
+    if len(xs) < 2:
+        return (stat(xs), stat(xs)) if xs else (0.0, 0.0)
+    boots = sorted(stat(rng.choices(xs, k=len(xs))) for _ in range(n))
+    lo = (1 - level) / 2
+    return boots[int(lo * n)], boots[min(n - 1, int((1 - lo) * n))]
+
+
+def ratio_ci(a, b, rng, n=2000, level=0.95):
+    """Bootstrap interval of median(b) / median(a), resampling both sides."""
+    boots = sorted(statistics.median(rng.choices(b, k=len(b))) / max(statistics.median(rng.choices(a, k=len(a))), 1e-12)
+                   for _ in range(n))
+    lo = (1 - level) / 2
+    return boots[int(lo * n)], boots[min(n - 1, int((1 - lo) * n))]
+
+
+def mann_whitney_p(a, b):
+    """Two-sided Mann-Whitney U p-value, normal approximation with tie correction."""
+    n1, n2 = len(a), len(b)
+    if not n1 or not n2:
+        return 1.0
+    pooled = sorted((v, i) for i, v in enumerate(a + b))
+    ranks = [0.0] * (n1 + n2)
+    ties = 0.0
+    i = 0
+    while i < len(pooled):
+        j = i
+        while j + 1 < len(pooled) and pooled[j + 1][0] == pooled[i][0]:
+            j += 1
+        for k in range(i, j + 1):
+            ranks[pooled[k][1]] = (i + j) / 2 + 1
+        t = j - i + 1
+        ties += t ** 3 - t
+        i = j + 1
+    u = sum(ranks[:n1]) - n1 * (n1 + 1) / 2
+    n = n1 + n2
+    var = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)))
+    if var <= 0:
+        return 1.0
+    z = (abs(u - n1 * n2 / 2) - 0.5) / math.sqrt(var)
+    return math.erfc(max(z, 0.0) / math.sqrt(2))
+
+
+# ---------- store ----------
+
+def _read(path):
+    try:
+        with open(path) as f:
+            return f.read().strip()
+    except OSError:
+        return ""
+
+
+def environment():
+    """Where results are measured; computed once per process."""
+    global _meta
+    if _meta is None:
+        def git(*args):
+            try:
+                return subprocess.run(["git", "-C", BASE_DIR] + list(args), capture_output=True, text=True,
+                                      timeout=10).stdout.strip()
+            except (OSError, subprocess.SubprocessError):
+                return ""
+        commit = git("rev-parse", "--short", "HEAD") or "unknown"
+        if git("status", "--porcelain", "--untracked-files=no"):
+            commit += "-dirty"
+        m = re.search(r"^model name\s*:\s*(.+)$", _read("/proc/cpuinfo"), re.M)
+        ib = "/sys/class/infiniband"
+        devices = sorted(f"{d} fw {_read(os.path.join(ib, d, 'fw_ver')) or '?'}"
+                         for d in (os.listdir(ib) if os.path.isdir(ib) else []))
+        _meta = {"host": platform.node(), "kernel": platform.release(), "cpu": m.group(1) if m else platform.machine(),
+                 "devices": devices, "commit": commit}
+    return _meta
+
+
+def record(scenario, metrics, tool, params=None, store=None):
+    """Append one result. metrics maps a name to a number or a list of samples."""
+    line = dict(environment(), time=time.strftime("%Y-%m-%dT%H:%M:%S"), scenario=scenario, tool=tool,
+                params=params or {}, metrics=metrics)
+    path = store or STORE
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "a") as f:
+        f.write(json.dumps(line) + "\n")
+
+
+def numeric_metrics(result, prefix=""):
+    """The numbers in a RESULT object, keyed by path: ceiling_gbps/send, runs/0/gbps.
+    Strings, booleans and nulls are not metrics."""
+    out = {}
+    items = result.items() if isinstance(result, dict) else enumerate(result)
+    for k, v in items:
+        key = f"{prefix}{k}"
+        if isinstance(v, (dict, list)):
+            out.update(numeric_metrics(v, key + "/"))
+        elif isinstance(v, (int, float)) and not isinstance(v, bool):
+            out[key] = v
+    return out
+
+
+def load(store=None):
+    out = []
+    try:
+        with open(store or STORE) as f:
+            for line in f:
+                try:
+                    out.append(json.loads(line))
+                except ValueError:
+                    pass    # a line cut short by a crash; the rest still counts
+    except FileNotFoundError:
+        pass
+    return out
+
+
+def samples(records, metric):
+    out = []
+    for r in records:
+        v = r["metrics"].get(metric)
+        out += v if isinstance(v, list) else [] if v is None else [v]
+    return out
+
+
+def commit_order(records):
+    """Commits in the order they first produced results."""
+    seen = {}
+    for r in records:
+        seen.setdefault(r["commit"], r["time"])
+    return sorted(seen, key=seen.get)
+
+
+def pick_baseline(scenario, records, candidate, pinned):
+    if scenario in pinned:
+        return pinned[scenario]
+    order = commit_order(records)
+    if candidate not in order:
+        return order[-1] if order else None
+    i = order.index(candidate)
+    return order[i - 1] if i > 0 else None
+
+
+def compare_scenario(records, base, cand, alpha, min_change, rng):
+    """Per-metric verdicts of cand against base."""
+    rows = []
+    a_recs = [r for r in records if r["commit"] == base]
+    b_recs = [r for r in records if r["commit"] == cand]
+    for metric in sorted({m for r in a_recs + b_recs for m in r["metrics"]}):
+        a, b = samples(a_recs, metric), samples(b_recs, metric)
+        if not a or not b:
+            continue
+        ratio = statistics.median(b) / max(statistics.median(a), 1e-12)
+        ci = ratio_ci(a, b, rng)
+        p = mann_whitney_p(a, b)
+        # worse means smaller where bigger is better, bigger otherwise
+        worse = ratio < 1 if any(k in metric for k in HIGHER_IS_BETTER) else ratio > 1
+        significant = p < alpha and not ci[0] <= 1.0 <= ci[1] and abs(ratio - 1) >= min_change
+        verdict = ("regression" if worse else "improvement") if significant else "unchanged"
+        if len(a) < 3 or len(b) < 3:
+            verdict = "too few samples" if verdict == "unchanged" else verdict
+        rows.append({"metric": metric, "baseline_n": len(a), "candidate_n": len(b),
+                     "baseline_median": statistics.median(a), "candidate_median": statistics.median(b),
+                     "ratio": ratio, "ci": ci, "p": p, "verdict": verdict})
+    return rows
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Benchmark result store and regression check")
+    ap.add_argument("--store", default=STORE)
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    ls = sub.add_parser("list", help="scenarios, commits and sample counts")
+    ls.add_argument("--scenario", default="*", help="glob")
+    bl = sub.add_parser("baseline", help="pin the baseline commit of scenarios")
+    bl.add_argument("commit")
+    bl.add_argument("--scenario", default="*", help="glob")
+    cmp = sub.add_parser("compare", help="flag regressions of a commit against its baselines")
+    cmp.add_argument("--candidate", help="commit to check (default: the newest with results)")
+    cmp.add_argument("--scenario", default="*", help="glob")
+    cmp.add_argument("--alpha", type=float, default=0.05, help="significance level")
+    cmp.add_argument("--min-change", type=float, default=0.05, help="ignore changes smaller than this fraction")
+    cmp.add_argument("--any-host", action="store_true", help="also pool results from other hosts")
+    cmp.add_argument("--seed", type=int, default=1)
+    run = sub.add_parser("run", help="run a native tool and record the numbers on its RESULT line")
+    run.add_argument("scenario", help="e.g. bench/4K-1M or storm/1000")
+    run.add_argument("argv", nargs=argparse.REMAINDER, help="-- command and its arguments")
+    args = ap.parse_args()
+
+    if args.cmd == "run":
+        argv = args.argv[1:] if args.argv[:1] == ["--"] else args.argv
+        if not argv:
+            sys.exit("[Results] run needs a command")
+        try:
+            proc = subprocess.run(argv, stdout=subprocess.PIPE, text=True)
+        except OSError as e:
+            sys.exit(f"[Results] {argv[0]}: {e}")
+        sys.stdout.write(proc.stdout)
+        result = parse_result_line(proc.stdout)
+        if proc.returncode != 0 or not result:
+            print(f"[Results] Not recorded: {'exit ' + str(proc.returncode) if proc.returncode else 'no RESULT line'}")
+            return proc.returncode or 1
+        record(args.scenario, numeric_metrics(result), os.path.basename(argv[0]), {"argv": argv[1:]}, args.store)
+        print(f"[Results] Recorded {args.scenario}")
+        return 0
+
+    baselines_path = os.path.splitext(args.store)[0] + "_baselines.json"
+    try:
+        with open(baselines_path) as f:
+            pinned = json.load(f)
+    except (OSError, ValueError):
+        pinned = {}
+    records = load(args.store)
+    by_scenario = {}
+    for r in records:
+        if fnmatch.fnmatchcase(r["scenario"], args.scenario):
+            by_scenario.setdefault(r["scenario"], []).append(r)
+
+    if args.cmd == "list":
+        for scenario, recs in sorted(by_scenario.items()):
+            pin = f" (baseline {pinned[scenario]})" if scenario in pinned else ""
+            print(f"[Results] {scenario}{pin}")
+            for commit in commit_order(recs):
+                rs = [r for r in recs if r["commit"] == commit]
+                n = max(len(samples(rs, m)) for m in {m for r in rs for m in r["metrics"]})
+                print(f"[Results]     {commit:16s} {len(rs):4d} runs, {n:4d} samples, {rs[-1]['host']}, last {rs[-1]['time']}")
+        return 0
+
+    if args.cmd == "baseline":
+        hits = [s for s, recs in by_scenario.items() if any(r["commit"] == args.commit for r in recs)]
+        if not hits:
+            sys.exit(f"[Results] no results at {args.commit} for {args.scenario}")
+        for s in hits:
+            pinned[s] = args.commit
+        with open(baselines_path, "w") as f:
+            json.dump(pinned, f, indent=1, sort_keys=True)
+        print(f"[Results] Baseline {args.commit} pinned for {len(hits)} scenarios")
+        return 0
+
+    rng = random.Random(args.seed)
+    host = environment()["host"]
+    report, regressions = [], 0
+    for scenario, recs in sorted(by_scenario.items()):
+        if not args.any_host:
+            recs = [r for r in recs if r["host"] == host]
+        cand = args.candidate or (commit_order(recs)[-1] if recs else None)
+        base = pick_baseline(scenario, recs, cand, pinned)
+        if not cand or not base or base == cand:
+            continue
+        rows = compare_scenario(recs, base, cand, args.alpha, args.min_change, rng)
+        if not rows:
+            continue
+        report.append({"scenario": scenario, "baseline": base, "candidate": cand, "metrics": rows})
+        print(f"[Results] {scenario}: {cand} against {base}")
+        for row in rows:
+            regressions += row["verdict"] == "regression"
+            print(f"[Results]     {row['metric']:20s} {row['baseline_median']:12.6g} -> {row['candidate_median']:12.6g} "
+                  f"x{row['ratio']:.3f} [{row['ci'][0]:.3f}, {row['ci'][1]:.3f}] p={row['p']:.4f}  "
+                  f"{row['verdict'].upper() if row['verdict'] == 'regression' else row['verdict']}")
+    if not report:
+        print("[Results] Nothing to compare: every scenario needs results at two commits")
+    print(f"[Results] {regressions} regressions")
+    print("RESULT " + json.dumps({"regressions": regressions, "scenarios": report}))
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
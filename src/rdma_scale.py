@@ -0,0 +1,246 @@
+#!/usr/bin/env python3
+# rdma_scale.py -- concurrency scaling benchmark: N clients against one rdma_file_server
+#
+# For each N in --clients, N clients each send one file at the same moment,
+# each on its own QP. Clients are rdma_file_client processes, or threads
+# running the in-process engine with --threads. Every step reports aggregate
+# throughput, fairness across clients (Jain's index), completion-time
+# percentiles and the server's CPU per GB, read from its admin socket. The
+# step after which adding clients stops paying is reported with the likely
+# limit.
+
+import argparse
+import json
+import os
+import socket
+import subprocess
+import sys
+import threading
+import time
+
+from rdma_engine import load_engine, EngineError
+from rdma_results import parse_result_line, percentile, record
+
+BASE_DIR = os.path.dirname(os.path.abspath(__file__))
+
+
+def admin_query(path):
+    """One JSON snapshot from the server's --admin socket."""
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+        s.settimeout(2.0)
+        s.connect(path)
+        data = b""
+        while not data.endswith(b"\n"):
+            chunk = s.recv(4096)
+            if not chunk:
+                break
+            data += chunk
+    return json.loads(data)
+
+
+def jain_index(xs):
+    """(sum x)^2 / (n * sum x^2): 1 when every client got the same, 1/n when one got everything."""
+    sq = sum(x * x for x in xs)
+    return sum(xs) ** 2 / (len(xs) * sq) if sq > 0 else 0.0
+
+
+class Clients:
+    """Runs n simultaneous transfers; returns [(start, end, RESULT dict or None, error or None)].
+
+    start and end are time.monotonic() around the call or the client process; run_step
+    times the transfer itself from the RESULT line instead."""
+
+    def __init__(self, server, src, threads, engine):
+        self.server = server
+        self.src = src
+        self.threads = threads
+        self.engine = engine
+        self.exe = os.path.join(BASE_DIR, "rdma_file_client")
+
+    def run(self, n):
+        out = [None] * n
+        go = threading.Barrier(n)
+
+        def worker(i):
+            go.wait()
+            start = time.monotonic()
+            if self.threads:
+                try:
+                    result, error = self.engine.send_file(self.server, self.src), None
+                except EngineError as e:
+                    result, error = None, str(e)
+            else:
+                try:
+                    proc = subprocess.run([self.exe, self.server, self.src, "--no-zero-rtt"], cwd=BASE_DIR,
+                                          capture_output=True, text=True)
+                    result = parse_result_line(proc.stdout)
+                    error = proc.stderr.strip() if proc.returncode not in (0, 2) else None
+                except OSError as e:
+                    result, error = None, str(e)
+            out[i] = (start, time.monotonic(), result, error)
+
+        workers = [threading.Thread(target=worker, args=(i,)) for i in range(n)]
+        for w in workers:
+            w.start()
+        for w in workers:
+            w.join()
+        return out
+
+
+def server_delta(before, after):
+    bytes_ = sum(after["bytes"].values()) - sum(before["bytes"].values())
+    cpu = after["rusage"]["cpu_s"] - before["rusage"]["cpu_s"]
+    busy = after["reactor"]["busy_s"] - before["reactor"]["busy_s"]
+    return bytes_, cpu, busy
+
+
+def transfer_span(start, result):
+    """(begin, end) of the connect and data phases on the monotonic clock.
+
+    The executable reports when its connect began (phases.start_s, CLOCK_MONOTONIC like
+    time.monotonic); the in-process engine starts connecting as soon as it is called."""
+    phases = result.get("phases", {})
+    begin = phases.get("start_s", start)
+    return begin, begin + phases.get("connected_s", 0.0) + result["elapsed_s"]
+
+
+def run_failure(result, error):
+    """Why a transfer does not count, or None. A BLAKE3 mismatch is a failure even though
+    the client exits 2 without an error and the engine still returns its statistics."""
+    if error:
+        return error
+    if not result:
+        return "no RESULT line"
+    if not result.get("digest_match"):
+        return "BLAKE3 digest mismatch"
+    return None
+
+
+def run_step(clients, n, reps, admin):
+    completions, rates, credit_fracs, errors = [], [], [], []
+    wall = total_bytes = 0.0
+    before = admin_query(admin) if admin else None
+    for _ in range(reps):
+        runs = clients.run(n)
+        failures = [run_failure(result, error) for _, _, result, error in runs]
+        ok = [r for r, f in zip(runs, failures) if not f]
+        errors += [f for f in failures if f]
+        if not ok:
+            continue
+        spans = [transfer_span(start, result) for start, _, result, _ in ok]
+        wall += max(e for _, e in spans) - min(b for b, _ in spans)
+        for (begin, end), (_, _, result, _) in zip(spans, ok):
+            took = end - begin
+            completions.append(took)
+            rates.append(result["file_size"] / took)
+            total_bytes += result["file_size"]
+            credit_fracs.append(result.get("credit_wait_s", 0.0) / took)
+    step = {
+        "clients": n,
+        "transfers": len(completions),
+        "failed": len(errors),
+        "aggregate_gbps": total_bytes * 8 / wall / 1e9 if wall > 0 else 0.0,
+        "jain": jain_index(rates) if rates else 0.0,
+        "completion_p50_s": percentile(sorted(completions), 50),
+        "completion_p99_s": percentile(sorted(completions), 99),
+        "credit_wait_frac": sum(credit_fracs) / len(credit_fracs) if credit_fracs else 0.0,
+    }
+    if admin:
+        bytes_, cpu, busy = server_delta(before, admin_query(admin))
+        step["server_cpu_s_per_gb"] = cpu / (bytes_ / 1e9) if bytes_ > 0 else 0.0
+        step["server_cpu_util"] = cpu / wall if wall > 0 else 0.0
+        step["reactor_util"] = busy / wall if wall > 0 else 0.0
+    return step, errors
+
+
+def likely_limit(step):
+    """The first explanation the numbers support for a step that did not scale."""
+    if step.get("server_cpu_util", 0.0) >= 0.9 or step.get("reactor_util", 0.0) >= 0.9:
+        return "server reactor saturated (one thread)"
+    if step["credit_wait_frac"] >= 0.3:
+        return "clients waiting for credits (shared --credits pool)"
+    if step["jain"] < 0.8:
+        return "unfair sharing between clients"
+    return "link or client bound"
+
+
+def start_server(engine, admin, extra):
+    args = ["--multi", "--admin", admin] + extra
+    if os.path.exists(admin):
+        os.unlink(admin)    # a stale socket would look like a server that is already up
+    log = os.path.join(BASE_DIR, "logs", "rdma_scale_server.log")
+    os.makedirs(os.path.dirname(log), exist_ok=True)
+    if engine:
+        server = engine.start_server(*args, log=log)
+    else:
+        with open(log, "w") as f:
+            server = subprocess.Popen([os.path.join(BASE_DIR, "rdma_file_server")] + args, cwd=BASE_DIR,
+                                      stdout=f, stderr=subprocess.STDOUT)
+    deadline = time.monotonic() + 5
+    while not os.path.exists(admin):
+        if server.poll() is not None or time.monotonic() > deadline:
+            sys.exit(f"[Scale] Server did not come up; see {log}")
+        time.sleep(0.05)
+    return server
+
+
+def main():
+    ap = argparse.ArgumentParser(description="N-client scaling benchmark against one rdma_file_server")
+    ap.add_argument("server", nargs="?", default="127.0.0.1")
+    ap.add_argument("--clients", default="1,2,4,8,16", help="comma-separated client counts")
+    ap.add_argument("--size", default="100M", help="bytes per client, e.g. 64M")
+    ap.add_argument("--reps", type=int, default=3, help="repetitions per client count")
+    ap.add_argument("--threads", action="store_true", help="threads on the in-process engine instead of processes")
+    ap.add_argument("--admin", help="admin socket of a running server (--admin on rdma_file_server)")
+    ap.add_argument("--start-server", action="store_true", help="start a local --multi server for the run")
+    ap.add_argument("--server-arg", action="append", default=[], help="extra rdma_file_server option, repeatable")
+    ap.add_argument("--no-store", action="store_true", help="do not append the steps to the result store")
+    args = ap.parse_args()
+
+    counts = sorted({int(c) for c in args.clients.split(",") if int(c) > 0})
+    engine = load_engine()
+    if args.threads and not engine:
+        sys.exit("[Scale] --threads needs librdma_engine.so")
+    server = None
+    admin = args.admin
+    if args.start_server:
+        admin = admin or os.path.join(BASE_DIR, "logs", "rdma_scale.sock")
+        server = start_server(engine, admin, args.server_arg)
+
+    clients = Clients(args.server, f"gen:{args.size}", args.threads, engine)
+    print(f"[Scale] {args.server}: {', '.join(map(str, counts))} clients x {args.size}, {args.reps} reps, "
+          f"{'threads' if args.threads else 'processes'}")
+    steps = []
+    try:
+        for n in counts:
+            step, errors = run_step(clients, n, args.reps, admin)
+            steps.append(step)
+            if not args.no_store and step["transfers"]:
+                record(f"scale/{'threads' if args.threads else 'processes'}/{args.size}/{n}",
+                       {k: v for k, v in step.items() if k not in ("clients", "transfers", "failed")},
+                       "rdma_scale", {"server": args.server, "reps": args.reps, "server_args": args.server_arg})
+            cpu = (f", server CPU {step['server_cpu_s_per_gb']:.3f} s/GB ({step['server_cpu_util'] * 100:.0f}% of a core)"
+                   if "server_cpu_s_per_gb" in step else "")
+            print(f"[Scale] {n:3d} clients: {step['aggregate_gbps']:.2f} Gbit/s aggregate, Jain {step['jain']:.3f}, "
+                  f"completion p50 {step['completion_p50_s'] * 1e3:.1f} ms / p99 {step['completion_p99_s'] * 1e3:.1f} ms, "
+                  f"credit wait {step['credit_wait_frac'] * 100:.0f}%{cpu}")
+            for e in errors[:3]:
+                print(f"[Scale]     failed: {e.splitlines()[-1] if e else e}")
+    finally:
+        if server:
+            server.terminate()
+
+    # scaling stops at the first step where the added clients bought under 10% more throughput
+    knee = None
+    for prev, cur in zip(steps, steps[1:]):
+        if cur["aggregate_gbps"] < prev["aggregate_gbps"] * 1.10:
+            knee = {"clients": prev["clients"], "limit": likely_limit(cur)}
+            print(f"[Scale] Scaling stops at {prev['clients']} clients: {knee['limit']}")
+            break
+    print("RESULT " + json.dumps({"server": args.server, "size": args.size, "reps": args.reps,
+                                  "mode": "threads" if args.threads else "processes", "steps": steps, "knee": knee}))
+    return 0 if all(s["failed"] == 0 for s in steps) else 2
+
+
+if __name__ == "__main__":
+    sys.exit(main())
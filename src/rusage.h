@@ -0,0 +1,60 @@
+// rusage.h -- getrusage snapshots for the tools' RESULT lines
+//
+// A phase is the difference between two snapshots of CPU time, context
+// switches and page faults. Peak RSS is a high-water mark, so a phase reports
+// the peak seen at its end. RUSAGE_THREAD gives CPU time, switches and faults
+// for one thread, but Linux reports the whole process's ru_maxrss there, so a
+// thread snapshot carries max_rss_kb = -1 and its JSON leaves the field out.
+#ifndef RUSAGE_H
+#define RUSAGE_H
+
+#include <stdio.h>
+#include <sys/resource.h>
+
+struct usage {
+    double user_s, sys_s;
+    long max_rss_kb;
+    long vcsw, ivcsw;       // voluntary / involuntary context switches
+    long minflt, majflt;
+};
+
+static inline void usage_now(int who, struct usage *u) {
+    struct rusage ru;
+    if (getrusage(who, &ru) != 0) {
+        *u = (struct usage){0};
+        return;
+    }
+    u->user_s = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+    u->sys_s = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    u->max_rss_kb = ru.ru_maxrss;
+#ifdef RUSAGE_THREAD
+    if (who == RUSAGE_THREAD) u->max_rss_kb = -1;
+#endif
+    u->vcsw = ru.ru_nvcsw;
+    u->ivcsw = ru.ru_nivcsw;
+    u->minflt = ru.ru_minflt;
+    u->majflt = ru.ru_majflt;
+}
+
+// usage of who since start
+static inline struct usage usage_since(const struct usage *start, int who) {
+    struct usage u;
+    usage_now(who, &u);
+    u.user_s -= start->user_s;
+    u.sys_s -= start->sys_s;
+    u.vcsw -= start->vcsw;
+    u.ivcsw -= start->ivcsw;
+    u.minflt -= start->minflt;
+    u.majflt -= start->majflt;
+    return u;
+}
+
+static inline void usage_json(const struct usage *u, char *out, size_t n) {
+    char rss[48] = "";
+    if (u->max_rss_kb >= 0) snprintf(rss, sizeof(rss), "\"max_rss_kb\": %ld, ", u->max_rss_kb);
+    snprintf(out, n, "{\"user_s\": %.6f, \"sys_s\": %.6f, \"cpu_s\": %.6f, %s"
+             "\"vol_ctx_switches\": %ld, \"invol_ctx_switches\": %ld, \"minor_faults\": %ld, \"major_faults\": %ld}",
+             u->user_s, u->sys_s, u->user_s + u->sys_s, rss, u->vcsw, u->ivcsw, u->minflt, u->majflt);
+}
+
+#endif
@@ -1,16 +1,29 @@
 # tcp_client.py
+import resource
 import socket
 import time
 
+def cpu_seconds():
+    ru = resource.getrusage(resource.RUSAGE_SELF)
+    return ru.ru_utime + ru.ru_stime
+
 def send_file(file_path, host, port=12345):
     start_time = time.time()
     with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
         s.connect((host, port))
+        # the send phase only, like rdma_file_client's data-phase rusage, so interpreter start-up is left out
+        cpu0 = cpu_seconds()
         with open(file_path, 'rb') as f:
             while chunk := f.read(4096):
                 s.sendall(chunk)
+        # done only when the server has written everything and acknowledged it
+        s.shutdown(socket.SHUT_WR)
+        while s.recv(16):
+            pass
+        send_cpu = cpu_seconds() - cpu0
     elapsed = time.time() - start_time
     print(f"TCP Transfer completed in {elapsed:.4f} seconds")
+    print(f"TCP send phase CPU: {send_cpu:.6f} seconds")
     return elapsed
 
 if __name__ == "__main__":
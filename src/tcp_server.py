@@ -1,21 +1,29 @@
 # tcp_server.py
 import socket
+import sys
 
-def start_server(host="0.0.0.0", port=12345):
+def start_server(host="0.0.0.0", port=12345, loop=False):
     with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
+        s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
         s.bind((host, port))
         s.listen(1)
         print(f"TCP Server listening on {host}:{port}")
-        conn, addr = s.accept()
-        with conn:
-            print(f"Connected by {addr}")
-            with open("logs/tcp_received_file.txt", "wb") as f:
-                while True:
-                    data = conn.recv(4096)
-                    if not data:
-                        break
-                    f.write(data)
-            print("File received")
+        while True:
+            conn, addr = s.accept()
+            with conn:
+                print(f"Connected by {addr}")
+                with open("logs/tcp_received_file.txt", "wb") as f:
+                    while True:
+                        data = conn.recv(4096)
+                        if not data:
+                            break
+                        f.write(data)
+                # the client's clock stops at this ack, once the file is on the server
+                conn.sendall(b"\x01")
+                print("File received", flush=True)
+            if not loop:
+                break
 
 if __name__ == "__main__":
-    start_server()
+    # --loop keeps accepting, one file after another (rdma_ab.py)
+    start_server(loop="--loop" in sys.argv[1:])